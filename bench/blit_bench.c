@@ -0,0 +1,95 @@
+/*
+ * Microbenchmark of the screen expansion in src/blit.c, at every scale
+ * factor from 1 to 16. Prints two lines per scale, one for a plane and one
+ * for the two planes of the XO-CHIP:
+ *
+ * blit <scale> <copy used> <ns per frame> <megapixels per second>
+ * planes <scale> <copy used> <ns per frame> <megapixels per second>
+ * */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/chip8.h"
+#include "../src/blit.h"
+
+#define BLIT_BENCH_MAX_SCALE 16
+
+// frames expanded for each scale, enough to last a few ms at scale 16
+#define BLIT_BENCH_FRAMES 2000
+
+
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static const uint32_t plane_colors[4] = { 0xFF000000, 0xFF68C3A3, 
+                                          0xFFC36868, 0xFFFFFFFF };
+
+static void print_rate(const char *what, const BlitTable *table, 
+                       uint64_t elapsed)
+{
+    double frame_ns = (double) elapsed / BLIT_BENCH_FRAMES;
+    double pixels_frame = (double) WINDOW_WIDTH * WINDOW_HEIGHT 
+                          * table->scale * table->scale;
+
+    printf("%s %u %s %.0f %.1f\n", what, table->scale, blit_kind(table),
+           frame_ns, pixels_frame / frame_ns * 1000);
+}
+
+int main()
+{
+    uint64_t rows[WINDOW_HEIGHT], second[WINDOW_HEIGHT];
+    unsigned int scale, frame, row;
+
+    // something that looks like a game, half the pixels lit
+    for (row = 0; row < WINDOW_HEIGHT; ++row)
+    {
+        rows[row] = 0x5AA5F00F0FF0A55AULL ^ ((uint64_t) row * 0x9E3779B97F4A7C15ULL);
+        second[row] = rows[row] << 3 ^ rows[row] >> 5;
+    }
+
+    for (scale = 1; scale <= BLIT_BENCH_MAX_SCALE; ++scale)
+    {
+        BlitTable table;
+        unsigned int pitch = WINDOW_WIDTH * scale * sizeof(uint32_t);
+        uint32_t *pixels = malloc(pitch * WINDOW_HEIGHT * scale);
+
+        if (pixels == NULL || !blit_init(&table, scale, 0xFF68C3A3, 0xFF000000)) {
+            fprintf(stderr, "blit_bench: out of memory at scale %u\n", scale);
+            return 1;
+        }
+
+        // warm up the table and the destination
+        blit_rows(&table, rows, WINDOW_WIDTH, WINDOW_HEIGHT, pixels, pitch);
+
+        uint64_t start = monotonic_ns();
+        for (frame = 0; frame < BLIT_BENCH_FRAMES; ++frame)
+        {
+            // change a row so the compiler can't hoist the work out
+            rows[frame % WINDOW_HEIGHT] ^= frame;
+            blit_rows(&table, rows, WINDOW_WIDTH, WINDOW_HEIGHT, pixels, pitch);
+        }
+        print_rate("blit", &table, monotonic_ns() - start);
+
+        start = monotonic_ns();
+        for (frame = 0; frame < BLIT_BENCH_FRAMES; ++frame)
+        {
+            second[frame % WINDOW_HEIGHT] ^= frame;
+            blit_planes(&table, rows, second, plane_colors, WINDOW_WIDTH,
+                        WINDOW_HEIGHT, pixels, pitch);
+        }
+        print_rate("planes", &table, monotonic_ns() - start);
+
+        blit_free(&table);
+        free(pixels);
+    }
+
+    return 0;
+}
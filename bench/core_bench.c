@@ -0,0 +1,242 @@
+/*
+ * Benchmarks of the interpreter, built with the same sources as the
+ * emulator. Every figure is the median of CORE_BENCH_RUNS runs, so it moves
+ * little between runs on the same machine. Prints one line per benchmark:
+ *
+ * rom <name> <instructions> <ns> <millions of instructions per second>
+ *                           the synthetic roms of workloads.c, and the roms
+ *                           given as arguments, run headless and unthrottled
+ * dispatch <profile> <ns per opcode>
+ *                           step() over a rom of 6XNN, the cheapest opcode,
+ *                           so what's left is fetching and dispatching
+ * draw <kind> <ns per sprite>
+ *                           the DXYN handlers called straight
+ * window <kind> <ns per frame>
+ *                           the expansion update_window() does before
+ *                           handing the texture to SDL, at the default scale
+ * */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/chip8.h"
+#include "../src/opcodes.h"
+#include "../src/blit.h"
+#include "../src/workloads.h"
+
+#define CORE_BENCH_RUNS 5
+
+// opcodes each rom runs for, per run
+#define CORE_BENCH_INSTRUCTIONS 20000000
+
+// calls per run of the microbenchmarks
+#define CORE_BENCH_CALLS 1000000
+#define CORE_BENCH_FRAMES 2000
+
+static cpu cpuData;
+static MemMaps mems;
+
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int by_value(const void *a, const void *b)
+{
+    uint64_t first = *(const uint64_t *) a, second = *(const uint64_t *) b;
+
+    return (first > second) - (first < second);
+}
+
+static uint64_t median(uint64_t *runs)
+{
+    qsort(runs, CORE_BENCH_RUNS, sizeof(runs[0]), by_value);
+    return runs[CORE_BENCH_RUNS / 2];
+}
+
+//******************************************************************************
+//*                                  roms                                      *
+//******************************************************************************
+
+// run count opcodes of the rom with the original tables, as the training 
+// mode does without -Q
+static uint64_t run(const uint8_t *rom, unsigned int size, unsigned long count)
+{
+    return workload_run(&cpuData, &mems, "default", rom, size, count);
+}
+
+static void bench_rom(const char *name, const uint8_t *rom, unsigned int size)
+{
+    uint64_t runs[CORE_BENCH_RUNS];
+    unsigned int index;
+
+    for (index = 0; index < CORE_BENCH_RUNS; ++index)
+    {
+        runs[index] = run(rom, size, CORE_BENCH_INSTRUCTIONS);
+    }
+
+    uint64_t elapsed = median(runs);
+    printf("rom %s %u %llu %.1f\n", name, CORE_BENCH_INSTRUCTIONS,
+           (unsigned long long) elapsed,
+           CORE_BENCH_INSTRUCTIONS * 1000.0 / elapsed);
+}
+
+static void bench_file(const char *path)
+{
+    static uint8_t rom[XO_RAM_SIZE - PROG_RAM_START];
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+        perror("core_bench: ");
+        return;
+    }
+
+    unsigned int size = fread(rom, 1, sizeof(rom), file);
+    fclose(file);
+
+    const char *name = strrchr(path, '/');
+    bench_rom(name != NULL ? name + 1 : path, rom, size);
+}
+
+//******************************************************************************
+//*                             microbenchmarks                                *
+//******************************************************************************
+
+static void bench_dispatch()
+{
+    static uint8_t rom[256];
+    uint64_t runs[CORE_BENCH_RUNS];
+    unsigned int index;
+
+    // LD VX, NN all the way, and a jump back to the start
+    for (index = 0; index < sizeof(rom) - 2; index += 2)
+    {
+        rom[index] = 0x60 | (index / 2 & 0xF);
+        rom[index + 1] = index;
+    }
+    rom[index] = 0x12;
+    rom[index + 1] = 0x00;
+
+    for (index = 0; index < CORE_BENCH_RUNS; ++index)
+    {
+        runs[index] = run(rom, sizeof(rom), CORE_BENCH_INSTRUCTIONS);
+    }
+
+    printf("dispatch %s %.2f\n", machine_quirks(&mems),
+           (double) median(runs) / CORE_BENCH_INSTRUCTIONS);
+}
+
+// call handler with the sprites of the font, n rows each, moving around
+static void bench_draw(const char *kind, opfunc handler, unsigned int n)
+{
+    uint64_t runs[CORE_BENCH_RUNS];
+    unsigned int index, call;
+
+    for (index = 0; index < CORE_BENCH_RUNS; ++index)
+    {
+        uint64_t start = monotonic_ns();
+
+        for (call = 0; call < CORE_BENCH_CALLS; ++call)
+        {
+            cpuData.regs[0] = call * 7;
+            cpuData.regs[1] = call * 3;
+            cpuData.i = call % 16 * FONTSET_BYTES_PER_CHAR;
+            handler(0xD010 | n, &cpuData, &mems);
+        }
+
+        runs[index] = monotonic_ns() - start;
+    }
+
+    printf("draw %s %.2f\n", kind, (double) median(runs) / CORE_BENCH_CALLS);
+}
+
+static void bench_window(const char *kind, unsigned int scale,
+                         unsigned int width, unsigned int height, int planes)
+{
+    static const uint32_t colors[4] = { 0xFF000000, 0xFF68C3A3, 0xFFFFFFFF,
+                                        0xFF555555 };
+    uint64_t runs[CORE_BENCH_RUNS];
+    unsigned int pitch = width * scale * sizeof(uint32_t);
+    uint32_t *pixels = malloc(pitch * height * scale);
+    unsigned int index, frame, word;
+    BlitTable table;
+
+    if (pixels == NULL || !blit_init(&table, scale, colors[1], colors[0])) {
+        fprintf(stderr, "core_bench: out of memory\n");
+        exit(1);
+    }
+
+    for (word = 0; word < SCREEN_WORDS; ++word)
+    {
+        mems.screen[0][word] = 0x5AA5F00F0FF0A55AULL * (word + 1);
+        mems.screen[1][word] = planes ? ~mems.screen[0][word] >> 3 : 0;
+    }
+
+    for (index = 0; index < CORE_BENCH_RUNS; ++index)
+    {
+        uint64_t start = monotonic_ns();
+
+        for (frame = 0; frame < CORE_BENCH_FRAMES; ++frame)
+        {
+            // change a row so the compiler can't hoist the work out
+            mems.screen[0][frame % SCREEN_WORDS] ^= frame;
+
+            if (planes) {
+                blit_planes(&table, mems.screen[0], mems.screen[1], colors,
+                            width, height, pixels, pitch);
+            } else {
+                blit_rows(&table, mems.screen[0], width, height, pixels,
+                          pitch);
+            }
+        }
+
+        runs[index] = monotonic_ns() - start;
+    }
+
+    printf("window %s %.0f\n", kind,
+           (double) median(runs) / CORE_BENCH_FRAMES);
+
+    blit_free(&table);
+    free(pixels);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int index;
+
+    for (index = 0; workloads[index].name != NULL; ++index)
+    {
+        bench_rom(workloads[index].name, workloads[index].rom,
+                  workloads[index].size);
+    }
+
+    for (index = 1; index < (unsigned int) argc; ++index)
+    {
+        bench_file(argv[index]);
+    }
+
+    bench_dispatch();
+
+    initialize(&cpuData, &mems, "default");
+    bench_draw("8x5", draw, 5);
+    bench_draw("8x15", draw, 15);
+    bench_draw("8x15-clip", draw_clip, 15);
+
+    mems.hires = 1;
+    bench_draw("hires-16x16", draw_ext, 0);
+    mems.hires = 0;
+
+    // update_window() scales the high resolution half as much
+    bench_window("lores", WINDOW_SCALLING, WINDOW_WIDTH, WINDOW_HEIGHT, 0);
+    bench_window("hires", WINDOW_SCALLING / 2, HIRES_WIDTH, HIRES_HEIGHT, 0);
+    bench_window("hires-planes", WINDOW_SCALLING / 2, HIRES_WIDTH,
+                 HIRES_HEIGHT, 1);
+
+    return 0;
+}
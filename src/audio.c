@@ -0,0 +1,189 @@
+/*
+ * Sound played from the sound timer. See audio.h
+ * */
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "audio.h"
+
+// bits of the pattern, and the fraction bits of the position in it
+#define PATTERN_BITS (8 * sizeof(((MemMaps *) 0)->audio))
+#define PHASE_SHIFT 16
+
+typedef struct AudioSlot
+{
+    uint8_t on;
+    uint8_t pitch;
+    uint8_t pattern[16];
+} AudioSlot;
+
+// single producer, single consumer ring. Only the emulation writes to head
+// and the slots, only the audio callback writes to tail
+typedef struct AudioRing
+{
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+    AudioSlot slots[AUDIO_RING_SIZE];
+} AudioRing;
+
+static AudioRing ring;
+static SDL_AudioDeviceID device = 0;
+static unsigned long ticks_full;
+
+// only touched by the callback, and by audio_close() once it's stopped
+static AudioSlot playing;
+static uint32_t phase, phase_step;
+static unsigned int rate, tick, tick_left;
+static int started, held;
+static unsigned long ticks_late, ticks_dropped;
+
+// move to the next tick in the ring. If it's empty, play this one once more
+// and then silence, so an emulation that stopped doesn't leave the buzzer on
+static void next_tick()
+{
+    uint32_t head = atomic_load_explicit(&ring.head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+
+    // the amount of samples isn't always a multiple of TIMERS_HZ, so the
+    // remainder is spread over the ticks
+    tick = (tick + 1) % TIMERS_HZ;
+    tick_left = (tick + 1) * rate / TIMERS_HZ - tick * rate / TIMERS_HZ;
+
+    if (head == tail) {
+        ticks_late += started;
+        if (held++) {
+            playing.on = 0;
+        }
+        return;
+    }
+    held = 0;
+
+    if (head - tail > AUDIO_MAX_LAG) {
+        ticks_dropped += head - tail - AUDIO_MAX_LAG;
+        tail = head - AUDIO_MAX_LAG;
+    }
+
+    playing = ring.slots[tail & (AUDIO_RING_SIZE - 1)];
+    atomic_store_explicit(&ring.tail, tail + 1, memory_order_release);
+    started = 1;
+
+    double bits = 4000.0 * pow(2.0, (playing.pitch - 64) / 48.0);
+    phase_step = bits * (1 << PHASE_SHIFT) / rate;
+}
+
+static void callback(void *userdata, Uint8 *stream, int len)
+{
+    int16_t *samples = (int16_t *) stream;
+    unsigned int count = len / sizeof(*samples), index, bit;
+
+    (void) userdata;
+
+    for (index = 0; index < count; ++index)
+    {
+        if (tick_left == 0) {
+            next_tick();
+        }
+        --tick_left;
+
+        if (!playing.on) {
+            samples[index] = 0;
+            continue;
+        }
+
+        bit = phase >> PHASE_SHIFT;
+        samples[index] = playing.pattern[bit / 8] & (0x80 >> bit % 8)
+                         ? AUDIO_VOLUME : -AUDIO_VOLUME;
+        phase = (phase + phase_step)
+                & ((PATTERN_BITS << PHASE_SHIFT) - 1);
+    }
+}
+
+int audio_init(unsigned int samples)
+{
+    SDL_AudioSpec want, have;
+
+    if (!samples) {
+        return 0;
+    }
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        fprintf(stderr, "chip8: no audio: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    memset(&want, 0, sizeof(want));
+    want.freq = AUDIO_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = samples;
+    want.callback = callback;
+
+    device = SDL_OpenAudioDevice(NULL, 0, &want, &have,
+                                 SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (device == 0) {
+        fprintf(stderr, "chip8: no audio: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    rate = have.freq;
+    SDL_PauseAudioDevice(device, 0);
+    atexit(audio_close);
+    return 1;
+}
+
+// publish a tick with the buzzer on or off
+static void push(uint8_t on, const MemMaps *mem)
+{
+    // the null sink
+    if (device == 0) {
+        return;
+    }
+
+    uint32_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+
+    // the device stopped taking ticks, it gets the newer ones when it's back
+    if (head - tail == AUDIO_RING_SIZE) {
+        ++ticks_full;
+        return;
+    }
+
+    AudioSlot *slot = &ring.slots[head & (AUDIO_RING_SIZE - 1)];
+    slot->on = on;
+    slot->pitch = mem->pitch;
+    memcpy(slot->pattern, mem->audio, sizeof(slot->pattern));
+
+    atomic_store_explicit(&ring.head, head + 1, memory_order_release);
+}
+
+void audio_tick(const cpu *cpuData, const MemMaps *mem)
+{
+    push(cpuData->st != 0, mem);
+}
+
+void audio_silence(const MemMaps *mem)
+{
+    push(0, mem);
+}
+
+void audio_close()
+{
+    if (device == 0) {
+        return;
+    }
+
+    // waits for the callback to return
+    SDL_CloseAudioDevice(device);
+    device = 0;
+
+    if (ticks_late || ticks_dropped + ticks_full) {
+        fprintf(stderr, "chip8: audio: %lu ticks late, %lu dropped\n",
+                ticks_late, ticks_dropped + ticks_full);
+    }
+}
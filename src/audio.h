@@ -0,0 +1,57 @@
+/*
+ * Sound. Once per tick the emulation thread hands the state of the sound
+ * timer, and the XO-CHIP pattern and pitch, to audio_tick(), which copies
+ * it into a lock-free ring. The SDL audio callback plays the ring back a
+ * tick every AUDIO_RATE / TIMERS_HZ samples, so the buzzer starts and stops
+ * on the tick it should, and the emulation thread never calls SDL.
+ *
+ * When the ring is empty, because the emulation is late, the callback plays
+ * the last tick once more instead of letting the device run dry, and then
+ * silence until the emulation is back, so a stall or a breakpoint doesn't
+ * leave the buzzer on. When the device falls behind and more than
+ * AUDIO_MAX_LAG ticks are waiting, the oldest are dropped, so the sound
+ * doesn't lag further and further.
+ *
+ * The tone is the 128 bit pattern of the XO-CHIP, played at
+ * 4000 * 2^((pitch - 64) / 48) bits per second. The other machines never
+ * change it, and get the square wave initialize() puts there.
+ *
+ * Without a device, when it can't be opened or -A 0 asks for silence, the
+ * ticks go to a null sink that drops them
+ * */
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "chip8.h"
+
+#define AUDIO_RATE 48000
+
+// samples per callback, about 11 ms. Smaller buffers lower the latency,
+// as long as the device keeps up
+#define AUDIO_DEFAULT_SAMPLES 512
+
+// ticks the ring holds, and how many may wait before the oldest are dropped
+#define AUDIO_RING_SIZE 16
+#define AUDIO_MAX_LAG 4
+
+#define AUDIO_VOLUME 4000
+
+// open the audio device, asking for buffers of samples samples. With 0
+// samples, or if the device can't be opened, the null sink is used. Return
+// 0 if there's no device
+int audio_init(unsigned int samples);
+
+// publish the sound of the tick about to start. Call it once per tick,
+// before timers_step()
+void audio_tick(const cpu *cpuData, const MemMaps *mem);
+
+// publish a silent tick instead, for the ticks the timers don't run, like
+// those of a paused machine: its sound timer doesn't count down, and its
+// buzzer would otherwise play for as long as it's paused
+void audio_silence(const MemMaps *mem);
+
+// close the device, reporting the ticks that were late or dropped. It's
+// also called at exit
+void audio_close();
+
+#endif
@@ -0,0 +1,370 @@
+/*
+ * Packed screen expansion and upscaling. See blit.h
+ * */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLIT_X86
+#endif
+
+#include "blit.h"
+
+// the loops over the screen are written once, as always inlined functions
+// taking the copies of a table entry as arguments. Each version below calls
+// them with its own copies, which get inlined too
+#define BLIT_INLINE static inline __attribute__((always_inline))
+
+// every entry has 8 * scale pixels, so its length in bytes is a multiple of
+// 32 and the vector copies below work without a remainder loop
+
+// copy an entry of the table
+typedef void (*CopyEntry) (uint32_t *dst, const uint32_t *src,
+                           unsigned int len);
+
+// write the pixels of 2 entries of the masks, picking each from colors by
+// its bit in first and in second
+typedef void (*SelectEntry) (uint32_t *dst, const uint32_t *first,
+                             const uint32_t *second, const uint32_t colors[4],
+                             unsigned int len);
+
+BLIT_INLINE void copy_words(uint32_t *dst, const uint32_t *src,
+                            unsigned int len)
+{
+    uint64_t *dst64 = (uint64_t *) dst;
+    const uint64_t *src64 = (const uint64_t *) src;
+    unsigned int index;
+
+    for (index = 0; index < len / 2; ++index)
+    {
+        dst64[index] = src64[index];
+    }
+}
+
+BLIT_INLINE void select_words(uint32_t *dst, const uint32_t *first,
+                              const uint32_t *second,
+                              const uint32_t colors[4], unsigned int len)
+{
+    unsigned int index;
+
+    for (index = 0; index < len; ++index)
+    {
+        uint32_t low = (colors[1] & first[index])
+                       | (colors[0] & ~first[index]);
+        uint32_t high = (colors[3] & first[index])
+                        | (colors[2] & ~first[index]);
+
+        dst[index] = (high & second[index]) | (low & ~second[index]);
+    }
+}
+
+#ifdef BLIT_X86
+__attribute__((target("sse2")))
+BLIT_INLINE void copy_sse2(uint32_t *dst, const uint32_t *src,
+                           unsigned int len)
+{
+    unsigned int index;
+
+    for (index = 0; index < len; index += 4)
+    {
+        __m128i pixels = _mm_load_si128((const __m128i *) (src + index));
+        _mm_storeu_si128((__m128i *) (dst + index), pixels);
+    }
+}
+
+__attribute__((target("sse2")))
+BLIT_INLINE void select_sse2(uint32_t *dst, const uint32_t *first,
+                             const uint32_t *second,
+                             const uint32_t colors[4], unsigned int len)
+{
+    __m128i color0 = _mm_set1_epi32(colors[0]);
+    __m128i color1 = _mm_set1_epi32(colors[1]);
+    __m128i color2 = _mm_set1_epi32(colors[2]);
+    __m128i color3 = _mm_set1_epi32(colors[3]);
+    unsigned int index;
+
+    for (index = 0; index < len; index += 4)
+    {
+        __m128i a = _mm_load_si128((const __m128i *) (first + index));
+        __m128i b = _mm_load_si128((const __m128i *) (second + index));
+        __m128i low = _mm_or_si128(_mm_and_si128(a, color1),
+                                   _mm_andnot_si128(a, color0));
+        __m128i high = _mm_or_si128(_mm_and_si128(a, color3),
+                                    _mm_andnot_si128(a, color2));
+
+        _mm_storeu_si128((__m128i *) (dst + index),
+                         _mm_or_si128(_mm_and_si128(b, high),
+                                      _mm_andnot_si128(b, low)));
+    }
+}
+
+__attribute__((target("avx2")))
+BLIT_INLINE void copy_avx2(uint32_t *dst, const uint32_t *src,
+                           unsigned int len)
+{
+    unsigned int index;
+
+    for (index = 0; index < len; index += 8)
+    {
+        __m256i pixels = _mm256_load_si256((const __m256i *) (src + index));
+        _mm256_storeu_si256((__m256i *) (dst + index), pixels);
+    }
+}
+
+__attribute__((target("avx2")))
+BLIT_INLINE void select_avx2(uint32_t *dst, const uint32_t *first,
+                             const uint32_t *second,
+                             const uint32_t colors[4], unsigned int len)
+{
+    __m256i color0 = _mm256_set1_epi32(colors[0]);
+    __m256i color1 = _mm256_set1_epi32(colors[1]);
+    __m256i color2 = _mm256_set1_epi32(colors[2]);
+    __m256i color3 = _mm256_set1_epi32(colors[3]);
+    unsigned int index;
+
+    for (index = 0; index < len; index += 8)
+    {
+        __m256i a = _mm256_load_si256((const __m256i *) (first + index));
+        __m256i b = _mm256_load_si256((const __m256i *) (second + index));
+        __m256i low = _mm256_blendv_epi8(color0, color1, a);
+        __m256i high = _mm256_blendv_epi8(color2, color3, a);
+
+        _mm256_storeu_si256((__m256i *) (dst + index),
+                            _mm256_blendv_epi8(low, high, b));
+    }
+}
+#endif
+
+// the scaled row at line is the same scale times
+BLIT_INLINE void repeat_row(uint32_t *line, unsigned int width,
+                            unsigned int scale, unsigned int pitch)
+{
+    unsigned int repeat;
+
+    for (repeat = 1; repeat < scale; ++repeat)
+    {
+        memcpy((uint8_t *) line + repeat * pitch, line,
+               width * scale * sizeof(uint32_t));
+    }
+}
+
+BLIT_INLINE void expand_rows(const BlitTable *table, const uint64_t *rows,
+                             unsigned int width, unsigned int height,
+                             uint32_t *dst, unsigned int pitch,
+                             CopyEntry copy)
+{
+    unsigned int scale = table->scale;
+    unsigned int entry_len = 8 * scale;
+    unsigned int words = (width + 63) / 64;
+    unsigned int row, word, byte;
+
+    for (row = 0; row < height; ++row)
+    {
+        uint32_t *line = (uint32_t *) ((uint8_t *) dst + row * scale * pitch);
+        uint32_t *pixel = line;
+
+        for (word = 0; word < words; ++word)
+        {
+            uint64_t bits = rows[row * words + word];
+            unsigned int bytes = width - word * 64 >= 64
+                                 ? 8 : (width - word * 64) / 8;
+
+            for (byte = 0; byte < bytes; ++byte)
+            {
+                copy(pixel, &table->entries[(bits >> 56) * entry_len],
+                     entry_len);
+                bits <<= 8;
+                pixel += entry_len;
+            }
+        }
+
+        repeat_row(line, width, scale, pitch);
+    }
+}
+
+BLIT_INLINE void expand_planes(const BlitTable *table, const uint64_t *first,
+                               const uint64_t *second,
+                               const uint32_t colors[4], unsigned int width,
+                               unsigned int height, uint32_t *dst,
+                               unsigned int pitch, SelectEntry select)
+{
+    unsigned int scale = table->scale;
+    unsigned int entry_len = 8 * scale;
+    unsigned int words = (width + 63) / 64;
+    unsigned int row, word, byte;
+
+    for (row = 0; row < height; ++row)
+    {
+        uint32_t *line = (uint32_t *) ((uint8_t *) dst + row * scale * pitch);
+        uint32_t *pixel = line;
+
+        for (word = 0; word < words; ++word)
+        {
+            uint64_t bits0 = first[row * words + word];
+            uint64_t bits1 = second[row * words + word];
+            unsigned int bytes = width - word * 64 >= 64
+                                 ? 8 : (width - word * 64) / 8;
+
+            for (byte = 0; byte < bytes; ++byte)
+            {
+                select(pixel, &table->masks[(bits0 >> 56) * entry_len],
+                       &table->masks[(bits1 >> 56) * entry_len], colors,
+                       entry_len);
+                bits0 <<= 8;
+                bits1 <<= 8;
+                pixel += entry_len;
+            }
+        }
+
+        repeat_row(line, width, scale, pitch);
+    }
+}
+
+static void rows_words(const BlitTable *table, const uint64_t *rows,
+                       unsigned int width, unsigned int height,
+                       uint32_t *dst, unsigned int pitch)
+{
+    expand_rows(table, rows, width, height, dst, pitch, copy_words);
+}
+
+static void planes_words(const BlitTable *table, const uint64_t *first,
+                         const uint64_t *second, const uint32_t colors[4],
+                         unsigned int width, unsigned int height,
+                         uint32_t *dst, unsigned int pitch)
+{
+    expand_planes(table, first, second, colors, width, height, dst, pitch,
+                  select_words);
+}
+
+#ifdef BLIT_X86
+__attribute__((target("sse2")))
+static void rows_sse2(const BlitTable *table, const uint64_t *rows,
+                      unsigned int width, unsigned int height,
+                      uint32_t *dst, unsigned int pitch)
+{
+    expand_rows(table, rows, width, height, dst, pitch, copy_sse2);
+}
+
+__attribute__((target("sse2")))
+static void planes_sse2(const BlitTable *table, const uint64_t *first,
+                        const uint64_t *second, const uint32_t colors[4],
+                        unsigned int width, unsigned int height,
+                        uint32_t *dst, unsigned int pitch)
+{
+    expand_planes(table, first, second, colors, width, height, dst, pitch,
+                  select_sse2);
+}
+
+__attribute__((target("avx2")))
+static void rows_avx2(const BlitTable *table, const uint64_t *rows,
+                      unsigned int width, unsigned int height,
+                      uint32_t *dst, unsigned int pitch)
+{
+    expand_rows(table, rows, width, height, dst, pitch, copy_avx2);
+}
+
+__attribute__((target("avx2")))
+static void planes_avx2(const BlitTable *table, const uint64_t *first,
+                        const uint64_t *second, const uint32_t colors[4],
+                        unsigned int width, unsigned int height,
+                        uint32_t *dst, unsigned int pitch)
+{
+    expand_planes(table, first, second, colors, width, height, dst, pitch,
+                  select_avx2);
+}
+#endif
+
+// fill 256 entries of 8 * scale pixels, on for the lit ones and off for the
+// others
+static void fill_entries(uint32_t *entries, unsigned int scale, uint32_t on,
+                         uint32_t off)
+{
+    unsigned int entry_len = 8 * scale;
+    unsigned int byte, bit, repeat;
+
+    for (byte = 0; byte < 256; ++byte)
+    {
+        uint32_t *entry = &entries[byte * entry_len];
+
+        for (bit = 0; bit < 8; ++bit)
+        {
+            uint32_t color = (byte & (0x80 >> bit)) ? on : off;
+
+            for (repeat = 0; repeat < scale; ++repeat)
+            {
+                entry[bit * scale + repeat] = color;
+            }
+        }
+    }
+}
+
+int blit_init(BlitTable *table, unsigned int scale, uint32_t on, uint32_t off)
+{
+    size_t size = 256 * 8 * scale * sizeof(uint32_t);
+
+    // aligned so the vector copies can use aligned loads
+    table->entries = aligned_alloc(32, size);
+    table->masks = aligned_alloc(32, size);
+    if (table->entries == NULL || table->masks == NULL) {
+        blit_free(table);
+        return 0;
+    }
+
+    table->scale = scale;
+    fill_entries(table->entries, scale, on, off);
+    fill_entries(table->masks, scale, ~(uint32_t) 0, 0);
+
+    table->rows = rows_words;
+    table->planes = planes_words;
+#ifdef BLIT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        table->rows = rows_avx2;
+        table->planes = planes_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        table->rows = rows_sse2;
+        table->planes = planes_sse2;
+    }
+#endif
+
+    return 1;
+}
+
+void blit_free(BlitTable *table)
+{
+    free(table->entries);
+    free(table->masks);
+    table->entries = NULL;
+    table->masks = NULL;
+}
+
+const char *blit_kind(const BlitTable *table)
+{
+#ifdef BLIT_X86
+    if (table->rows == rows_avx2) {
+        return "avx2";
+    }
+    if (table->rows == rows_sse2) {
+        return "sse2";
+    }
+#endif
+    return "scalar";
+}
+
+void blit_rows(const BlitTable *table, const uint64_t *rows,
+               unsigned int width, unsigned int height,
+               uint32_t *dst, unsigned int pitch)
+{
+    table->rows(table, rows, width, height, dst, pitch);
+}
+
+void blit_planes(const BlitTable *table, const uint64_t *first,
+                 const uint64_t *second, const uint32_t colors[4],
+                 unsigned int width, unsigned int height,
+                 uint32_t *dst, unsigned int pitch)
+{
+    table->planes(table, first, second, colors, width, height, dst, pitch);
+}
@@ -0,0 +1,63 @@
+/*
+ * Expansion of the packed screen rows into 32 bit pixels, scaled by an 
+ * integer factor on the cpu, so that the renderer only has to copy them.
+ *
+ * Every byte of a row expands to 8 * scale pixels through a lookup table
+ * built once for the scale and colors in use, and the expanded row is then
+ * copied scale - 1 times below itself. With 2 planes, a second table of the
+ * same layout holds masks instead of colors, and the 4 colors are picked
+ * from the masks of both planes.
+ *
+ * The loops over the whole screen are compiled for AVX2, SSE2 and plain 64
+ * bit words, and blit_init() picks the best the cpu runs, so a frame costs
+ * a single indirect call and the copies are inlined into the loops
+ * */
+#ifndef BLIT_H
+#define BLIT_H
+
+#include <stdint.h>
+
+typedef struct BlitTable BlitTable;
+
+struct BlitTable
+{
+    unsigned int scale;
+    uint32_t *entries;           // 256 entries of 8 * scale pixels each
+    uint32_t *masks;             // the same, all bits set for a lit pixel
+
+    // blit_rows() and blit_planes(), the best versions the cpu can run
+    void (*rows) (const BlitTable *table, const uint64_t *rows, 
+                  unsigned int width, unsigned int height, uint32_t *dst, 
+                  unsigned int pitch);
+    void (*planes) (const BlitTable *table, const uint64_t *first, 
+                    const uint64_t *second, const uint32_t colors[4],
+                    unsigned int width, unsigned int height, uint32_t *dst, 
+                    unsigned int pitch);
+};
+
+// build the table for scale, with on and off being the colors of the lit 
+// and unlit pixels. Return 0 if the table couldn't be allocated
+int blit_init(BlitTable *table, unsigned int scale, uint32_t on, uint32_t off);
+
+// free what blit_init() allocated
+void blit_free(BlitTable *table);
+
+// name of the copy used by the table, for the benchmarks
+const char *blit_kind(const BlitTable *table);
+
+// expand height rows of width pixels, width being a multiple of 8, into 
+// dst. pitch is the size of a destination row in bytes, and each source row
+// has its leftmost pixel in the msb of its first word
+void blit_rows(const BlitTable *table, const uint64_t *rows, 
+               unsigned int width, unsigned int height, 
+               uint32_t *dst, unsigned int pitch);
+
+// same as blit_rows(), for 2 planes laid out the same way. The color of a
+// pixel is colors[bit of first | bit of second << 1], so only the masks of
+// the table are used, for the XO-CHIP roms that draw to the second plane
+void blit_planes(const BlitTable *table, const uint64_t *first, 
+                 const uint64_t *second, const uint32_t colors[4],
+                 unsigned int width, unsigned int height, 
+                 uint32_t *dst, unsigned int pitch);
+
+#endif
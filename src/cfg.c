@@ -0,0 +1,397 @@
+/*
+ * Static analysis of roms. See cfg.h
+ * */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "opcodes.h"
+#include "romcache.h"
+#include "cfg.h"
+
+typedef struct Block
+{
+    uint32_t start;
+    uint32_t end;                // past its last opcode
+    unsigned int opcodes;
+    RomEdge edges[ROMCACHE_MAX_EDGES];
+    unsigned int edges_count;
+} Block;
+
+typedef struct Loop
+{
+    uint32_t header;             // block the edge back goes to
+    uint32_t latch;              // and the block it leaves
+} Loop;
+
+// where the depth first search is in a block
+typedef struct Visit
+{
+    int32_t block;
+    unsigned int edge;
+} Visit;
+
+enum VisitState
+{
+    UNSEEN,
+    WALKING,
+    DONE
+};
+
+static const char *edge_names[] = { "next", "skip", "jump", "call", "table" };
+
+// the graph of the rom being analysed. Jumps can go to odd addresses, so a
+// block can start at any byte, and each of its edges can be the edge back of
+// a loop
+static Block blocks[XO_RAM_SIZE];
+static unsigned int blocks_count;
+static int32_t block_at[XO_RAM_SIZE];
+static Loop loops[ROMCACHE_MAX_EDGES * XO_RAM_SIZE];
+static unsigned int loops_count;
+static uint8_t is_code[XO_RAM_SIZE];
+static uint8_t states[XO_RAM_SIZE];
+static Visit visits[XO_RAM_SIZE];
+
+static uint16_t opcode_at(const MemMaps *mems, uint32_t addr)
+{
+    return (mems->ram[addr] << 8) | mems->ram[addr + 1];
+}
+
+//******************************************************************************
+//*                                  graph                                     *
+//******************************************************************************
+
+// split the code found by the analysis into blocks
+static void build_blocks(const RomMap *map, const MemMaps *mems)
+{
+    uint32_t addr, pc, next, byte;
+
+    blocks_count = 0;
+    memset(is_code, 0, sizeof(is_code));
+
+    for (addr = 0; addr < map->ram_size; ++addr)
+    {
+        block_at[addr] = -1;
+        if ((map->flags[addr] & (ROMMAP_BLOCK | ROMMAP_CODE))
+            != (ROMMAP_BLOCK | ROMMAP_CODE)) {
+            continue;
+        }
+
+        Block *block = &blocks[blocks_count];
+        block_at[addr] = blocks_count++;
+        block->start = addr;
+        block->opcodes = 0;
+
+        for (pc = addr;; pc = next)
+        {
+            ++block->opcodes;
+            block->edges_count = romcache_edges(mems, pc, block->edges, &next);
+
+            for (byte = pc; byte < next && byte < map->ram_size; ++byte)
+            {
+                is_code[byte] = 1;
+            }
+
+            if (block->edges_count != 1
+                || block->edges[0].kind != ROMEDGE_NEXT
+                || (map->flags[next] & ROMMAP_BLOCK)
+                || !(map->flags[next] & ROMMAP_CODE)) {
+                break;
+            }
+        }
+        block->end = next;
+    }
+}
+
+// depth first search from the block at root, recording the edges back
+static void find_loops_from(int32_t root)
+{
+    unsigned int depth = 1;
+
+    states[root] = WALKING;
+    visits[0].block = root;
+    visits[0].edge = 0;
+
+    while (depth)
+    {
+        Visit *visit = &visits[depth - 1];
+        Block *block = &blocks[visit->block];
+
+        if (visit->edge == block->edges_count) {
+            states[visit->block] = DONE;
+            --depth;
+            continue;
+        }
+
+        int32_t target = block_at[block->edges[visit->edge++].to];
+
+        if (target == -1) {
+            continue;
+        }
+
+        if (states[target] == WALKING) {
+            loops[loops_count].header = blocks[target].start;
+            loops[loops_count++].latch = block->start;
+        } else if (states[target] == UNSEEN) {
+            states[target] = WALKING;
+            visits[depth].block = target;
+            visits[depth++].edge = 0;
+        }
+    }
+}
+
+static void find_loops()
+{
+    unsigned int index;
+
+    loops_count = 0;
+    memset(states, UNSEEN, blocks_count);
+
+    if (block_at[PROG_RAM_START] != -1) {
+        find_loops_from(block_at[PROG_RAM_START]);
+    }
+
+    // what only a BNNN table or such reaches
+    for (index = 0; index < blocks_count; ++index)
+    {
+        if (states[index] == UNSEEN) {
+            find_loops_from(index);
+        }
+    }
+}
+
+// the end of the range of data starting at addr, and whether I points in it
+static uint32_t data_end(const RomMap *map, uint32_t addr, uint32_t end,
+                         int *pointed)
+{
+    *pointed = 0;
+    for (; addr < end && !is_code[addr]; ++addr)
+    {
+        *pointed |= (map->flags[addr] & ROMMAP_DATA) != 0;
+    }
+
+    return addr;
+}
+
+//******************************************************************************
+//*                                 reports                                    *
+//******************************************************************************
+
+static void print_opcode(FILE *out, const MemMaps *mems, uint32_t pc,
+                         uint32_t next)
+{
+    char text[32];
+    uint16_t opcode = opcode_at(mems, pc);
+
+    disassemble(mems, opcode, text, sizeof(text));
+    if (next - pc == 4) {
+        fprintf(out, "  %#.3X: %.4X %.4X  %s %#.4X\n", pc, opcode,
+                opcode_at(mems, pc + 2), text, opcode_at(mems, pc + 2));
+    } else {
+        fprintf(out, "  %#.3X: %.4X  %s\n", pc, opcode, text);
+    }
+}
+
+static void report_text(FILE *out, const CorpusRom *rom, const RomMap *map,
+                        const MemMaps *mems, uint32_t code, uint32_t data)
+{
+    unsigned int index, edge;
+    uint32_t pc, next, addr, end, rom_end = PROG_RAM_START + rom->size;
+    RomEdge edges[ROMCACHE_MAX_EDGES];
+    int pointed;
+
+    fprintf(out, "rom %s %s\n%u blocks, %u loops, %u bytes of code, "
+            "%u of data\n", rom->name, machine_quirks(mems), blocks_count,
+            loops_count, code, data);
+
+    for (index = 0; index < blocks_count; ++index)
+    {
+        Block *block = &blocks[index];
+
+        fprintf(out, "\nblock %#.3X-%#.3X\n", block->start, block->end - 1);
+        for (pc = block->start; pc < block->end; pc = next)
+        {
+            romcache_edges(mems, pc, edges, &next);
+            print_opcode(out, mems, pc, next);
+        }
+
+        fprintf(out, "  ->");
+        for (edge = 0; edge < block->edges_count; ++edge)
+        {
+            fprintf(out, "%s %#.3X %s", edge ? "," : "",
+                    block->edges[edge].to,
+                    edge_names[block->edges[edge].kind]);
+        }
+        fprintf(out, block->edges_count ? "\n" : " none\n");
+    }
+
+    if (loops_count) {
+        fprintf(out, "\nloops\n");
+    }
+    for (index = 0; index < loops_count; ++index)
+    {
+        fprintf(out, "  %#.3X from %#.3X\n", loops[index].header,
+                loops[index].latch);
+    }
+
+    for (addr = PROG_RAM_START; addr < rom_end; addr = end)
+    {
+        if (is_code[addr]) {
+            end = addr + 1;
+            continue;
+        }
+
+        end = data_end(map, addr, rom_end, &pointed);
+        fprintf(out, "\ndata %#.3X-%#.3X%s", addr, end - 1,
+                pointed ? ", I points here" : "");
+        for (pc = addr; pc < end; ++pc)
+        {
+            if ((pc - addr) % CFG_DATA_PER_LINE == 0) {
+                fprintf(out, "\n  %#.3X:", pc);
+            }
+            fprintf(out, " %.2X", mems->ram[pc]);
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out, "\n");
+}
+
+static void json_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (; *text; ++text)
+    {
+        if (*text == '"' || *text == '\\') {
+            fprintf(out, "\\%c", *text);
+        } else if ((unsigned char) *text < 0x20) {
+            fprintf(out, "\\u%.4x", *text);
+        } else {
+            fputc(*text, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void report_json(FILE *out, const CorpusRom *rom, const RomMap *map,
+                        const MemMaps *mems, uint32_t code, uint32_t data,
+                        int first)
+{
+    unsigned int index, edge;
+    uint32_t addr, end, rom_end = PROG_RAM_START + rom->size;
+    int pointed, ranges = 0;
+
+    fprintf(out, "%s\n    {\"name\": ", first ? "" : ",");
+    json_string(out, rom->name);
+    fprintf(out, ", \"hash\": \"%.16llx\", \"size\": %u, \"quirks\": \"%s\", "
+            "\"entry\": %u, \"code\": %u, \"data\": %u,\n     \"blocks\": [",
+            (unsigned long long) rom->hash, rom->size, machine_quirks(mems),
+            PROG_RAM_START, code, data);
+
+    for (index = 0; index < blocks_count; ++index)
+    {
+        fprintf(out, "%s\n      {\"start\": %u, \"end\": %u, \"opcodes\": %u, "
+                "\"edges\": [", index ? "," : "", blocks[index].start,
+                blocks[index].end, blocks[index].opcodes);
+        for (edge = 0; edge < blocks[index].edges_count; ++edge)
+        {
+            fprintf(out, "%s{\"to\": %u, \"kind\": \"%s\"}", edge ? ", " : "",
+                    blocks[index].edges[edge].to,
+                    edge_names[blocks[index].edges[edge].kind]);
+        }
+        fprintf(out, "]}");
+    }
+
+    fprintf(out, "\n     ],\n     \"loops\": [");
+    for (index = 0; index < loops_count; ++index)
+    {
+        fprintf(out, "%s\n      {\"header\": %u, \"latch\": %u}",
+                index ? "," : "", loops[index].header, loops[index].latch);
+    }
+
+    fprintf(out, "\n     ],\n     \"data_ranges\": [");
+    for (addr = PROG_RAM_START; addr < rom_end; addr = end)
+    {
+        if (is_code[addr]) {
+            end = addr + 1;
+            continue;
+        }
+
+        end = data_end(map, addr, rom_end, &pointed);
+        fprintf(out, "%s\n      {\"start\": %u, \"end\": %u, "
+                "\"pointed\": %s}", ranges++ ? "," : "", addr, end,
+                pointed ? "true" : "false");
+    }
+    fprintf(out, "\n     ]}");
+}
+
+int cfg(const Corpus *corpus, const char *path)
+{
+    static cpu cpuData;
+    static MemMaps mems;
+    char text_path[4096], json_path[4096];
+    unsigned int game, analysed = 0;
+    uint32_t addr, code, data;
+    FILE *text, *json;
+
+    snprintf(text_path, sizeof(text_path), "%.4000s.txt", path);
+    snprintf(json_path, sizeof(json_path), "%.4000s.json", path);
+
+    if ((text = fopen(text_path, "w")) == NULL) {
+        perror("chip8: ");
+        return 0;
+    }
+    if ((json = fopen(json_path, "w")) == NULL) {
+        perror("chip8: ");
+        fclose(text);
+        return 0;
+    }
+    fprintf(json, "{\n  \"roms\": [");
+
+    for (game = 0; game < corpus->count; ++game)
+    {
+        const CorpusRom *rom = &corpus->roms[game];
+
+        if (rom->original != -1) {
+            continue;
+        }
+
+        // the ram and skips of the machine the rom was written for
+        initialize(&cpuData, &mems, 
+                   rom->quirks != NULL ? rom->quirks : "default");
+
+        if (!corpus_load(corpus, game, &mems)) {
+            continue;
+        }
+
+        RomMap *map = romcache_analyse(&mems);
+        if (map == NULL) {
+            fprintf(stderr, "chip8: no memory to analyse %s\n", rom->name);
+            continue;
+        }
+
+        build_blocks(map, &mems);
+        find_loops();
+
+        for (addr = PROG_RAM_START, code = 0; addr < map->ram_size; ++addr)
+        {
+            code += is_code[addr] && addr < PROG_RAM_START + rom->size;
+        }
+        data = rom->size - code;
+
+        report_text(text, rom, map, &mems, code, data);
+        report_json(json, rom, map, &mems, code, data, !analysed++);
+        printf("%s: %u blocks, %u loops, %u bytes of code, %u of data\n",
+               rom->name, blocks_count, loops_count, code, data);
+
+        free(map);
+    }
+
+    fprintf(json, "\n  ]\n}\n");
+    fclose(text);
+    fclose(json);
+
+    return 1;
+}
@@ -0,0 +1,35 @@
+/*
+ * Static analysis of roms, without running them. Each rom of a corpus is
+ * loaded with the quirk profile the catalog suggests for it and analysed
+ * as the rom cache does, see romcache_analyse(), so the opcodes are told
+ * apart from the data with the same decode tables the interpreter runs.
+ *
+ * The code found is split into basic blocks: a block starts where the
+ * analysis found one starting, and ends at the first opcode that doesn't
+ * just fall through to the next one, or before the start of another
+ * block. The edges out of a block are those romcache_edges() gives for its
+ * last opcode. A loop is an edge back to a block that's still being
+ * walked by a depth first search of the graph from PROG_RAM_START, its
+ * header being the block the edge goes to.
+ *
+ * The bytes of the rom that aren't code are data, the ranges where ANNN
+ * or F000 NNNN point I being sprites most of the time.
+ *
+ * The results of all the roms are written to <path>.txt, the disassembly
+ * of each block with its edges, its loops and the data, and <path>.json,
+ * the same graph without the disassembly. A line per rom is printed with
+ * how much was found
+ * */
+#ifndef CFG_H
+#define CFG_H
+
+#include "corpus.h"
+
+// data bytes per line of the text report
+#define CFG_DATA_PER_LINE 8
+
+// analyse the roms of corpus, skipping the copies, and write the reports
+// to path.txt and path.json. Return 0 if they couldn't be written
+int cfg(const Corpus *corpus, const char *path);
+
+#endif
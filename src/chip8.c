@@ -1,4 +1,9 @@
-#include <errno.h>
+/*
+ * The machine itself: opcode dispatch, fetch and execution, timers and 
+ * initialization. Nothing in here knows about SDL or the clock, so it's what
+ * libchip8 is built from, the frontend lives in main.c
+ * */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,43 +11,42 @@
 #include <stdint.h>
 #include <sys/random.h>
 #include <unistd.h>
-#include <time.h>
 
 #include "chip8.h"
 #include "opcodes.h"
-#include "graphics.h"
 
 //******************************************************************************
 // * ARRAYS OF POINTERS TO FUNCTIONS                                           *
 //******************************************************************************
 
-const void (*zeroop[]) (uint16_t opcode, cpu *cpuData, MemMaps *mem) =
+const opfunc zeroop[16] =
 {
     cls, cpuNULL, cpuNULL, cpuNULL, cpuNULL, 
     cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL, 
-    cpuNULL, cpuNULL, cpuNULL, cpuNULL, ret
+    cpuNULL, cpuNULL, cpuNULL, cpuNULL, ret, cpuNULL
 };
 
 // Handle opcodes starting with 0x8
-const void (*eightop[]) (uint16_t opcode, cpu *cpuData, MemMaps *mem) = 
+const opfunc eightop[16] = 
 {
     setvxtovy, vxorvy, vxandvy, vxxorvy, 
     vxaddvy, vxsubvy, shr, 
     vysubvx, cpuNULL, cpuNULL, cpuNULL, 
     cpuNULL, cpuNULL, cpuNULL, 
-    shl
+    shl, cpuNULL
 };
 
 // Handle opcodes starting with 0xE
-const void (*e_op[]) (uint16_t opcode, cpu *cpuData, MemMaps *mem) = 
+const opfunc e_op[16] = 
 {
     cpuNULL, cpuNULL, cpuNULL, cpuNULL, 
     cpuNULL, cpuNULL, cpuNULL, cpuNULL, 
-    cpuNULL, skipifdown, skipnotdown
+    cpuNULL, skipifdown, skipnotdown, cpuNULL,
+    cpuNULL, cpuNULL, cpuNULL, cpuNULL
 };
 
 // Handle opcodes starting with 0xF
-const void (*special[]) (uint16_t opcode, cpu *cpuData, MemMaps *mem) =
+const opfunc special[16] =
 {
     cpuNULL, set_dt, cpuNULL, set_BCD, cpuNULL, 
     reg_dump, reg_load, vx_to_dt, set_st, load_char_addr, 
@@ -55,7 +59,7 @@ const void (*special[]) (uint16_t opcode, cpu *cpuData, MemMaps *mem) =
 // and call some function in case the first msb nibble(4 bits) isn't
 // unique to a specific opcode and need more handling, then the function
 // handles it and call other arrays of pointers to functions
-const void (*generalop[]) (uint16_t opcode, cpu *cpuData, MemMaps *mem) =
+const opfunc generalop[16] =
 {
     msbis0, jump, call, se, sne, 
     svxevy, setvx, addvx, msbis8, next_if_vx_not_vy, 
@@ -63,6 +67,13 @@ const void (*generalop[]) (uint16_t opcode, cpu *cpuData, MemMaps *mem) =
     msbisf
 };
 
+// the index of the 0xF tables of 16 handlers: the last digit, but FX15, 
+// FX55 and FX65 share it, so those are told apart by the third
+static inline uint16_t special_index(uint16_t opcode)
+{
+    return offset4(opcode) == 0x5 ? offset3(opcode) : offset4(opcode);
+}
+
 // call our opcodes according to the function pointers
 void msbis0(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
@@ -87,18 +98,355 @@ void msbise(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 
 void msbisf(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
-    uint16_t index = offset4(opcode);
-    if (index == 0x5) {
-        index = offset3(opcode);
+    (*special[special_index(opcode)]) (opcode, cpuData, mem);
+}
+
+//-----------------------------------------------------------------------------
+// quirk profiles
+//
+// Each profile gets tables of its own, built from the variants of the
+// handlers that behave differently on each interpreter, so picking one 
+// doesn't add a single branch to the opcodes. The 0x8 and 0xF opcodes are 
+// looked up in tables of their own, so each profile also has its own 
+// msbis8 and msbisf
+
+#define QUIRK_TABLES(name, or_, and_, xor_, shr_, shl_, jp_v0, drw, dump, load)\
+static void msbis8_##name(uint16_t opcode, cpu *cpuData, MemMaps *mem);     \
+static void msbisf_##name(uint16_t opcode, cpu *cpuData, MemMaps *mem);     \
+                                                                            \
+static const opfunc eightop_##name[16] =                                    \
+{                                                                           \
+    setvxtovy, or_, and_, xor_, vxaddvy, vxsubvy, shr_, vysubvx,            \
+    cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL, shl_, cpuNULL     \
+};                                                                          \
+                                                                            \
+static const opfunc special_##name[16] =                                    \
+{                                                                           \
+    cpuNULL, set_dt, cpuNULL, set_BCD, cpuNULL,                             \
+    dump, load, vx_to_dt, set_st, load_char_addr,                           \
+    vx_to_key, cpuNULL, cpuNULL, cpuNULL, iaddvx, cpuNULL                   \
+};                                                                          \
+                                                                            \
+static const opfunc generalop_##name[16] =                                  \
+{                                                                           \
+    msbis0, jump, call, se, sne,                                            \
+    svxevy, setvx, addvx, msbis8_##name, next_if_vx_not_vy,                 \
+    itoa, jp_v0, vxandrand, drw, msbise,                                    \
+    msbisf_##name                                                           \
+};                                                                          \
+                                                                            \
+static void msbis8_##name(uint16_t opcode, cpu *cpuData, MemMaps *mem)      \
+{                                                                           \
+    (*eightop_##name[offset4(opcode)]) (opcode, cpuData, mem);              \
+}                                                                           \
+                                                                            \
+static void msbisf_##name(uint16_t opcode, cpu *cpuData, MemMaps *mem)      \
+{                                                                           \
+    (*special_##name[special_index(opcode)]) (opcode, cpuData, mem);        \
+}
+
+// the original interpreter: VF reset by the logic opcodes, shifts of VY, 
+// I moved past the registers by FX55 and FX65, BNNN and clipped sprites
+QUIRK_TABLES(vip, vxorvy_vf, vxandvy_vf, vxxorvy_vf, shr_vy, shl_vy, 
+             jmpaddv0, draw_clip, reg_dump_inc, reg_load_inc)
+
+// shifts of VX, I moved by X, BXNN
+QUIRK_TABLES(chip48, vxorvy, vxandvy, vxxorvy, shr, shl, 
+             jmpaddvx, draw_clip, reg_dump_incx, reg_load_incx)
+
+// what most roms written today expect: the VIP without the VF reset
+QUIRK_TABLES(modern, vxorvy, vxandvy, vxxorvy, shr_vy, shl_vy, 
+             jmpaddv0, draw_clip, reg_dump_inc, reg_load_inc)
+
+//-----------------------------------------------------------------------------
+// SUPER-CHIP and XO-CHIP
+//
+// Their opcodes only exist in these tables. The 0x0 ones are looked up by 
+// their third digit, and the 0x00F ones by the last, and the 0xF ones by
+// the whole low byte, since both machines use most of it
+
+static void zero_f_ext(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+static const opfunc zerofop_ext[16] =
+{
+    cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL,
+    cpuNULL, cpuNULL, cpuNULL, scroll_right, scroll_left, exit_rom, lores,
+    hires
+};
+
+static void zero_f_ext(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    (*zerofop_ext[offset4(opcode)]) (opcode, cpuData, mem);
+}
+
+static const opfunc zeroop_schip[16] =
+{
+    msbis0, msbis0, msbis0, msbis0, msbis0, msbis0, msbis0, msbis0,
+    msbis0, msbis0, msbis0, msbis0, scroll_down, msbis0, msbis0, zero_f_ext
+};
+
+static const opfunc zeroop_xochip[16] =
+{
+    msbis0, msbis0, msbis0, msbis0, msbis0, msbis0, msbis0, msbis0,
+    msbis0, msbis0, msbis0, msbis0, scroll_down, scroll_up, msbis0, 
+    zero_f_ext
+};
+
+static const opfunc fiveop_xochip[16] =
+{
+    svxevy_xo, cpuNULL, save_range, load_range, cpuNULL, cpuNULL, cpuNULL,
+    cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL, cpuNULL,
+    cpuNULL
+};
+
+static const opfunc e_op_xochip[16] = 
+{
+    cpuNULL, cpuNULL, cpuNULL, cpuNULL, 
+    cpuNULL, cpuNULL, cpuNULL, cpuNULL, 
+    cpuNULL, skipifdown_xo, skipnotdown_xo, cpuNULL,
+    cpuNULL, cpuNULL, cpuNULL, cpuNULL
+};
+
+static const opfunc special_schip[256] =
+{
+    [0x00 ... 0xFF] = cpuNULL,
+    [0x07] = vx_to_dt, [0x0A] = vx_to_key, [0x15] = set_dt, [0x18] = set_st,
+    [0x1E] = iaddvx, [0x29] = load_char_addr, [0x30] = load_big_char_addr,
+    [0x33] = set_BCD, [0x55] = reg_dump, [0x65] = reg_load, 
+    [0x75] = save_flags, [0x85] = load_flags
+};
+
+static const opfunc special_xochip[256] =
+{
+    [0x00 ... 0xFF] = cpuNULL,
+    [0x00] = long_i, [0x01] = select_planes, [0x02] = audio_pattern,
+    [0x07] = vx_to_dt, [0x0A] = vx_to_key, [0x15] = set_dt, [0x18] = set_st,
+    [0x1E] = iaddvx, [0x29] = load_char_addr, [0x30] = load_big_char_addr,
+    [0x33] = set_BCD, [0x3A] = set_pitch, [0x55] = reg_dump_inc, 
+    [0x65] = reg_load_inc, [0x75] = save_flags, [0x85] = load_flags
+};
+
+static void msbis0_schip(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    (*zeroop_schip[offset3(opcode)]) (opcode, cpuData, mem);
+}
+
+static void msbisf_schip(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    (*special_schip[opcode & 0xFF]) (opcode, cpuData, mem);
+}
+
+static void msbis0_xochip(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    (*zeroop_xochip[offset3(opcode)]) (opcode, cpuData, mem);
+}
+
+static void msbis5_xochip(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    (*fiveop_xochip[offset4(opcode)]) (opcode, cpuData, mem);
+}
+
+static void msbise_xochip(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    (*e_op_xochip[offset3(opcode)]) (opcode, cpuData, mem);
+}
+
+static void msbisf_xochip(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    (*special_xochip[opcode & 0xFF]) (opcode, cpuData, mem);
+}
+
+// the quirks of the SUPER-CHIP 1.1 are those of the original tables but 
+// for BXNN and clipping
+static const opfunc generalop_schip[16] =
+{
+    msbis0_schip, jump, call, se, sne, 
+    svxevy, setvx, addvx, msbis8, next_if_vx_not_vy, 
+    itoa, jmpaddvx, vxandrand, draw_ext_clip, msbise, 
+    msbisf_schip
+};
+
+// the quirks of the XO-CHIP are those of the modern profile, but sprites
+// wrap
+static const opfunc generalop_xochip[16] =
+{
+    msbis0_xochip, jump, call, se_xo, sne_xo, 
+    msbis5_xochip, setvx, addvx, msbis8_modern, next_if_vx_not_vy_xo, 
+    itoa, jmpaddv0, vxandrand, draw_ext, msbise_xochip, 
+    msbisf_xochip
+};
+
+// the XO-CHIP roms are written for 1000 opcodes per frame, as Octo runs them
+#define XO_CLOCK_HZ (1000 * TIMERS_HZ)
+
+typedef struct QuirkProfile
+{
+    const char *name;
+    const opfunc *table;
+    uint32_t ram_size;
+    uint8_t block_shift;
+    unsigned int clock_hz;
+} QuirkProfile;
+
+static const QuirkProfile quirk_profiles[] =
+{
+    { NULL,     generalop,        RAM_SIZE, RAM_BLOCK_SHIFT, CLOCK_HZ },
+    { "vip",    generalop_vip,    RAM_SIZE, RAM_BLOCK_SHIFT, CLOCK_HZ },
+    { "chip48", generalop_chip48, RAM_SIZE, RAM_BLOCK_SHIFT, CLOCK_HZ },
+    { "schip",  generalop_schip,  RAM_SIZE, RAM_BLOCK_SHIFT, CLOCK_HZ },
+    { "modern", generalop_modern, RAM_SIZE, RAM_BLOCK_SHIFT, CLOCK_HZ },
+    { "xochip", generalop_xochip, XO_RAM_SIZE, XO_RAM_BLOCK_SHIFT, 
+                XO_CLOCK_HZ }
+};
+
+// the profile called name, NULL if there's none
+static const QuirkProfile *find_quirks(const char *name)
+{
+    unsigned int index;
+
+    // "default", as machine_quirks() calls it, is the original tables
+    if (!strcmp(name, "default")) {
+        return &quirk_profiles[0];
+    }
+
+    for (index = 1; index < sizeof(quirk_profiles) / sizeof(quirk_profiles[0]);
+         ++index)
+    {
+        if (!strcmp(name, quirk_profiles[index].name)) {
+            return &quirk_profiles[index];
+        }
     }
 
-    (*special[index]) (opcode, cpuData, mem);
+    return NULL;
+}
+
+int quirks_exist(const char *name)
+{
+    return find_quirks(name) != NULL;
+}
+
+const char *machine_quirks(const MemMaps *mem)
+{
+    const char *name = quirk_profiles[mem->quirks].name;
+
+    return name != NULL ? name : "default";
+}
+
+unsigned int quirks_clock_hz(const char *name)
+{
+    unsigned int index;
+
+    for (index = 1; name != NULL 
+         && index < sizeof(quirk_profiles) / sizeof(quirk_profiles[0]); 
+         ++index)
+    {
+        if (!strcmp(name, quirk_profiles[index].name)) {
+            return quirk_profiles[index].clock_hz;
+        }
+    }
+
+    return quirk_profiles[0].clock_hz;
+}
+
+//-----------------------------------------------------------------------------
+// decoding
+//
+// decode() follows an opcode through the tables of the profile of the
+// machine, as step() does, so the analysis and the disassembly see the
+// handlers that run. Each dispatcher it meets on the way is looked up here,
+// for the table it calls into and the digits it indexes it with
+
+enum DispatchIndex
+{
+    BY_THIRD,                    // the third digit
+    BY_LAST,                     // the last digit
+    BY_SPECIAL,                  // see special_index()
+    BY_BYTE                      // the low byte
+};
+
+typedef struct Dispatch
+{
+    opfunc dispatcher;
+    const opfunc *table;
+    uint8_t by;                  // DispatchIndex
+} Dispatch;
+
+static const Dispatch dispatchers[] =
+{
+    { msbis0,          zeroop,         BY_LAST    },
+    { msbis8,          eightop,        BY_LAST    },
+    { msbise,          e_op,           BY_THIRD   },
+    { msbisf,          special,        BY_SPECIAL },
+    { msbis8_vip,      eightop_vip,    BY_LAST    },
+    { msbisf_vip,      special_vip,    BY_SPECIAL },
+    { msbis8_chip48,   eightop_chip48, BY_LAST    },
+    { msbisf_chip48,   special_chip48, BY_SPECIAL },
+    { msbis8_modern,   eightop_modern, BY_LAST    },
+    { msbisf_modern,   special_modern, BY_SPECIAL },
+    { msbis0_schip,    zeroop_schip,   BY_THIRD   },
+    { zero_f_ext,      zerofop_ext,    BY_LAST    },
+    { msbisf_schip,    special_schip,  BY_BYTE    },
+    { msbis0_xochip,   zeroop_xochip,  BY_THIRD   },
+    { msbis5_xochip,   fiveop_xochip,  BY_LAST    },
+    { msbise_xochip,   e_op_xochip,    BY_THIRD   },
+    { msbisf_xochip,   special_xochip, BY_BYTE    }
+};
+
+// the entry of dispatchers for handler, NULL if it runs an opcode itself
+static const Dispatch *find_dispatch(opfunc handler)
+{
+    unsigned int index;
+
+    for (index = 0; index < sizeof(dispatchers) / sizeof(dispatchers[0]);
+         ++index)
+    {
+        if (dispatchers[index].dispatcher == handler) {
+            return &dispatchers[index];
+        }
+    }
+
+    return NULL;
+}
+
+opfunc decode(const MemMaps *mem, uint16_t opcode)
+{
+    opfunc handler = quirk_profiles[mem->quirks].table[offset1(opcode)];
+    const Dispatch *dispatch;
+    uint16_t index;
+
+    // every msbis0 ignores it
+    if (!opcode) {
+        return msbis0;
+    }
+
+    // the tables a dispatcher leads to may have dispatchers of their own
+    while ((dispatch = find_dispatch(handler)) != NULL)
+    {
+        switch (dispatch->by)
+        {
+            case BY_THIRD:
+                index = offset3(opcode);
+                break;
+            case BY_LAST:
+                index = offset4(opcode);
+                break;
+            case BY_SPECIAL:
+                index = special_index(opcode);
+                break;
+            default:
+                index = opcode & 0xFF;
+        }
+
+        handler = dispatch->table[index];
+    }
+
+    return handler;
 }
 
 //-----------------------------------------------------------------------------
 
 // fonts
-static uint8_t fonts[80] = {
+static const uint8_t fonts[80] = {
     0xF0, 0x90, 0x90, 0x90, 0xF0,   // 0
     0x20, 0x60, 0x20, 0x20, 0x70,   // 1
     0xF0, 0x10, 0xF0, 0x80, 0xF0,   // 2
@@ -117,154 +465,139 @@ static uint8_t fonts[80] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80    // F
 };
 
+// the 8x10 digits of the SUPER-CHIP, and the letters the XO-CHIP added
+static const uint8_t big_fonts[160] = {
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C,   // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C,   // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF,   // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C,   // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06,   // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C,   // 5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C,   // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60,   // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C,   // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C,   // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,   // A
+    0xFE, 0xFF, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xC3, 0xFF, 0xFE,   // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,   // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,   // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,   // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0    // F
+};
+
 //******************************************************************************
 //*                      general processor functions                           *
 //******************************************************************************
 
-
-
-int main(int argc, char *argv[])
+uint8_t randnum(cpu *cpuData)
 {
-    uint game_size;
+    // xorshift32, the state lives in the cpu so that a snapshot of the
+    // machine also restores the sequence of random numbers
+    uint32_t x = cpuData->rng;
 
-    
-    // initialize interpreter and load game into memory
-    if (argc == 2) {
-        cpu cpuData;
-        MemMaps mems;
-        
-        // initialize general variables and arrays to the desired values
-        initialize(&cpuData, &mems);
-
-        // open game and load it in memory
-        game_size = load_game(argv[argc-1], &mems);
-
-	    char *game_name = argv[1];
-        // start window using sdl 
-        init_win(game_name, WINDOW_SCALLING);
-
-        // start cpu emulation
-        emulate(game_size, &cpuData, &mems);
-    } else {
-        fprintf(stderr, "usage: ./chip8 <game>\n");
-        exit(1);
-    }
-}
-
-uint8_t randnum()
-{
-    ssize_t buffer[1];
-    getrandom(&buffer[0], 1, 0x0);
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    cpuData->rng = x;
 
-    // generates number
-    srandom(buffer[0]);
-    uint8_t number = (random()) % 255;
-
-    return number;
+    return (uint8_t) x;
 }
 
-
-void debug(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+uint64_t hash_bytes(uint64_t hash, const void *data, unsigned long size)
 {
-       
-    printf("opcode: %.4x pc: %.2X I: %.4X SP: %.4X DT: %.2i ST: %.2i\n", 
-            opcode, cpuData->pc, cpuData->i, cpuData->sp, cpuData->dt, cpuData->st);
+    const uint8_t *byte = data;
 
-    uint index = 0;
-    printf("Stack dump     | Register dump \n");
-    while (index < STACK_SIZE)
+    while (size--)
     {
-        printf("stack %.1X: 0x%.3X  |  R%.1X: %.3X\n", 
-		index, cpuData->stack[index], index, cpuData->regs[index]);
-	    ++index;
+        hash = (hash ^ *byte++) * 0x100000001B3ULL;
     }
 
-    printf("\n\n\n");
+    return hash;
 }
 
-// TODO: refactor code to be more efficient
-void emulate(uint game_size, cpu *cpuData, MemMaps *memoryMaps)
+void set_clock_hz(MemMaps *mems, unsigned int hz)
 {
-    uint16_t opcode;
+    mems->clock_hz = hz ? hz : quirk_profiles[mems->quirks].clock_hz;
+}
 
-    // start time is the time at which the executing cycle was started
-    struct timespec startTime, timersClock;
-    clock_gettime(CLOCK_MONOTONIC, &timersClock);
+unsigned int frame_cycles(const MemMaps *mems, unsigned long frame)
+{
+    // the clock isn't always a multiple of TIMERS_HZ, so the remainder is 
+    // spread over the frames
+    unsigned int hz = mems->clock_hz;
 
-    for (;(cpuData->pc) <= (game_size + 0x200); )
-    {
-        clock_gettime(CLOCK_MONOTONIC, &startTime);
-        set_keys(memoryMaps->keys);
+    frame %= TIMERS_HZ;
+    return (frame + 1) * hz / TIMERS_HZ - frame * hz / TIMERS_HZ;
+}
 
-        opcode = fetch(memoryMaps->ram, &cpuData->pc);
-	
-	    // debug(opcode, cpuData, memoryMaps);
-        // execute opcode
-        (generalop[(opcode & 0xF000) >> 12]) (opcode, cpuData, memoryMaps);
+void timers_step(cpu *cpuData)
+{
+    if (cpuData->dt != 0) {
+        cpuData->dt -= 1;
+    }
 
-        clock_handler(&startTime);
-        timers_tick(cpuData, &timersClock);
+    // the buzzer sounds while it isn't 0, see audio.h
+    if (cpuData->st != 0) {
+        cpuData->st -= 1;
     }
 }
 
-void clock_handler(struct timespec *startTime)
+uint8_t step(cpu *cpuData, MemMaps *mem)
 {
-    // TODO: we should check if the resolution is high enough to handle 
-    // the amount of nanoseconds that one cycle takes, and if not, we should 
-    // increase the amount of cycles to execute before calling this function
-    // (one cycle per call should yield better resolution though)
-
-    // we sleep the difference between the time it takes to execute a cycle in 
-    // nanoseconds and the time it took to execute the cycle
-    struct timespec timenow; 
-    clock_gettime(CLOCK_MONOTONIC, &timenow);
+    // the opcode is 2 bytes long, so pc must leave room for the second one
+    if (cpuData->pc >= mem->ram_size - 1) {
+        cpuData->fault = FAULT_PC_OVERRUN;
+        return cpuData->fault;
+    }
 
-    // Amount of time the cycle took to execute
-    long CycleExec_ns = timenow.tv_nsec - startTime->tv_nsec;
+    uint16_t opcode = fetch(mem->ram, &cpuData->pc);
 
-    // in case the cycle took more than or the exact amount of time
-    // it should take to execute, we don't need to sleep and can just 
-    // end the function
-    if (CycleExec_ns > 0 && CycleExec_ns < CLOCK_HZ_NS) {
-        struct timespec sleeptime;
-        sleeptime.tv_nsec = CLOCK_HZ_NS - CycleExec_ns;
-        sleeptime.tv_sec = 0;
+    cpuData->fault = FAULT_NONE;
+    (quirk_profiles[mem->quirks].table[(opcode & 0xF000) >> 12])
+        (opcode, cpuData, mem);
 
-        if(clock_nanosleep(CLOCK_MONOTONIC, 0, &sleeptime, NULL) == -1) {
-            perror("chip8: ");
-        }
-    }
+    return cpuData->fault;
 }
 
-void timers_tick(cpu *cpuData, struct timespec *timersClock)
+const char *fault_name(uint8_t fault)
 {
-    struct timespec nowtime;
-    clock_gettime(CLOCK_MONOTONIC, &nowtime);
+    static const char *names[FAULT_COUNT] =
+    {
+        "no fault", "Stack overflow", "Stack underflow",
+        "Ram overrun", "Program counter overrun", "Watchpoint", 
+        "Program exited"
+    };
 
-    // get the difference between the last update of the clocks
-    // and now, and if the difference is bigger or equal to the 
-    // delay between clock updates, we update the clocks and the 
-    // timer
-    long diffNs = nowtime.tv_nsec - timersClock->tv_nsec;
-    
-    // we need the difference in seconds because sometimes one seconds passes
-    // and the timersClock structure wasn't updated, which can create some 
-    // really hairy bugs if just time in nanoseconds was considered
-    long diffS  = nowtime.tv_sec  - timersClock->tv_nsec;
-    
-    if (diffS != 0 || diffNs >= TIMERS_HZ_NS) {
+    return fault < FAULT_COUNT ? names[fault] : "unknown fault";
+}
 
-        if (cpuData->dt != 0) {
-            cpuData->dt -= 1;
-        }
+int ram_watched(MemMaps *mem, uint32_t addr, uint32_t len, uint8_t kind)
+{
+    uint32_t index;
 
-        if (cpuData->st != 0) {
-            // TODO: call function to play that good ol jazz.
-            cpuData->st -= 1;
+    if (mem->seen != NULL) {
+        for (index = addr; index < addr + len && index < mem->ram_size; ++index)
+        {
+            mem->seen[index] |= kind;
         }
+    }
+
+    // blocks can be watched only to fill the seen map
+    if (mem->watch == NULL) {
+        return 0;
+    }
 
-        clock_gettime(CLOCK_MONOTONIC, timersClock);
+    for (index = addr; index < addr + len && index < mem->ram_size; ++index)
+    {
+        if (mem->watch[index] & kind) {
+            mem->watch_addr = addr;
+            mem->watch_len = len;
+            mem->watch_kind = kind;
+            return 1;
+        }
     }
+
+    return 0;
 }
 
 uint16_t fetch(uint8_t *ram, uint16_t *pc)
@@ -280,48 +613,122 @@ uint16_t fetch(uint8_t *ram, uint16_t *pc)
     return opcode;
 }
 
-void initialize(cpu *cpuData, MemMaps *mems)
+// set up the machine with the profile at index of quirk_profiles
+static void initialize_profile(cpu *cpuData, MemMaps *mems,
+                               unsigned int index)
 {
-    explicit_bzero(mems->screen, WINDOW_HEIGHT * WINDOW_WIDTH);
+    const QuirkProfile *machine = &quirk_profiles[index];
+
+    explicit_bzero(mems->screen, sizeof(mems->screen));
 
     // Can you smell that? Yes, my friend, that is the smell of sanitizer
-    explicit_bzero(mems->ram, 
-                   (RAM_END-1) * sizeof(mems->ram[0]));
+    explicit_bzero(mems->ram, sizeof(mems->ram));
+    mems->ram_size = machine->ram_size;
+    mems->block_shift = machine->block_shift;
+    mems->quirks = index;
+    mems->clock_hz = machine->clock_hz;
     
     explicit_bzero(cpuData->stack, STACK_SIZE * sizeof(cpuData->stack[0]));
+    explicit_bzero(cpuData->regs, sizeof(cpuData->regs));
+    explicit_bzero(cpuData->flags, sizeof(cpuData->flags));
+    explicit_bzero(mems->keys, sizeof(mems->keys));
+
+    // a 500 Hz square wave at the default pitch, until a XO-CHIP rom loads
+    // a pattern of its own
+    memset(mems->audio, 0xF0, sizeof(mems->audio));
     
     // load fontset
     memcpy(mems->ram, fonts, (FONTSET_SIZE - 1));
+    memcpy(mems->ram + BIG_FONTSET_START, big_fonts, sizeof(big_fonts));
 
     // set some default values
     cpuData->i = 0;
     cpuData->pc = PROG_RAM_START;
-    cpuData->st = 60;
+    cpuData->sp = 0;
+    cpuData->st = 0;
     cpuData->dt = 60;
+    cpuData->fault = FAULT_NONE;
+    cpuData->unknown = 0;
+
+    // xorshift gets stuck at 0, so keep reading until we get a usable seed
+    do {
+        getrandom(&cpuData->rng, sizeof(cpuData->rng), 0x0);
+    } while (cpuData->rng == 0);
+
+    mems->hires = 0;
+    mems->planes = 1;
+    mems->pitch = 64;               // 4000 Hz
+
+    mems->redraw = 0;
+    mems->keys_read = 0;
+    mems->dirty = 0;
+
+    mems->watch_read = 0;
+    mems->watch_write = 0;
+    mems->watch = NULL;
+    mems->seen = NULL;
 }
 
-uint load_game(char *game_name, MemMaps *mems)
+int initialize(cpu *cpuData, MemMaps *mems, const char *quirks)
 {
-    FILE *filep = fopen(game_name, "r");
+    const QuirkProfile *found = find_quirks(quirks);
 
-    if (filep == NULL) {
-        perror("chip8: ");
-        exit(errno); 
+    if (found == NULL) {
+        return 0;
     }
 
+    initialize_profile(cpuData, mems, found - quirk_profiles);
+    return 1;
+}
 
-    // read at most 0xdff bytes of data, respecting the maximum amount of
-    // ram that is available to store applications, according to the chip8
-    // specification
-    uint bread = (uint) fread((mems->ram + 0x200),
-                              sizeof(char),
-                              RAM_SIZE - PROG_RAM_START,
-                              filep);
+unsigned int load_rom(const uint8_t *rom, unsigned long size, MemMaps *mems)
+{
+    // at most 0xdff bytes, respecting the maximum amount of ram that is 
+    // available to store applications, according to the chip8 specification,
+    // or what's left of the 64 KB of the XO-CHIP
+    if (size > mems->ram_size - PROG_RAM_START) {
+        size = mems->ram_size - PROG_RAM_START;
+    }
+
+    memcpy(mems->ram + PROG_RAM_START, rom, size);
+
+    return size;
+}
+
+// OR the pixels of a 64 pixels word in pairs, into 32 of them
+static uint64_t squeeze(uint64_t word)
+{
+    // the pair of each pixel ends up in the even bits, then those are 
+    // gathered into the low half
+    uint64_t x = ((word | (word << 1)) & 0xAAAAAAAAAAAAAAAAULL) >> 1;
 
-    if(ferror(filep)) {
-        fprintf(stderr, "chip8: error reading file\n");
-        exit(1);
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+
+    return x;
+}
+
+void screen_lores(const MemMaps *mem, uint64_t rows[WINDOW_HEIGHT])
+{
+    const uint64_t *first = mem->screen[0], *second = mem->screen[1];
+    unsigned int row;
+
+    for (row = 0; row < WINDOW_HEIGHT; ++row)
+    {
+        if (!mem->hires) {
+            rows[row] = first[row] | second[row];
+            continue;
+        }
+
+        // 2 rows of 2 words each
+        uint64_t left = first[4 * row] | first[4 * row + 2] 
+                        | second[4 * row] | second[4 * row + 2];
+        uint64_t right = first[4 * row + 1] | first[4 * row + 3] 
+                         | second[4 * row + 1] | second[4 * row + 3];
+
+        rows[row] = (squeeze(left) << 32) | squeeze(right);
     }
-    
-    return bread;
 }
@@ -10,21 +10,60 @@
 #define RAM_END (RAM_SIZE - 1)
 #define PROG_RAM_START 0X200
 
+// the XO-CHIP addresses 64 KB of ram, the array is always that big and 
+// MemMaps.ram_size says how much of it the machine has
+#define XO_RAM_SIZE 0x10000
+
+// each row of the screen is stored in a 64 bit word, see MemMaps
 #define WINDOW_WIDTH 64
 #define WINDOW_HEIGHT 32
 #define WINDOW_SCALLING 10
 
+// the SUPER-CHIP and XO-CHIP high resolution mode, with rows of 2 words
+#define HIRES_WIDTH 128
+#define HIRES_HEIGHT 64
+#define SCREEN_WORDS (HIRES_WIDTH / 64 * HIRES_HEIGHT)
+
+// bit planes of the XO-CHIP, the other machines only draw to the first one
+#define SCREEN_PLANES 2
+
 #define FONTSET_SIZE 0x50
 #define FONTSET_BYTES_PER_CHAR 5
 
+// the SUPER-CHIP digits, 8x10 pixels, right after the small ones
+#define BIG_FONTSET_START FONTSET_SIZE
+#define BIG_FONTSET_BYTES_PER_CHAR 10
+
 #define CLOCK_HZ 500
-// amount of ns that executing 1 cycle takes
-#define CLOCK_HZ_NS ((double)1000000000.0 / (double)CLOCK_HZ)
 
 #define TIMERS_HZ 60
 // the time in ns that should pass between each clock update
 #define TIMERS_HZ_NS (long)(1000000000.0 / TIMERS_HZ)
 
+// ram is tracked in 64 blocks, so that a machine can be brought back to a 
+// snapshot by copying only the blocks that were written since then. They 
+// are 64 bytes each, or 1 KB with the ram of the XO-CHIP, see 
+// MemMaps.block_shift
+#define RAM_BLOCK_SHIFT 6
+#define RAM_BLOCK_SIZE (1 << RAM_BLOCK_SHIFT)
+#define XO_RAM_BLOCK_SHIFT 10
+
+// faults raised by the opcodes when the program tries to use memory or stack
+// outside of their bounds. The opcode that raises it doesn't change the
+// machine state, and it's up to the caller of step() to decide what to do
+enum Faults
+{
+    FAULT_NONE,
+    FAULT_STACK_OVERFLOW,        // CALL with a full stack
+    FAULT_STACK_UNDERFLOW,       // RET with an empty stack
+    FAULT_RAM_OVERRUN,           // FX33, FX55, FX65 or DXYN past the ram end
+    FAULT_PC_OVERRUN,            // pc points outside of ram
+    FAULT_WATCH,                 // ram access hit a watchpoint. Unlike the
+                                 // others, the opcode did run
+    FAULT_EXIT,                  // 00FD, the SUPER-CHIP program ended
+    FAULT_COUNT
+};
+
 typedef struct cpu
 {
     uint16_t i;                  // index register(often addressing)
@@ -34,6 +73,10 @@ typedef struct cpu
 	uint16_t sp;                 // stack pointer
 	uint16_t stack[STACK_SIZE];  // stack itself
 	uint8_t regs[16];            // registers 0x0-0xF
+    uint8_t fault;               // fault raised by the last opcode
+    uint32_t unknown;            // unknown opcodes executed
+    uint32_t rng;                // state of the random number generator
+    uint8_t flags[16];           // the SUPER-CHIP RPL flags, FX75 and FX85
 } cpu;
 
 // store all the memory related things, like the memory keymap 
@@ -41,39 +84,165 @@ typedef struct cpu
 typedef struct MemMaps
 {
     uint8_t keys[16];                       // keymap
-    uint8_t ram[RAM_SIZE];                  // RAM itself
-
-    uint8_t screen[WINDOW_HEIGHT]
-                  [WINDOW_WIDTH];          // the screen map. This screen map
-                                           // is reduced in size by a factor of
-                                           // eight, so each byte represent
-                                           // a row of 8 contiguous pixels
+    uint8_t ram[XO_RAM_SIZE];               // RAM itself
+    uint32_t ram_size;                      // how much of it there is
+    uint8_t block_shift;                    // log2 of the size of the ram
+                                            // blocks of dirty and watch_*
+
+    uint64_t screen[SCREEN_PLANES][SCREEN_WORDS];
+                                           // the screen map, a plane after
+                                           // the other. Rows are packed, 1
+                                           // bit per pixel and the leftmost
+                                           // one in the msb of the first 
+                                           // word: a word per row in low
+                                           // resolution, 2 in high
+    uint8_t hires;                         // 128x64 instead of 64x32
+    uint8_t planes;                        // planes drawn to, 1 bit each
+    uint8_t audio[16];                     // XO-CHIP audio pattern, 1 bit
+    uint8_t pitch;                         // per sample, and its pitch
+    uint8_t redraw;                        // screen changed since last frame
+    uint16_t keys_read;                    // keys checked by opcodes, 1 bit
+                                           // each, cleared by the frontend
+    uint64_t dirty;                        // ram blocks written, 1 bit each
+
+    uint64_t watch_read;                   // ram blocks with a read or a
+    uint64_t watch_write;                  // write watchpoint, 1 bit each
+    const uint8_t *watch;                  // WATCH_* bits of each address,
+                                           // ram_size of them, owned by
+                                           // whoever sets them. initialize()
+                                           // clears it and the bitmaps
+    uint16_t watch_addr;                   // the access that hit one
+    uint16_t watch_len;
+    uint8_t watch_kind;
+    uint8_t *seen;                         // WATCH_* bits of each address
+                                           // read or written in a watched
+                                           // block, NULL not to record them
+
+    uint8_t quirks;                        // its quirk profile, an index
+                                           // in the profiles of chip8.c
+    uint32_t clock_hz;                     // opcodes per second, those of
+                                           // the profile by default
 } MemMaps;
 
+// kinds of ram access a watchpoint stops at
+#define WATCH_READ 1
+#define WATCH_WRITE 2
+
+// bitmap of the ram blocks in the range [addr, addr + len)
+static inline uint64_t ram_blocks(const MemMaps *mem, uint32_t addr, 
+                                  uint32_t len)
+{
+    uint32_t block = addr >> mem->block_shift;
+    uint32_t last = (addr + len - 1) >> mem->block_shift;
+
+    return (~(uint64_t) 0 >> (63 - last)) & (~(uint64_t) 0 << block);
+}
+
+// look up the range in the watch map, after its blocks were found watched,
+// and record the access in the seen map if there's one. Return 1, and
+// remember the access, if an address in it is watched for kind
+int ram_watched(MemMaps *mem, uint32_t addr, uint32_t len, uint8_t kind);
+
+// mark the ram blocks in the range [addr, addr + len) as dirty. Return 1 if 
+// the write hit a watchpoint. Without watchpoints in these blocks that's the
+// only extra work a store does
+static inline int ram_touch(MemMaps *mem, uint32_t addr, uint32_t len)
+{
+    uint64_t blocks = ram_blocks(mem, addr, len);
+
+    mem->dirty |= blocks;
+    return (mem->watch_write & blocks) 
+           && ram_watched(mem, addr, len, WATCH_WRITE);
+}
+
+// the opcodes call it before reading the range [addr, addr + len) of ram as
+// data. Return 1 if the read hit a watchpoint
+static inline int ram_read(MemMaps *mem, uint32_t addr, uint32_t len)
+{
+    return (mem->watch_read & ram_blocks(mem, addr, len))
+           && ram_watched(mem, addr, len, WATCH_READ);
+}
+
 //******************************************************************************
 //* General Functions                                                          *
 //******************************************************************************
 
-// initialize memory and registers and load game into memory
-void initialize();
+// initialize memory and registers, with the quirk profile called quirks:
+// "vip", "chip48", "schip", "modern" or "xochip" make the interpreter
+// behave like another one where they disagree, the last two also adding the
+// opcodes of the SUPER-CHIP and XO-CHIP, and the XO-CHIP running faster and
+// with more ram. "default" is the behavior of the original tables of
+// chip8.c. The machine keeps its profile until the next initialize(), so
+// the machines of a process can differ. Return 0, without touching the
+// machine, if there's no profile with that name
+int initialize(cpu *cpuData, MemMaps *mems, const char *quirks);
 
-// load game into ram
-unsigned int load_game(char *game_name, MemMaps *mems);
+// copy size bytes of rom into the program ram, ignoring what doesn't fit. 
+// Return the amount of bytes copied
+unsigned int load_rom(const uint8_t *rom, unsigned long size, MemMaps *mems);
+
+// whether there's a quirk profile called name, for initialize()
+int quirks_exist(const char *name);
+
+// the name of the quirk profile of the machine, "default" for the original
+// tables
+const char *machine_quirks(const MemMaps *mem);
+
+// the clock of the profile called name, that of the default one if there's 
+// no such profile
+unsigned int quirks_clock_hz(const char *name);
+
+// the screen as 64x32 pixels of a plane, a word per row, for the frontends
+// that only know that size. The high resolution is scaled down, a pixel
+// being lit if any of the 4 it replaces is, and so are the planes
+void screen_lores(const MemMaps *mem, uint64_t rows[WINDOW_HEIGHT]);
+
+// FNV-1a of size bytes of data, continuing from hash. Start from HASH_SEED
+#define HASH_SEED 0xCBF29CE484222325ULL
+uint64_t hash_bytes(uint64_t hash, const void *data, unsigned long size);
 
 // return random number between 0-255
-uint8_t randnum();
+uint8_t randnum(cpu *cpuData);
 
 // fetch 2 contigous bytes in memory, starting at pc, and then adds 2 to pc
 uint16_t fetch(uint8_t *ram, uint16_t *pc);
 
-// subtract 1 from ST and DT
-void timers_tick(cpu *cpuData, struct timespec *timersClock);
+// execute the opcode at pc. Return the fault raised by it, FAULT_NONE if
+// the opcode executed normally
+uint8_t step(cpu *cpuData, MemMaps *mem);
+
+// describe a fault in a human readable way
+const char *fault_name(uint8_t fault);
+
+// subtract 1 from ST and DT, if they aren't 0 already
+void timers_step(cpu *cpuData);
+
+// amount of cpu cycles between each timers tick, for the loops that count
+// time in cycles instead of reading the clock
+#define CYCLES_PER_TICK (CLOCK_HZ / TIMERS_HZ)
+
+// return the amount of cycles the machine runs in the given frame, the 
+// frames counting from 0
+unsigned int frame_cycles(const MemMaps *mems, unsigned long frame);
+
+// run the machine at hz opcodes per second instead of the clock of its quirk
+// profile, 0 to go back to it. initialize() goes back to it too
+void set_clock_hz(MemMaps *mems, unsigned int hz);
+
+//******************************************************************************
+//* Frontend, main.c                                                           *
+//******************************************************************************
+
+// load game into ram, exiting if it can't be read
+unsigned int load_game(char *game_name, MemMaps *mems);
 
 // emulate cpu
 void emulate(unsigned int game_size, cpu *cpuData, MemMaps *memoryMaps);
 
-// function for handling the cpu clock our emulator cpu
-void clock_handler(struct timespec *startTime);
+// sleep until deadline plus 1/60 of a second, and move deadline there. 
+// Return how late, in ns, the sleep ended. When that's more than
+// PACING_MAX_CATCHUP frames, the deadline moves to now instead
+int64_t frame_wait(struct timespec *deadline);
 
 //
 #endif
@@ -0,0 +1,251 @@
+/*
+ * chip8stat: print the telemetry published by running emulators. 
+ *
+ * usage: chip8stat [-w] [-f] [pid...]
+ *
+ * Without pids, every emulator found in /dev/shm is listed. With -w, the
+ * list is printed again every second. With -f, the latest frame exported by
+ * each emulator started with -X is printed instead of its telemetry
+ * */
+
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "export.h"
+#include "shm.h"
+#include "telemetry.h"
+
+#define MAX_INSTANCES 1024
+
+// an instance is reported as stalled if it didn't update for this long
+#define STALLED_NS 2000000000ULL
+
+static uint64_t now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void print_header()
+{
+    printf("%8s %10s %5s %5s %10s %10s %10s %10s %8s %6s %8s %8s %5s %s\n",
+           "pid", "ips", "fps", "pps", "jitter_us", "jit_max", 
+           "oversh_us", "over_max", "unknown", "pc", "skipped", "dropped",
+           "every", "state");
+}
+
+// print the telemetry of the emulator running as pid. Return 0 if it 
+// couldn't be read
+static int print_instance(int pid)
+{
+    char name[64];
+    size_t size;
+
+    snprintf(name, sizeof(name), "%s%d", TELEMETRY_PREFIX, pid);
+
+    Telemetry *telemetry = shm_attach(name, &size, 0);
+    if (telemetry == NULL) {
+        return 0;
+    }
+
+    // the frame skipping fields came later
+    if (size < offsetof(Telemetry, skipped_catchup)
+        || telemetry->magic != TELEMETRY_MAGIC
+        || telemetry->version != TELEMETRY_VERSION) {
+        printf("%8d unknown telemetry layout\n", pid);
+        shm_detach(telemetry, size);
+        return 1;
+    }
+
+    uint64_t updated = atomic_load_explicit(&telemetry->updated_ns,
+                                            memory_order_relaxed);
+    char skipped[24] = "-", dropped[24] = "-", every[16] = "-";
+
+    if (size >= sizeof(Telemetry)) {
+        snprintf(skipped, sizeof(skipped), "%lu", (unsigned long)
+                 (atomic_load_explicit(&telemetry->skipped_catchup,
+                                       memory_order_relaxed)
+                  + atomic_load_explicit(&telemetry->skipped_interval,
+                                         memory_order_relaxed)));
+        snprintf(dropped, sizeof(dropped), "%lu", (unsigned long)
+                 atomic_load_explicit(&telemetry->dropped,
+                                      memory_order_relaxed));
+        snprintf(every, sizeof(every), "%u",
+                 atomic_load_explicit(&telemetry->present_interval,
+                                      memory_order_relaxed));
+    }
+
+    printf("%8d %10u %5u %5u %10.1f %10.1f %10.1f %10.1f %8lu  %#.3X "
+           "%8s %8s %5s %s\n",
+           pid, 
+           atomic_load_explicit(&telemetry->ips, memory_order_relaxed),
+           atomic_load_explicit(&telemetry->fps, memory_order_relaxed),
+           atomic_load_explicit(&telemetry->pps, memory_order_relaxed),
+           atomic_load_explicit(&telemetry->jitter_ns, 
+                                memory_order_relaxed) / 1000.0,
+           atomic_load_explicit(&telemetry->jitter_max_ns, 
+                                memory_order_relaxed) / 1000.0,
+           atomic_load_explicit(&telemetry->overshoot_ns, 
+                                memory_order_relaxed) / 1000.0,
+           atomic_load_explicit(&telemetry->overshoot_max_ns, 
+                                memory_order_relaxed) / 1000.0,
+           (unsigned long) atomic_load_explicit(&telemetry->unknown_opcodes,
+                                                memory_order_relaxed),
+           atomic_load_explicit(&telemetry->pc, memory_order_relaxed),
+           skipped, dropped, every,
+           kill(pid, 0) == -1 && errno == ESRCH ? "exited" 
+           : now_ns() - updated > STALLED_NS ? "stalled" : "running");
+
+    shm_detach(telemetry, size);
+    return 1;
+}
+
+// print the latest frame exported by the emulator running as pid. Return 0
+// if there's none
+static int print_frame(int pid)
+{
+    char name[64];
+    size_t size;
+    ExportFrame copy;
+    const ExportFrame *slot;
+    uint32_t seq;
+    unsigned int row, column, reg;
+
+    snprintf(name, sizeof(name), "%s%d", EXPORT_PREFIX, pid);
+
+    Export *exp = shm_attach(name, &size, 0);
+    if (exp == NULL) {
+        return 0;
+    }
+
+    if (size < sizeof(Export) || exp->magic != EXPORT_MAGIC
+        || exp->version != EXPORT_VERSION) {
+        printf("%8d unknown frame layout\n", pid);
+        shm_detach(exp, size);
+        return 1;
+    }
+
+    // the slot is copied since printing takes a while, readers that only 
+    // look at a few fields can check them in place the same way
+    do {
+        slot = export_latest(exp);
+        if (slot == NULL) {
+            printf("%8d no frame yet\n", pid);
+            shm_detach(exp, size);
+            return 1;
+        }
+
+        seq = export_begin(slot);
+        memcpy(&copy, slot, sizeof(copy));
+    } while (!export_valid(slot, seq));
+
+    printf("%8d frame %lu pc %#.3X i %#.3X sp %u dt %u st %u\n", pid,
+           (unsigned long) copy.frame, copy.pc, copy.i, copy.sp, copy.dt, 
+           copy.st);
+    for (reg = 0; reg < 16; ++reg)
+    {
+        printf(" V%X=%.2X", reg, copy.regs[reg]);
+    }
+    printf("\n");
+
+    for (row = 0; row < WINDOW_HEIGHT; ++row)
+    {
+        for (column = 0; column < WINDOW_WIDTH; ++column)
+        {
+            putchar((copy.screen[row] >> (63 - column)) & 1 ? '#' : '.');
+        }
+        putchar('\n');
+    }
+
+    shm_detach(exp, size);
+    return 1;
+}
+
+// find the pids of the emulators publishing telemetry
+static int find_instances(int *pids)
+{
+    const char *prefix = TELEMETRY_PREFIX + 1;
+    struct dirent *entry;
+    int count = 0;
+
+    DIR *dir = opendir("/dev/shm");
+    if (dir == NULL) {
+        perror("chip8stat: /dev/shm");
+        return 0;
+    }
+
+    while ((entry = readdir(dir)) != NULL && count < MAX_INSTANCES)
+    {
+        if (strncmp(entry->d_name, prefix, strlen(prefix)) == 0) {
+            pids[count++] = atoi(entry->d_name + strlen(prefix));
+        }
+    }
+    closedir(dir);
+
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    static int pids[MAX_INSTANCES];
+    int watch = 0, frames = 0, opt, count, index;
+
+    while ((opt = getopt(argc, argv, "wf")) != -1)
+    {
+        switch (opt)
+        {
+            case 'w':
+                watch = 1;
+                break;
+            case 'f':
+                frames = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: chip8stat [-w] [-f] [pid...]\n");
+                exit(1);
+        }
+    }
+
+    do {
+        if (optind < argc) {
+            for (count = 0; optind + count < argc && count < MAX_INSTANCES; 
+                 ++count)
+            {
+                pids[count] = atoi(argv[optind + count]);
+            }
+        } else {
+            count = find_instances(pids);
+        }
+
+        if (!frames) {
+            print_header();
+        }
+        for (index = 0; index < count; ++index)
+        {
+            if (frames) {
+                if (!print_frame(pids[index])) {
+                    printf("%8d no frames, was it started with -X?\n", 
+                           pids[index]);
+                }
+            } else if (!print_instance(pids[index])) {
+                printf("%8d no telemetry\n", pids[index]);
+            }
+        }
+
+        if (watch) {
+            fflush(stdout);
+            sleep(1);
+        }
+    } while (watch);
+
+    return 0;
+}
@@ -0,0 +1,544 @@
+/*
+ * Conformance runner. See conform.h
+ * */
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "conform.h"
+
+enum ConformStatus
+{
+    CONFORM_LOST,                // the worker running it died
+    CONFORM_PASS,
+    CONFORM_FAIL,
+    CONFORM_UPDATED,
+    CONFORM_ERROR                // the rom or its script couldn't be used
+};
+
+typedef struct ConformKey
+{
+    unsigned long frame;
+    uint8_t key;
+    uint8_t down;
+} ConformKey;
+
+typedef struct ConformScript
+{
+    char quirks[CONFORM_MAX_QUIRKS][32];
+    unsigned int quirks_count;
+    unsigned long frames;
+    unsigned long cycles;
+    uint32_t seed;
+    ConformKey keys[CONFORM_MAX_KEYS];
+    unsigned int keys_count;
+} ConformScript;
+
+typedef struct ConformResult
+{
+    uint8_t status;
+    unsigned int len;
+    char report[CONFORM_REPORT_SIZE];
+} ConformResult;
+
+// shared by the workers, the next rom to run and the results of all
+typedef struct ConformShared
+{
+    _Atomic unsigned int next;
+    ConformResult results[];
+} ConformShared;
+
+static void report(ConformResult *result, const char *format, ...)
+{
+    va_list args;
+
+    if (result->len >= sizeof(result->report) - 1) {
+        return;
+    }
+
+    va_start(args, format);
+    int len = vsnprintf(result->report + result->len,
+                        sizeof(result->report) - result->len, format, args);
+    va_end(args);
+
+    if (len > 0) {
+        result->len += len;
+        if (result->len >= sizeof(result->report)) {
+            result->len = sizeof(result->report) - 1;
+        }
+    }
+}
+
+//******************************************************************************
+//*                                 scripts                                    *
+//******************************************************************************
+
+// read the script at path into script, leaving the defaults if there's none.
+// Return 0 after reporting what's wrong with it
+static int read_script(const char *path, ConformScript *script,
+                       ConformResult *result)
+{
+    char line[256], word[32], state[8];
+    unsigned long frame, key;
+    unsigned int number = 0;
+    int offset;
+
+    memset(script, 0, sizeof(*script));
+    strcpy(script->quirks[0], "default");
+    script->quirks_count = 1;
+    script->frames = CONFORM_DEFAULT_FRAMES;
+    script->seed = 1;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        ++number;
+        if (sscanf(line, "%31s", word) != 1 || word[0] == '#') {
+            continue;
+        }
+
+        if (!strcmp(word, "quirks")) {
+            char *names = line + strcspn(line, " \t");
+
+            script->quirks_count = 0;
+            while (script->quirks_count < CONFORM_MAX_QUIRKS
+                   && sscanf(names, "%31s%n",
+                             script->quirks[script->quirks_count],
+                             &offset) == 1)
+            {
+                ++script->quirks_count;
+                names += offset;
+            }
+
+            if (script->quirks_count && sscanf(names, "%31s", word) != 1) {
+                continue;
+            }
+        } else if (!strcmp(word, "frames")
+                   && sscanf(line, "%*s %lu", &script->frames) == 1) {
+            script->cycles = 0;
+            continue;
+        } else if (!strcmp(word, "cycles")
+                   && sscanf(line, "%*s %lu", &script->cycles) == 1) {
+            script->frames = 0;
+            continue;
+        } else if (!strcmp(word, "seed")
+                   && sscanf(line, "%*s %u", &script->seed) == 1) {
+            continue;
+        } else if (!strcmp(word, "key")
+                   && sscanf(line, "%*s %lu %lu %7s", &frame, &key,
+                             state) == 3
+                   && key < 16 && (!strcmp(state, "down")
+                                   || !strcmp(state, "up"))
+                   && script->keys_count < CONFORM_MAX_KEYS) {
+            script->keys[script->keys_count].frame = frame;
+            script->keys[script->keys_count].key = key;
+            script->keys[script->keys_count++].down = !strcmp(state, "down");
+            continue;
+        }
+
+        report(result, "    %s:%u: can't read %s", path, number, line);
+        fclose(file);
+        return 0;
+    }
+
+    fclose(file);
+
+    if (!script->frames && !script->cycles) {
+        report(result, "    %s: the rom would run forever\n", path);
+        return 0;
+    }
+
+    return 1;
+}
+
+//******************************************************************************
+//*                                   runs                                     *
+//******************************************************************************
+
+// run the machine as the script says, and return the fault it ended with
+static uint8_t run(cpu *cpuData, MemMaps *mems, const ConformScript *script)
+{
+    unsigned long frame, left = script->cycles;
+    unsigned int cycle, cycles, key;
+
+    for (frame = 0; !script->frames || frame < script->frames; ++frame)
+    {
+        for (key = 0; key < script->keys_count; ++key)
+        {
+            if (script->keys[key].frame == frame) {
+                mems->keys[script->keys[key].key] = script->keys[key].down;
+            }
+        }
+
+        cycles = frame_cycles(mems, frame);
+        if (script->cycles) {
+            if (!left) {
+                break;
+            }
+            cycles = cycles < left ? cycles : left;
+            left -= cycles;
+        }
+
+        for (cycle = 0; cycle < cycles; ++cycle)
+        {
+            if (step(cpuData, mems) != FAULT_NONE) {
+                return cpuData->fault;
+            }
+        }
+
+        timers_step(cpuData);
+    }
+
+    return FAULT_NONE;
+}
+
+// what a run ends with, as the goldens have it
+typedef struct ConformState
+{
+    uint64_t hash;
+    char regs[160];
+    char screen[WINDOW_HEIGHT][WINDOW_WIDTH + 1];
+} ConformState;
+
+static void capture(const cpu *cpuData, const MemMaps *mems, uint8_t fault,
+                    ConformState *state)
+{
+    uint64_t rows[WINDOW_HEIGHT];
+    unsigned int index, len = 0;
+
+    uint64_t hash = hash_bytes(HASH_SEED, mems->screen, sizeof(mems->screen));
+    hash = hash_bytes(hash, &mems->hires, sizeof(mems->hires));
+    hash = hash_bytes(hash, cpuData->regs, sizeof(cpuData->regs));
+    hash = hash_bytes(hash, &cpuData->i, sizeof(cpuData->i));
+    hash = hash_bytes(hash, &cpuData->pc, sizeof(cpuData->pc));
+    hash = hash_bytes(hash, &cpuData->sp, sizeof(cpuData->sp));
+    hash = hash_bytes(hash, cpuData->stack,
+                      cpuData->sp * sizeof(cpuData->stack[0]));
+    hash = hash_bytes(hash, &cpuData->dt, sizeof(cpuData->dt));
+    hash = hash_bytes(hash, &cpuData->st, sizeof(cpuData->st));
+    state->hash = hash_bytes(hash, &fault, sizeof(fault));
+
+    for (index = 0; index < 16; ++index)
+    {
+        len += snprintf(state->regs + len, sizeof(state->regs) - len, "%.2X ",
+                        cpuData->regs[index]);
+    }
+    snprintf(state->regs + len, sizeof(state->regs) - len,
+             "i %.4X pc %.4X sp %u dt %u st %u fault %u", cpuData->i,
+             cpuData->pc, cpuData->sp, cpuData->dt, cpuData->st, fault);
+
+    screen_lores(mems, rows);
+    for (index = 0; index < WINDOW_HEIGHT; ++index)
+    {
+        unsigned int x;
+
+        for (x = 0; x < WINDOW_WIDTH; ++x)
+        {
+            state->screen[index][x] = rows[index] >> (63 - x) & 1 ? '#' : '.';
+        }
+        state->screen[index][WINDOW_WIDTH] = '\0';
+    }
+}
+
+// read the golden at path. Return 0 if there's none, or it can't be read
+static int read_golden(const char *path, ConformState *state)
+{
+    char line[256];
+    unsigned long long hash;
+    unsigned int row;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    memset(state, 0, sizeof(*state));
+    int ok = fgets(line, sizeof(line), file) != NULL
+             && sscanf(line, "hash %llx", &hash) == 1
+             && fgets(line, sizeof(line), file) != NULL
+             && !strncmp(line, "regs ", 5);
+
+    if (ok) {
+        state->hash = hash;
+        snprintf(state->regs, sizeof(state->regs), "%.150s", line + 5);
+        state->regs[strcspn(state->regs, "\n")] = '\0';
+        ok = fgets(line, sizeof(line), file) != NULL;
+    }
+
+    for (row = 0; ok && row < WINDOW_HEIGHT; ++row)
+    {
+        ok = fgets(line, sizeof(line), file) != NULL;
+        snprintf(state->screen[row], sizeof(state->screen[row]), "%.64s",
+                 line);
+    }
+
+    fclose(file);
+    return ok;
+}
+
+static int write_golden(const char *path, const ConformState *state)
+{
+    unsigned int row;
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        return 0;
+    }
+
+    fprintf(file, "hash %.16llx\nregs %s\nscreen\n",
+            (unsigned long long) state->hash, state->regs);
+    for (row = 0; row < WINDOW_HEIGHT; ++row)
+    {
+        fprintf(file, "%s\n", state->screen[row]);
+    }
+
+    return fclose(file) == 0;
+}
+
+// report what changed between the golden and the run
+static void diff(const ConformState *golden, const ConformState *state,
+                 ConformResult *result)
+{
+    unsigned int row, x;
+
+    if (strcmp(golden->regs, state->regs)) {
+        report(result, "    expected regs %s\n", golden->regs);
+        report(result, "    got regs      %s\n", state->regs);
+    }
+
+    if (memcmp(golden->screen, state->screen, sizeof(state->screen))) {
+        report(result, "    screen, + lit only now, - lit only before:\n");
+
+        for (row = 0; row < WINDOW_HEIGHT; ++row)
+        {
+            char line[WINDOW_WIDTH + 1];
+
+            for (x = 0; x < WINDOW_WIDTH; ++x)
+            {
+                char before = golden->screen[row][x];
+                char now = state->screen[row][x];
+
+                line[x] = before == now ? now : now == '#' ? '+' : '-';
+            }
+            line[WINDOW_WIDTH] = '\0';
+            report(result, "    %s\n", line);
+        }
+    }
+}
+
+// run the rom under the profile quirks and compare the run against golden.
+// Return its status, reporting what went wrong
+static uint8_t run_quirks(const uint8_t *rom, unsigned long size,
+                          const char *name, const ConformScript *script,
+                          const char *quirks, const char *golden_path,
+                          int update, ConformResult *result)
+{
+    ConformState state, golden;
+    cpu cpuData;
+    static MemMaps mems;
+
+    if (!initialize(&cpuData, &mems, quirks)) {
+        report(result, "    no quirk profile %s\n", quirks);
+        return CONFORM_ERROR;
+    }
+
+    if (size > mems.ram_size - PROG_RAM_START) {
+        report(result, "    %s doesn't fit in the ram of the %s profile\n",
+               name, quirks);
+        return CONFORM_ERROR;
+    }
+    load_rom(rom, size, &mems);
+    cpuData.rng = script->seed ? script->seed : 1;
+
+    capture(&cpuData, &mems, run(&cpuData, &mems, script), &state);
+
+    if (read_golden(golden_path, &golden) && golden.hash == state.hash) {
+        return CONFORM_PASS;
+    }
+
+    if (update) {
+        if (write_golden(golden_path, &state)) {
+            return CONFORM_UPDATED;
+        }
+        report(result, "    %s can't be written\n", golden_path);
+        return CONFORM_ERROR;
+    }
+
+    if (access(golden_path, F_OK) != 0) {
+        report(result, "    no %s, -u writes it\n", golden_path);
+    } else {
+        report(result, "    expected hash %.16llx, got %.16llx\n",
+               (unsigned long long) golden.hash,
+               (unsigned long long) state.hash);
+        diff(&golden, &state, result);
+    }
+    return CONFORM_FAIL;
+}
+
+static void run_test(const char *dir, const char *name, int update,
+                     ConformResult *result)
+{
+    static uint8_t rom[XO_RAM_SIZE - PROG_RAM_START + 1];
+    char path[4096], base[4000];
+    ConformScript script;
+    unsigned int index;
+
+    snprintf(base, sizeof(base), "%s/%.*s", dir,
+             (int) (strrchr(name, '.') - name), name);
+
+    snprintf(path, sizeof(path), "%s.test", base);
+    if (!read_script(path, &script, result)) {
+        result->status = CONFORM_ERROR;
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        report(result, "    %s can't be opened\n", path);
+        result->status = CONFORM_ERROR;
+        return;
+    }
+    unsigned long size = fread(rom, 1, sizeof(rom), file);
+    fclose(file);
+
+    // a rom run under a single profile has a single golden, the others one
+    // per profile. The rom takes the worst status of its runs
+    result->status = CONFORM_PASS;
+    for (index = 0; index < script.quirks_count; ++index)
+    {
+        const char *quirks = script.quirks[index];
+        unsigned int len = result->len;
+
+        if (script.quirks_count == 1) {
+            snprintf(path, sizeof(path), "%s.golden", base);
+        } else {
+            snprintf(path, sizeof(path), "%s.%s.golden", base, quirks);
+            report(result, "  quirks %s\n", quirks);
+        }
+
+        uint8_t status = run_quirks(rom, size, name, &script, quirks, path,
+                                    update, result);
+
+        // only the profiles with something to say are in the report
+        if (status == CONFORM_PASS || status == CONFORM_UPDATED) {
+            result->len = len;
+            result->report[len] = '\0';
+        }
+        if (status > result->status) {
+            result->status = status;
+        }
+    }
+}
+
+//******************************************************************************
+//*                                 workers                                    *
+//******************************************************************************
+
+static int is_rom(const struct dirent *entry)
+{
+    const char *ext = strrchr(entry->d_name, '.');
+
+    return ext != NULL && (!strcasecmp(ext, ".ch8") || !strcasecmp(ext, ".sc8")
+                           || !strcasecmp(ext, ".xo8"));
+}
+
+static void worker(const char *dir, struct dirent **roms, unsigned int count,
+                   int update, ConformShared *shared)
+{
+    unsigned int index;
+
+    while ((index = atomic_fetch_add(&shared->next, 1)) < count)
+    {
+        run_test(dir, roms[index]->d_name, update, &shared->results[index]);
+    }
+}
+
+unsigned int conform(const char *dir, unsigned int workers, int update)
+{
+    static const char *status_names[] = { "LOST", "pass", "FAIL", "updated",
+                                          "ERROR" };
+    unsigned int counts[5] = { 0 };
+    struct dirent **roms;
+    unsigned int index;
+    int count = scandir(dir, &roms, is_rom, alphasort);
+
+    if (count < 0) {
+        perror("chip8: ");
+        return 1;
+    }
+
+    if (count > CONFORM_MAX_TESTS) {
+        fprintf(stderr, "chip8: only the first %u roms of %s are run\n",
+                CONFORM_MAX_TESTS, dir);
+        count = CONFORM_MAX_TESTS;
+    }
+
+    if (!workers) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cores > 0 ? cores : 1;
+    }
+    if (workers > (unsigned int) count) {
+        workers = count ? count : 1;
+    }
+
+    size_t size = sizeof(ConformShared) + count * sizeof(ConformResult);
+    ConformShared *shared = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("chip8: mmap");
+        return 1;
+    }
+
+    // each worker is a process, so that each can have a quirk profile
+    fflush(NULL);
+    for (index = 0; index < workers; ++index)
+    {
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            worker(dir, roms, count, update, shared);
+            _exit(0);
+        } else if (pid == -1) {
+            perror("chip8: fork");
+            break;
+        }
+    }
+
+    // a fork that failed leaves the work to the others, or to this process
+    if (index == 0) {
+        worker(dir, roms, count, update, shared);
+    }
+    while (wait(NULL) > 0);
+
+    for (index = 0; index < (unsigned int) count; ++index)
+    {
+        ConformResult *result = &shared->results[index];
+
+        printf("%s %s\n", status_names[result->status], roms[index]->d_name);
+        fputs(result->report, stdout);
+        ++counts[result->status];
+        free(roms[index]);
+    }
+    free(roms);
+
+    printf("%d roms: %u passed, %u failed, %u updated, %u errors\n", count,
+           counts[CONFORM_PASS], counts[CONFORM_FAIL] + counts[CONFORM_LOST],
+           counts[CONFORM_UPDATED], counts[CONFORM_ERROR]);
+
+    munmap(shared, size);
+    return counts[CONFORM_FAIL] + counts[CONFORM_LOST] + counts[CONFORM_ERROR];
+}
@@ -0,0 +1,60 @@
+/*
+ * Conformance runner. Runs every rom of a directory headless and compares
+ * the machine it ends with against a golden file, so a change to the
+ * interpreter that changes what roms do doesn't go unnoticed.
+ *
+ * A rom name.ch8 (or .sc8, .xo8) can come with name.test, a script of
+ * lines like these:
+ *
+ *   # a comment
+ *   quirks schip          the profile to run with, see initialize(). With
+ *                         several, like "quirks vip schip", the rom runs
+ *                         under each of them
+ *   frames 120            frames to run, CONFORM_DEFAULT_FRAMES by default
+ *   cycles 5000           or opcodes to run, the timers ticking every
+ *                         CYCLES_PER_TICK of them
+ *   seed 7                seed of the random numbers, 1 by default
+ *   key 10 5 down         at the start of frame 10, press key 5
+ *   key 12 5 up           and release it at frame 12
+ *
+ * The run ends there, or when the rom exits or faults, and its result is
+ * compared against name.golden, or name.<profile>.golden for each profile
+ * of a rom run under several:
+ *
+ *   hash <16 hex digits>  hash_bytes() of the screen, registers, timers,
+ *                         stack and fault
+ *   regs <V0> ... <VF> i <I> pc <pc> sp <sp> dt <DT> st <ST> fault <fault>
+ *   screen
+ *   32 rows of 64 '#' and '.', the screen as screen_lores() sees it
+ *
+ * Only the hash decides, the rest is there to show what changed: on a
+ * mismatch the registers are printed and the screen is rendered as a diff,
+ * '+' being the pixels that are lit now and weren't, '-' the other way
+ * around. With -u, the goldens that are missing or don't match are written
+ * from the run instead.
+ *
+ * The roms run in worker processes, as many as there are cores unless told
+ * otherwise, each setting its own quirk profile. The report is printed in
+ * the order of the roms, whatever order they finish in
+ * */
+#ifndef CONFORM_H
+#define CONFORM_H
+
+#define CONFORM_DEFAULT_FRAMES 60
+
+// most roms in a directory, and most key events in a script
+#define CONFORM_MAX_TESTS 4096
+#define CONFORM_MAX_KEYS 256
+
+// most profiles a rom runs under
+#define CONFORM_MAX_QUIRKS 8
+
+// bytes of the report of each rom
+#define CONFORM_REPORT_SIZE 8192
+
+// run the roms of dir on workers processes, 0 for one per core. With
+// update, write the goldens instead of failing. Return the amount of roms
+// that failed
+unsigned int conform(const char *dir, unsigned int workers, int update);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ * Control of a running emulator. See control.h
+ * */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "control.h"
+
+#define STATE_MAGIC "CH8STATE"
+
+ControlQueue control_ui;
+
+// fed by the thread of the socket
+static ControlQueue control_socket;
+static int listen_fd = -1;
+static const char *socket_path;
+
+//******************************************************************************
+//*                                 queues                                     *
+//******************************************************************************
+
+int control_push(ControlQueue *queue, ControlCommand *command)
+{
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    struct timespec now;
+
+    if (head - tail == CONTROL_QUEUE_SIZE) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    command->queued_ns = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+
+    queue->commands[head & (CONTROL_QUEUE_SIZE - 1)] = *command;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 1;
+}
+
+int control_pop(ControlQueue *queue, ControlCommand *command)
+{
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    if (head == tail) {
+        return 0;
+    }
+
+    *command = queue->commands[tail & (CONTROL_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+int control_next(ControlCommand *command)
+{
+    return control_pop(&control_ui, command)
+           || control_pop(&control_socket, command);
+}
+
+//******************************************************************************
+//*                                 socket                                     *
+//******************************************************************************
+
+static void unlink_socket()
+{
+    unlink(socket_path);
+}
+
+// fill command from a line of the socket. Return why it can't, NULL if it can
+static const char *parse(char *line, ControlCommand *command)
+{
+    static const struct
+    {
+        const char *name;
+        uint8_t type;
+        int takes_path;
+    } names[] =
+    {
+        { "pause",  CONTROL_PAUSE,    0 },
+        { "resume", CONTROL_RESUME,   0 },
+        { "step",   CONTROL_STEP,     0 },
+        { "clock",  CONTROL_CLOCK,    0 },
+        { "save",   CONTROL_SAVE,     1 },
+        { "load",   CONTROL_LOAD,     1 },
+        { "rom",    CONTROL_ROM,      1 },
+        { "quirks", CONTROL_QUIRKS,   1 },
+        { "quit",   CONTROL_SHUTDOWN, 0 }
+    };
+    unsigned int index;
+    char *arg, *end;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    arg = line + strcspn(line, " ");
+    if (*arg) {
+        *arg++ = '\0';
+        arg += strspn(arg, " ");
+    }
+
+    for (index = 0; index < sizeof(names) / sizeof(names[0]); ++index)
+    {
+        if (!strcmp(line, names[index].name)) {
+            break;
+        }
+    }
+    if (index == sizeof(names) / sizeof(names[0])) {
+        return "unknown command";
+    }
+
+    memset(command, 0, sizeof(*command));
+    command->type = names[index].type;
+
+    if (names[index].takes_path) {
+        if (!*arg) {
+            return "no argument";
+        }
+        if (strlen(arg) >= sizeof(command->path)) {
+            return "argument too long";
+        }
+        strcpy(command->path, arg);
+
+        // a bad profile would only fail the roms loaded after it
+        if (command->type == CONTROL_QUIRKS && !quirks_exist(arg)) {
+            return "no quirk profile";
+        }
+    } else if (command->type == CONTROL_STEP
+               || command->type == CONTROL_CLOCK) {
+        if (!*arg && command->type == CONTROL_STEP) {
+            command->arg = 1;
+            return NULL;
+        }
+
+        command->arg = strtoul(arg, &end, 0);
+        if (end == arg || *end) {
+            return "not a number";
+        }
+    }
+
+    return NULL;
+}
+
+// answer the lines of a client until it hangs up
+static void serve(int sock)
+{
+    char line[CONTROL_LINE_SIZE], answer[64];
+    ControlCommand command;
+    FILE *in = fdopen(sock, "r");
+
+    if (in == NULL) {
+        close(sock);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        const char *error = parse(line, &command);
+
+        if (error != NULL) {
+            snprintf(answer, sizeof(answer), "error: %s\n", error);
+        } else {
+            snprintf(answer, sizeof(answer), "%s\n",
+                     control_push(&control_socket, &command) ? "ok" : "busy");
+        }
+
+        if (write(sock, answer, strlen(answer)) == -1) {
+            break;
+        }
+    }
+
+    fclose(in);
+}
+
+static void *control_thread(void *arg)
+{
+    int sock;
+
+    (void) arg;
+
+    for (;;)
+    {
+        sock = accept(listen_fd, NULL, NULL);
+
+        if (sock == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("chip8: control socket");
+            return NULL;
+        }
+
+        serve(sock);
+    }
+}
+
+int control_listen(const char *path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    pthread_t thread;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "chip8: socket path too long: %s\n", path);
+        return 0;
+    }
+    strcpy(address.sun_path, path);
+    socket_path = path;
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) {
+        perror("chip8: socket");
+        return 0;
+    }
+
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) == -1
+        || listen(listen_fd, 1) == -1) {
+        perror("chip8: ");
+        close(listen_fd);
+        listen_fd = -1;
+        return 0;
+    }
+    atexit(unlink_socket);
+
+    if (pthread_create(&thread, NULL, control_thread, NULL) != 0) {
+        fprintf(stderr, "chip8: couldn't start the control thread\n");
+        return 0;
+    }
+    pthread_detach(thread);
+
+    return 1;
+}
+
+int control_active()
+{
+    return listen_fd != -1;
+}
+
+//******************************************************************************
+//*                                 states                                     *
+//******************************************************************************
+
+static void state_header(StateHeader *header, const MemMaps *mems,
+                         unsigned int game_size)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, STATE_MAGIC, sizeof(header->magic));
+    header->version = STATE_VERSION;
+    header->cpu_size = sizeof(cpu);
+    header->mems_size = sizeof(MemMaps);
+    header->game_size = game_size;
+    strncpy(header->quirks, machine_quirks(mems), sizeof(header->quirks) - 1);
+}
+
+int state_save(const char *path, const cpu *cpuData, const MemMaps *mems,
+               unsigned int game_size)
+{
+    StateHeader header;
+    FILE *out = fopen(path, "wb");
+
+    if (out == NULL) {
+        fprintf(stderr, "chip8: can't write %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    state_header(&header, mems, game_size);
+    if (fwrite(&header, sizeof(header), 1, out) != 1
+        || fwrite(cpuData, sizeof(*cpuData), 1, out) != 1
+        || fwrite(mems, sizeof(*mems), 1, out) != 1) {
+        fprintf(stderr, "chip8: can't write %s: %s\n", path, strerror(errno));
+        fclose(out);
+        return 0;
+    }
+
+    return fclose(out) == 0;
+}
+
+int state_load(const char *path, cpu *cpuData, MemMaps *mems,
+               unsigned int *game_size)
+{
+    static cpu state_cpu;
+    static MemMaps state_mems;
+    StateHeader header, expected;
+    FILE *in = fopen(path, "rb");
+
+    if (in == NULL) {
+        fprintf(stderr, "chip8: can't read %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    if (fread(&header, sizeof(header), 1, in) != 1
+        || fread(&state_cpu, sizeof(state_cpu), 1, in) != 1
+        || fread(&state_mems, sizeof(state_mems), 1, in) != 1) {
+        fprintf(stderr, "chip8: %s is not a state\n", path);
+        fclose(in);
+        return 0;
+    }
+    fclose(in);
+
+    // the game size is the only field that can change between states
+    state_header(&expected, mems, header.game_size);
+    if (memcmp(&header, &expected, sizeof(header))) {
+        fprintf(stderr, "chip8: %s is not a state of this build and the %s "
+                "profile\n", path, machine_quirks(mems));
+        return 0;
+    }
+
+    // the watchpoints belong to the debugger, not to the machine
+    state_mems.watch = mems->watch;
+    state_mems.watch_read = mems->watch_read;
+    state_mems.watch_write = mems->watch_write;
+    state_mems.seen = mems->seen;
+
+    *cpuData = state_cpu;
+    *mems = state_mems;
+    *game_size = header.game_size;
+    return 1;
+}
@@ -0,0 +1,128 @@
+/*
+ * Control of a running emulator. Commands are queued by the frontend, from
+ * set_keys(), and by a thread serving a Unix control socket, and the
+ * emulation loop drains them at the start of every frame. Each producer has
+ * a single producer, single consumer queue of its own, so pushing and
+ * popping take no locks, and a frame with nothing queued costs the loop a
+ * load of each queue. The opcodes never look at them.
+ *
+ * The socket is SOCK_STREAM and takes a command per line:
+ *
+ *   pause                 stop running opcodes and ticking the timers
+ *   resume
+ *   step [n]              pause, then run n opcodes, 1 by default, at the
+ *                         pace of the clock
+ *   clock <hz>            opcodes per second, 0 for the one of the profile
+ *   save <path>           write the state of the machine to path
+ *   load <path>           bring the machine back to the state in path
+ *   rom <path>            reset the machine and load another rom, running
+ *                         it even if the last one was paused
+ *   quirks <name>         the quirk profile of the roms loaded from then on
+ *   quit                  end the emulation, as closing the window does
+ *
+ * and answers each line with "ok" once the command is queued, "busy" if the
+ * queue is full, or "error: " and why the line wasn't understood. Paths are
+ * relative to the directory the emulator runs in. What happens when the
+ * command runs, a state that can't be loaded say, is reported on stderr
+ *
+ * With the socket, the emulator is in warm start mode: it can start without
+ * a rom, paused until one is loaded, and a rom that ends or faults pauses
+ * the machine instead of ending the process, so the window, renderer and
+ * audio device outlive the roms. A rom loaded with "rom" is reset with
+ * initialize() like a cold start, and the time from the command to its
+ * first present is reported on stderr, as is the time from the start of
+ * the process to the first present
+ *
+ * A state file is a StateHeader, then the cpu and the MemMaps of the
+ * machine as they are in memory, so they are only good for the same build
+ * on the same host, and with the same quirk profile
+ * */
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+// commands a queue holds, a power of 2
+#define CONTROL_QUEUE_SIZE 16
+
+// bytes of a path in a command, and of a line of the socket
+#define CONTROL_PATH_SIZE 1024
+#define CONTROL_LINE_SIZE (CONTROL_PATH_SIZE + 16)
+
+#define STATE_VERSION 1
+
+enum ControlType
+{
+    CONTROL_PAUSE,
+    CONTROL_RESUME,
+    CONTROL_STEP,
+    CONTROL_CLOCK,
+    CONTROL_SAVE,
+    CONTROL_LOAD,
+    CONTROL_ROM,
+    CONTROL_QUIRKS,
+    CONTROL_SHUTDOWN
+};
+
+typedef struct ControlCommand
+{
+    uint8_t type;                // ControlType
+    uint32_t arg;                // opcodes to step, or the clock rate
+    char path[CONTROL_PATH_SIZE];    // or the name of a quirk profile
+    uint64_t queued_ns;          // CLOCK_MONOTONIC of control_push()
+} ControlCommand;
+
+// only the producer writes to head and the commands, only the emulation
+// loop writes to tail
+typedef struct ControlQueue
+{
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+    ControlCommand commands[CONTROL_QUEUE_SIZE];
+} ControlQueue;
+
+typedef struct StateHeader
+{
+    char magic[8];               // "CH8STATE"
+    uint32_t version;            // STATE_VERSION
+    uint32_t cpu_size;           // sizeof(cpu)
+    uint32_t mems_size;          // sizeof(MemMaps)
+    uint32_t game_size;          // bytes of the rom that was running
+    char quirks[16];             // the quirk profile, see machine_quirks()
+} StateHeader;
+
+// the queue of the frontend
+extern ControlQueue control_ui;
+
+// queue command, setting when it was queued. Return 0 if the queue is full
+int control_push(ControlQueue *queue, ControlCommand *command);
+
+// take the oldest command of the queue. Return 0 if it's empty
+int control_pop(ControlQueue *queue, ControlCommand *command);
+
+// take the oldest command of the frontend, or else of the socket. Return 0
+// if there's none
+int control_next(ControlCommand *command);
+
+// serve the control socket at path on a thread of its own. Return 0 if it
+// can't be created
+int control_listen(const char *path);
+
+// whether the control socket is served, and so the emulator is in warm
+// start mode
+int control_active();
+
+// write the machine and the size of its rom to path. Return 0 after saying
+// why if it can't
+int state_save(const char *path, const cpu *cpuData, const MemMaps *mems,
+               unsigned int game_size);
+
+// bring the machine, and the size of its rom, back to the state in path.
+// The watchpoints of the debugger are kept. Return 0, without touching the
+// machine, after saying why if the file isn't a state of this build
+int state_load(const char *path, cpu *cpuData, MemMaps *mems,
+               unsigned int *game_size);
+
+#endif
@@ -0,0 +1,466 @@
+/*
+ * Rom corpus for the batch tools. See corpus.h
+ * */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "corpus.h"
+#include "opcodes.h"
+#include "romcache.h"
+
+#define TAR_BLOCK 512
+
+Corpus *corpus_open()
+{
+    return calloc(1, sizeof(Corpus));
+}
+
+//******************************************************************************
+//*                                 catalog                                    *
+//******************************************************************************
+
+// put rom number index in the table, which has room for it
+static void index_insert(Corpus *corpus, unsigned int index)
+{
+    unsigned int mask = corpus->index_size - 1;
+    unsigned int slot = corpus->roms[index].hash & mask;
+
+    while (corpus->index[slot] != -1)
+    {
+        slot = (slot + 1) & mask;
+    }
+    corpus->index[slot] = index;
+}
+
+// keep the table at most half full, so the searches stay short
+static int index_grow(Corpus *corpus)
+{
+    unsigned int size = corpus->index_size ? corpus->index_size * 2 : 1024;
+    unsigned int index;
+    int32_t *table = malloc(size * sizeof(*table));
+
+    if (table == NULL) {
+        return 0;
+    }
+
+    free(corpus->index);
+    corpus->index = table;
+    corpus->index_size = size;
+    memset(table, -1, size * sizeof(*table));
+
+    for (index = 0; index < corpus->count; ++index)
+    {
+        if (corpus->roms[index].error == NULL
+            && corpus->roms[index].original == -1) {
+            index_insert(corpus, index);
+        }
+    }
+
+    return 1;
+}
+
+int corpus_find(const Corpus *corpus, uint64_t hash)
+{
+    unsigned int mask = corpus->index_size - 1;
+    unsigned int slot;
+
+    if (corpus->index == NULL) {
+        return -1;
+    }
+
+    for (slot = hash & mask; corpus->index[slot] != -1;
+         slot = (slot + 1) & mask)
+    {
+        if (corpus->roms[corpus->index[slot]].hash == hash) {
+            return corpus->index[slot];
+        }
+    }
+
+    return -1;
+}
+
+// the first rom with the image of rom, -1 if it's the first. Images with the
+// same hash are compared, so a collision doesn't make a copy
+static int32_t find_original(const Corpus *corpus, const CorpusRom *rom)
+{
+    unsigned int mask = corpus->index_size - 1;
+    unsigned int slot;
+
+    for (slot = rom->hash & mask; corpus->index[slot] != -1;
+         slot = (slot + 1) & mask)
+    {
+        const CorpusRom *other = &corpus->roms[corpus->index[slot]];
+
+        if (other->hash == rom->hash && other->size == rom->size
+            && !memcmp(other->data, rom->data, rom->size)) {
+            return corpus->index[slot];
+        }
+    }
+
+    return -1;
+}
+
+// suggest the machine the rom was written for
+static void suggest(CorpusRom *rom)
+{
+    // only used by this thread, and too big for the stack
+    static cpu cpuData;
+    static MemMaps mems;
+    const char *ext = strrchr(rom->name, '.');
+    uint32_t addr;
+
+    rom->quirks = NULL;
+
+    if ((ext != NULL && !strcasecmp(ext, ".xo8"))
+        || rom->size > RAM_SIZE - PROG_RAM_START) {
+        rom->quirks = "xochip";
+    } else if (ext != NULL && !strcasecmp(ext, ".sc8")) {
+        rom->quirks = "schip";
+    } else {
+        // follow the code, as the data may look like any opcode, with the
+        // tables of the XO-CHIP, which has every opcode there is
+        initialize(&cpuData, &mems, "xochip");
+        load_rom(rom->data, rom->size, &mems);
+
+        RomMap *map = romcache_analyse(&mems);
+
+        for (addr = 0; map != NULL && addr < map->ram_size; ++addr)
+        {
+            if (!(map->flags[addr] & ROMMAP_CODE)) {
+                continue;
+            }
+
+            opfunc handler = opinfo[romcache_classes(map)[addr]].handler;
+
+            if (handler == long_i || handler == save_range
+                || handler == load_range || handler == select_planes
+                || handler == audio_pattern || handler == set_pitch) {
+                rom->quirks = "xochip";
+                break;
+            }
+
+            if (handler == hires || handler == lores || handler == exit_rom
+                || handler == scroll_down || handler == scroll_up
+                || handler == scroll_left || handler == scroll_right
+                || handler == load_big_char_addr || handler == save_flags
+                || handler == load_flags) {
+                rom->quirks = "schip";
+            }
+        }
+        free(map);
+    }
+
+    rom->clock_hz = quirks_clock_hz(rom->quirks);
+}
+
+// add a rom to the catalog, error saying why it can't be loaded. The name
+// is copied
+static void add_rom(Corpus *corpus, const char *name, const uint8_t *data,
+                    size_t size, const char *error)
+{
+    CorpusRom *rom;
+
+    if (corpus->count == corpus->capacity) {
+        unsigned int capacity = corpus->capacity ? corpus->capacity * 2 : 256;
+        CorpusRom *roms = realloc(corpus->roms, capacity * sizeof(*roms));
+
+        if (roms == NULL) {
+            fprintf(stderr, "chip8: no memory for %s\n", name);
+            return;
+        }
+        corpus->roms = roms;
+        corpus->capacity = capacity;
+    }
+
+    if ((corpus->unique + 1) * 2 > corpus->index_size
+        && !index_grow(corpus)) {
+        fprintf(stderr, "chip8: no memory for %s\n", name);
+        return;
+    }
+
+    rom = &corpus->roms[corpus->count];
+    memset(rom, 0, sizeof(*rom));
+    rom->name = strdup(name);
+    rom->data = data;
+    rom->size = size;
+    rom->original = -1;
+    rom->error = error;
+
+    if (rom->name == NULL) {
+        return;
+    }
+
+    if (error == NULL && size == 0) {
+        rom->error = "is empty";
+    } else if (error == NULL && size > CORPUS_MAX_ROM) {
+        rom->error = "doesn't fit in ram";
+    }
+    ++corpus->count;
+
+    if (rom->error != NULL) {
+        return;
+    }
+
+    rom->hash = hash_bytes(HASH_SEED, data, size);
+    if ((rom->original = find_original(corpus, rom)) != -1) {
+        rom->quirks = corpus->roms[rom->original].quirks;
+        rom->clock_hz = corpus->roms[rom->original].clock_hz;
+        return;
+    }
+
+    suggest(rom);
+    index_insert(corpus, corpus->count - 1);
+    ++corpus->unique;
+}
+
+//******************************************************************************
+//*                                  files                                     *
+//******************************************************************************
+
+// map the whole file read-only, remembering to unmap it. Return NULL, with
+// error set, if it can't be done, or if it's empty
+static const uint8_t *map(Corpus *corpus, int fd, size_t *size,
+                          const char **error)
+{
+    struct stat info;
+
+    if (fstat(fd, &info) == -1) {
+        *error = "can't be read";
+        return NULL;
+    }
+
+    *size = info.st_size;
+    if (*size == 0) {
+        *error = "is empty";
+        return NULL;
+    }
+
+    if (corpus->mappings_count == corpus->mappings_capacity) {
+        unsigned int capacity = corpus->mappings_capacity
+                                ? corpus->mappings_capacity * 2 : 256;
+        CorpusMapping *mappings = realloc(corpus->mappings,
+                                          capacity * sizeof(*mappings));
+
+        if (mappings == NULL) {
+            *error = "can't be mapped";
+            return NULL;
+        }
+        corpus->mappings = mappings;
+        corpus->mappings_capacity = capacity;
+    }
+
+    void *addr = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        *error = "can't be mapped";
+        return NULL;
+    }
+
+    corpus->mappings[corpus->mappings_count].addr = addr;
+    corpus->mappings[corpus->mappings_count++].size = *size;
+    return addr;
+}
+
+static int is_tar(const uint8_t *data, size_t size)
+{
+    return size >= 2 * TAR_BLOCK && !memcmp(data + 257, "ustar", 5);
+}
+
+static uint64_t tar_number(const uint8_t *field, unsigned int len)
+{
+    uint64_t value = 0;
+
+    for (; len && (*field == ' ' || *field == '0'); --len, ++field);
+    for (; len && *field >= '0' && *field <= '7'; --len, ++field)
+    {
+        value = value * 8 + *field - '0';
+    }
+
+    return value;
+}
+
+// add the regular files of the tar archive at path, mapped at data
+static unsigned int add_tar(Corpus *corpus, const char *path,
+                            const uint8_t *data, size_t size)
+{
+    char name[4096], long_name[1024] = "";
+    unsigned int added = 0;
+    size_t offset = 0;
+
+    while (offset + TAR_BLOCK <= size && data[offset])
+    {
+        const uint8_t *header = data + offset;
+        uint64_t file_size = tar_number(header + 124, 12);
+        const uint8_t *file = header + TAR_BLOCK;
+
+        offset += TAR_BLOCK + (file_size + TAR_BLOCK - 1) / TAR_BLOCK
+                  * TAR_BLOCK;
+        if (offset > size) {
+            add_rom(corpus, path, NULL, 0, "is a truncated archive");
+            return added + 1;
+        }
+
+        // GNU tar stores the names that don't fit in the header before it
+        if (header[156] == 'L') {
+            snprintf(long_name, sizeof(long_name), "%.*s",
+                     (int) (file_size < sizeof(long_name)
+                            ? file_size : sizeof(long_name) - 1), file);
+            continue;
+        }
+
+        if (*long_name) {
+            snprintf(name, sizeof(name), "%s:%s", path, long_name);
+        } else if (header[345]) {
+            snprintf(name, sizeof(name), "%s:%.155s/%.100s", path,
+                     header + 345, header);
+        } else {
+            snprintf(name, sizeof(name), "%s:%.100s", path, header);
+        }
+        *long_name = '\0';
+
+        if (header[156] == '0' || header[156] == '\0') {
+            add_rom(corpus, name, file, file_size, NULL);
+            ++added;
+        }
+    }
+
+    return added;
+}
+
+static unsigned int add_file(Corpus *corpus, const char *path)
+{
+    const char *error = NULL;
+    const uint8_t *data;
+    size_t size = 0;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) {
+        add_rom(corpus, path, NULL, 0, "can't be opened");
+        return 1;
+    }
+
+    data = map(corpus, fd, &size, &error);
+    close(fd);
+
+    if (data != NULL && is_tar(data, size)) {
+        return add_tar(corpus, path, data, size);
+    }
+
+    add_rom(corpus, path, data, data != NULL ? size : 0, error);
+    return 1;
+}
+
+static unsigned int add_dir(Corpus *corpus, const char *path)
+{
+    struct dirent **entries;
+    char name[4096];
+    int count = scandir(path, &entries, NULL, alphasort);
+    unsigned int added = 0;
+    int entry;
+
+    if (count == -1) {
+        add_rom(corpus, path, NULL, 0, "can't be listed");
+        return 1;
+    }
+
+    // sorted, so the first of the copies is always the same one
+    for (entry = 0; entry < count; ++entry)
+    {
+        if (entries[entry]->d_name[0] != '.'
+            && snprintf(name, sizeof(name), "%s/%s", path,
+                        entries[entry]->d_name) < (int) sizeof(name)) {
+            added += corpus_add(corpus, name);
+        }
+        free(entries[entry]);
+    }
+    free(entries);
+
+    return added;
+}
+
+unsigned int corpus_add(Corpus *corpus, const char *path)
+{
+    struct stat info;
+
+    if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+        return add_dir(corpus, path);
+    }
+
+    return add_file(corpus, path);
+}
+
+//******************************************************************************
+//*                                  usage                                     *
+//******************************************************************************
+
+unsigned int corpus_load(const Corpus *corpus, unsigned int index,
+                         MemMaps *mems)
+{
+    const CorpusRom *rom = &corpus->roms[index];
+
+    if (rom->error != NULL) {
+        fprintf(stderr, "chip8: %s %s\n", rom->name, rom->error);
+        return 0;
+    }
+
+    if (rom->size > mems->ram_size - PROG_RAM_START) {
+        fprintf(stderr, "chip8: %s doesn't fit in the ram of the %s profile\n",
+                rom->name, machine_quirks(mems));
+        return 0;
+    }
+
+    return load_rom(rom->data, rom->size, mems);
+}
+
+void corpus_print(const Corpus *corpus, FILE *out)
+{
+    unsigned int index;
+
+    for (index = 0; index < corpus->count; ++index)
+    {
+        const CorpusRom *rom = &corpus->roms[index];
+
+        if (rom->error != NULL) {
+            fprintf(out, "%-16s %5s %-7s %5s %s %s\n", "-", "-", "-", "-",
+                    rom->name, rom->error);
+            continue;
+        }
+
+        fprintf(out, "%.16llx %5u %-7s %5u %s", (unsigned long long) rom->hash,
+                rom->size, rom->quirks != NULL ? rom->quirks : "default",
+                rom->clock_hz, rom->name);
+        if (rom->original != -1) {
+            fprintf(out, " copy of %s", corpus->roms[rom->original].name);
+        }
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "%u roms, %u unique\n", corpus->count, corpus->unique);
+}
+
+void corpus_close(Corpus *corpus)
+{
+    unsigned int index;
+
+    for (index = 0; index < corpus->mappings_count; ++index)
+    {
+        munmap(corpus->mappings[index].addr, corpus->mappings[index].size);
+    }
+
+    for (index = 0; index < corpus->count; ++index)
+    {
+        free(corpus->roms[index].name);
+    }
+
+    free(corpus->mappings);
+    free(corpus->roms);
+    free(corpus->index);
+    free(corpus);
+}
@@ -0,0 +1,85 @@
+/*
+ * Rom corpus for the batch tools. A corpus is built from any mix of roms,
+ * directories of them, searched recursively, and tar archives of them. The
+ * files and archives are memory mapped, never read, and the machines load
+ * the roms by copying them straight from the mappings, so going over tens
+ * of thousands of roms costs a mmap per file or archive.
+ *
+ * Every rom is hashed with hash_bytes() into a catalog that finds a rom by
+ * its hash, and the images seen before are marked as copies of the first
+ * one, so batches can run each image once. The catalog also suggests the
+ * quirk profile and clock rate of each rom: XO-CHIP if its extension says
+ * so or it doesn't fit in 4 KB, SUPER-CHIP for the .sc8 ones, and otherwise
+ * the newest machine whose opcodes are found following its code.
+ *
+ * A rom that can't be used doesn't stop the batch: it stays in the catalog
+ * with the reason, and corpus_load() reports it
+ * */
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chip8.h"
+
+// the most a rom can have, that of the XO-CHIP
+#define CORPUS_MAX_ROM (XO_RAM_SIZE - PROG_RAM_START)
+
+typedef struct CorpusRom
+{
+    char *name;                  // path, inside the archive for its roms
+    const uint8_t *data;         // image in the mapping
+    uint32_t size;
+    uint64_t hash;
+    int32_t original;            // index of the first rom with the same
+                                 // image, -1 if this is the first
+    const char *quirks;          // suggested profile, NULL for the default
+    unsigned int clock_hz;       // and its clock rate
+    const char *error;           // why it can't be loaded, NULL if it can
+} CorpusRom;
+
+typedef struct CorpusMapping
+{
+    void *addr;
+    size_t size;
+} CorpusMapping;
+
+typedef struct Corpus
+{
+    CorpusRom *roms;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned int unique;         // roms loadable that aren't copies
+
+    int32_t *index;              // open addressing table of the unique
+    unsigned int index_size;     // roms by hash, -1 for the empty slots
+
+    CorpusMapping *mappings;     // to unmap when the corpus is closed
+    unsigned int mappings_count;
+    unsigned int mappings_capacity;
+} Corpus;
+
+// an empty corpus. Return NULL if there's no memory for it
+Corpus *corpus_open();
+
+// add the rom, directory or tar archive at path. Return the amount of roms
+// added, those that can't be loaded included
+unsigned int corpus_add(Corpus *corpus, const char *path);
+
+// the index of the first rom with the image of hash, -1 if there's none
+int corpus_find(const Corpus *corpus, uint64_t hash);
+
+// load rom number index into the ram of mems, initialized already. Return
+// the amount of bytes loaded, 0 after printing why if it can't be loaded
+unsigned int corpus_load(const Corpus *corpus, unsigned int index,
+                         MemMaps *mems);
+
+// print a line per rom: hash, size, suggested profile and clock, name, and
+// what's wrong with it or the rom it's a copy of
+void corpus_print(const Corpus *corpus, FILE *out);
+
+// unmap everything and free the corpus
+void corpus_close(Corpus *corpus);
+
+#endif
@@ -0,0 +1,672 @@
+/*
+ * Terminal debugger. See debug.h
+ * */
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "debug.h"
+#include "opcodes.h"
+#include "romcache.h"
+
+// what to do before the next opcode
+enum DebugModes
+{
+    DEBUG_RUN,                   // stop only at breakpoints
+    DEBUG_STOP,                  // stop right away
+    DEBUG_STEP,                  // stop after steps opcodes
+    DEBUG_UNTIL,                 // stop at until_pc with the stack at until_sp
+    DEBUG_FINISH                 // stop once the stack is below until_sp
+};
+
+volatile sig_atomic_t debug_armed = 0;
+
+static int enabled = 0;
+static volatile sig_atomic_t mode = DEBUG_RUN;
+static unsigned long steps;
+static uint16_t until_pc, until_sp;
+
+static uint64_t breakpoints[DEBUG_BREAKPOINT_WORDS];
+static unsigned int breakpoints_count;
+
+// a range of ram watched for reads, writes or both
+typedef struct Watchpoint
+{
+    uint32_t addr;
+    uint32_t len;
+    uint8_t kind;                // WATCH_READ and/or WATCH_WRITE
+} Watchpoint;
+
+static Watchpoint watchpoints[DEBUG_MAX_WATCHPOINTS];
+static unsigned int watchpoints_count;
+
+// the WATCH_* bits of each address, what step() looks at through MemMaps.
+// It covers the ram of the XO-CHIP, whatever the profile
+static uint8_t watch_map[XO_RAM_SIZE];
+
+// comparisons of a condition, COND_CHANGE stops whenever the value changes
+enum ConditionOps
+{
+    COND_CHANGE, COND_EQ, COND_NE, COND_LT, COND_GT, COND_LE, COND_GE,
+    COND_COUNT
+};
+
+static const char *condition_ops[COND_COUNT] = 
+{
+    "", "==", "!=", "<", ">", "<=", ">="
+};
+
+// stop when a register, or I, starts to meet a condition
+typedef struct Condition
+{
+    uint8_t reg;                 // V0-VF, or DEBUG_REG_I
+    uint8_t op;
+    uint16_t value;
+    uint16_t last;               // value for COND_CHANGE, result otherwise
+} Condition;
+
+static Condition conditions[DEBUG_MAX_CONDITIONS];
+static unsigned int conditions_count;
+
+static char last_command[256];
+
+// the main loop only has to go through debug_cycles() when there's 
+// something to stop at
+static void rearm()
+{
+    debug_armed = mode != DEBUG_RUN || breakpoints_count || conditions_count;
+}
+
+static void interrupt(int signal)
+{
+    (void) signal;
+
+    mode = DEBUG_STOP;
+    debug_armed = 1;
+}
+
+int debug_enabled()
+{
+    return enabled;
+}
+
+void debug_init()
+{
+    struct sigaction action = { .sa_handler = interrupt, 
+                                .sa_flags = SA_RESTART };
+
+    // Ctrl-C stops the game instead of killing it
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+
+    enabled = 1;
+    mode = DEBUG_STOP;
+    rearm();
+}
+
+static int breakpoint(uint16_t addr)
+{
+    // the 64 KB of the XO-CHIP can't have breakpoints past the first 4
+    if (addr >= DEBUG_BREAKPOINT_WORDS * 64) {
+        return 0;
+    }
+
+    return (breakpoints[addr >> 6] >> (addr & 63)) & 1;
+}
+
+static void set_breakpoint(uint16_t addr, int set)
+{
+    if (breakpoint(addr) == set) {
+        return;
+    }
+
+    breakpoints[addr >> 6] ^= (uint64_t) 1 << (addr & 63);
+    breakpoints_count += set ? 1 : -1;
+}
+
+// rebuild the watch map and the bitmaps of watched blocks from the list 
+// of watchpoints. Those past the ram of the machine, set with a profile
+// that had more, are kept but can't fire
+static void update_watch(MemMaps *mem)
+{
+    unsigned int index, addr;
+
+    memset(watch_map, 0, sizeof(watch_map));
+    mem->watch_read = 0;
+    mem->watch_write = 0;
+
+    for (index = 0; index < watchpoints_count; ++index)
+    {
+        Watchpoint *watch = &watchpoints[index];
+
+        if (watch->addr + watch->len > mem->ram_size) {
+            continue;
+        }
+
+        for (addr = watch->addr; addr < watch->addr + watch->len; ++addr)
+        {
+            watch_map[addr] |= watch->kind;
+        }
+
+        if (watch->kind & WATCH_READ) {
+            mem->watch_read |= ram_blocks(mem, watch->addr, watch->len);
+        }
+        if (watch->kind & WATCH_WRITE) {
+            mem->watch_write |= ram_blocks(mem, watch->addr, watch->len);
+        }
+    }
+
+    mem->watch = watchpoints_count ? watch_map : NULL;
+}
+
+void debug_rearm(MemMaps *mem)
+{
+    update_watch(mem);
+}
+
+static uint16_t register_value(cpu *cpuData, uint8_t reg)
+{
+    return reg == DEBUG_REG_I ? cpuData->i : cpuData->regs[reg];
+}
+
+static uint16_t evaluate(cpu *cpuData, Condition *condition)
+{
+    uint16_t value = register_value(cpuData, condition->reg);
+
+    switch (condition->op)
+    {
+        case COND_EQ:
+            return value == condition->value;
+        case COND_NE:
+            return value != condition->value;
+        case COND_LT:
+            return value < condition->value;
+        case COND_GT:
+            return value > condition->value;
+        case COND_LE:
+            return value <= condition->value;
+        case COND_GE:
+            return value >= condition->value;
+        default:
+            return value;
+    }
+}
+
+// return the first condition that started to be met since the last opcode, 
+// or NULL. Changes are stops of their own, comparisons only stop when they 
+// go from false to true
+static Condition *condition_met(cpu *cpuData)
+{
+    Condition *met = NULL;
+    unsigned int index;
+    uint16_t result;
+
+    for (index = 0; index < conditions_count; ++index)
+    {
+        result = evaluate(cpuData, &conditions[index]);
+
+        if (result != conditions[index].last 
+            && (conditions[index].op == COND_CHANGE || result) 
+            && met == NULL) {
+            met = &conditions[index];
+        }
+        conditions[index].last = result;
+    }
+
+    return met;
+}
+
+//******************************************************************************
+//*                                 dumps                                      *
+//******************************************************************************
+
+static uint16_t opcode_at(MemMaps *mem, uint16_t addr)
+{
+    return addr < RAM_END ? (mem->ram[addr] << 8) | mem->ram[addr + 1] : 0;
+}
+
+// what the analysis of the rom found at addr, 0 when there's no map
+static uint8_t map_flags(uint16_t addr)
+{
+    const RomMap *map = romcache_get();
+
+    return map != NULL && addr < map->ram_size ? map->flags[addr] : 0;
+}
+
+static void print_opcode(MemMaps *mem, uint16_t addr, uint16_t pc)
+{
+    char text[32];
+    uint16_t opcode = opcode_at(mem, addr);
+    uint8_t flags = map_flags(addr);
+
+    // I points there and no code path reaches it, it's not worth decoding
+    if ((flags & (ROMMAP_DATA | ROMMAP_CODE)) == ROMMAP_DATA) {
+        snprintf(text, sizeof(text), "data");
+    } else {
+        disassemble(mem, opcode, text, sizeof(text));
+    }
+    printf("%c%c %#.3X: %.4X  %s\n", addr == pc ? '>' : ' ', 
+           breakpoint(addr) ? '*' : ' ', addr, opcode, text);
+}
+
+static void print_disassembly(MemMaps *mem, uint16_t from, unsigned int count,
+                              uint16_t pc)
+{
+    uint16_t first = from;
+
+    for (; count && from < RAM_END; --count, from += 2)
+    {
+        // a line between the blocks found by the analysis
+        if (from != first && (map_flags(from) & ROMMAP_BLOCK)) {
+            printf("\n");
+        }
+        print_opcode(mem, from, pc);
+    }
+}
+
+static void print_registers(cpu *cpuData)
+{
+    unsigned int index;
+
+    printf("pc: %#.3X  I: %#.3X  sp: %u  DT: %u  ST: %u\n", cpuData->pc, 
+           cpuData->i, cpuData->sp, cpuData->dt, cpuData->st);
+
+    for (index = 0; index < 16; ++index)
+    {
+        printf("V%X: %.2X%s", index, cpuData->regs[index], 
+               index % 8 == 7 ? "\n" : "  ");
+    }
+
+    printf("stack:");
+    for (index = 0; index < cpuData->sp; ++index)
+    {
+        printf(" %#.3X", cpuData->stack[index]);
+    }
+    printf(cpuData->sp ? "\n" : " empty\n");
+}
+
+static void print_memory(MemMaps *mem, uint16_t addr, unsigned int len)
+{
+    unsigned int index;
+
+    for (index = 0; index < len && addr + index < mem->ram_size; ++index)
+    {
+        if (index % 16 == 0) {
+            printf("%s%#.3X:", index ? "\n" : "", addr + index);
+        }
+        printf(" %.2X", mem->ram[addr + index]);
+    }
+    printf("\n");
+}
+
+static void print_help()
+{
+    printf("s [n]         step n opcodes, 1 by default\n"
+           "n             step over a CALL\n"
+           "fin           run until the current subroutine returns\n"
+           "c             continue\n"
+           "b <addr>      set a breakpoint\n"
+           "d [addr]      delete a breakpoint, or all of them\n"
+           "bl            list the breakpoints\n"
+           "l [addr]      disassemble around pc, or from addr\n"
+           "r             dump registers, timers, I and the stack\n"
+           "x <addr> [n]  dump n bytes of ram, 16 by default\n"
+           "w <addr> [n] [r|w|rw]\n"
+           "              stop when n bytes of ram, 1 by default, are read\n"
+           "              or written by FX33, FX55, FX65 or DXYN, written\n"
+           "              by default\n"
+           "if <Vx|I> [op value]\n"
+           "              stop when a register changes, or when op, one of\n"
+           "              == != < > <= >=, becomes true\n"
+           "wl            list the watchpoints and conditions\n"
+           "dw [n]        delete watchpoint n, or all of them\n"
+           "dc [n]        delete condition n, or all of them\n"
+           "q             quit\n"
+           "An empty line repeats the last command, and Ctrl-C stops a "
+           "running game\n");
+}
+
+static void print_watchpoints(cpu *cpuData)
+{
+    unsigned int index;
+
+    for (index = 0; index < watchpoints_count; ++index)
+    {
+        printf("w%u: %#.3X-%#.3X %s%s\n", index, watchpoints[index].addr,
+               watchpoints[index].addr + watchpoints[index].len - 1,
+               watchpoints[index].kind & WATCH_READ ? "r" : "",
+               watchpoints[index].kind & WATCH_WRITE ? "w" : "");
+    }
+
+    for (index = 0; index < conditions_count; ++index)
+    {
+        Condition *condition = &conditions[index];
+
+        printf("c%u: ", index);
+        if (condition->reg == DEBUG_REG_I) {
+            printf("I");
+        } else {
+            printf("V%X", condition->reg);
+        }
+
+        if (condition->op == COND_CHANGE) {
+            printf(" changes, now %#X\n", 
+                   register_value(cpuData, condition->reg));
+        } else {
+            printf(" %s %#X\n", condition_ops[condition->op], 
+                   condition->value);
+        }
+    }
+}
+
+//******************************************************************************
+//*                                commands                                    *
+//******************************************************************************
+
+// w <addr> [n] [r|w|rw]
+static void add_watchpoint(MemMaps *mem, const char *line)
+{
+    unsigned int addr, len = 1;
+    char kind[4] = "w";
+
+    if (sscanf(line, "%*s %x %u %3s", &addr, &len, kind) < 1 
+        || len == 0 || addr + len > mem->ram_size) {
+        printf("usage: w <addr> [n] [r|w|rw], inside of ram\n");
+        return;
+    }
+
+    if (watchpoints_count == DEBUG_MAX_WATCHPOINTS) {
+        printf("there can only be %d watchpoints\n", DEBUG_MAX_WATCHPOINTS);
+        return;
+    }
+
+    watchpoints[watchpoints_count].addr = addr;
+    watchpoints[watchpoints_count].len = len;
+    watchpoints[watchpoints_count].kind = 
+        (strchr(kind, 'r') ? WATCH_READ : 0) 
+        | (strchr(kind, 'w') ? WATCH_WRITE : 0);
+
+    if (watchpoints[watchpoints_count].kind == 0) {
+        printf("the kind of access is r, w or rw\n");
+        return;
+    }
+
+    ++watchpoints_count;
+    update_watch(mem);
+}
+
+// if <Vx|I> [op value]
+static void add_condition(cpu *cpuData, const char *line)
+{
+    char reg[4], op[4] = "";
+    unsigned int value = 0;
+    Condition condition;
+    int args;
+
+    args = sscanf(line, "%*s %3s %3s %i", reg, op, &value);
+
+    if (args >= 1 && (reg[0] == 'I' || reg[0] == 'i') && reg[1] == '\0') {
+        condition.reg = DEBUG_REG_I;
+    } else if (args >= 1 && (reg[0] == 'V' || reg[0] == 'v') 
+               && sscanf(reg + 1, "%1x", &value) == 1 && reg[2] == '\0') {
+        condition.reg = value;
+    } else {
+        printf("usage: if <Vx|I> [op value]\n");
+        return;
+    }
+
+    for (condition.op = COND_CHANGE; condition.op < COND_COUNT; 
+         ++condition.op)
+    {
+        if (!strcmp(op, condition_ops[condition.op])) {
+            break;
+        }
+    }
+
+    if (condition.op == COND_COUNT || (condition.op != COND_CHANGE 
+        && sscanf(line, "%*s %*s %*s %i", &value) != 1)) {
+        printf("the comparisons are == != < > <= >=, followed by a value\n");
+        return;
+    }
+
+    if (conditions_count == DEBUG_MAX_CONDITIONS) {
+        printf("there can only be %d conditions\n", DEBUG_MAX_CONDITIONS);
+        return;
+    }
+
+    // it has to start being met from here on, so it's evaluated right away
+    condition.value = value;
+    condition.last = evaluate(cpuData, &condition);
+    conditions[conditions_count++] = condition;
+}
+
+// remove entry n of a list, or empty it when args says there's no n
+static void delete_entry(void *list, unsigned int *count, size_t size, 
+                         int args, unsigned int n)
+{
+    if (args < 2) {
+        *count = 0;
+    } else if (n < *count) {
+        memmove((char *) list + n * size, (char *) list + (n + 1) * size,
+                (*count - n - 1) * size);
+        --*count;
+    } else {
+        printf("there's no entry %u\n", n);
+    }
+}
+
+// read and run commands until one resumes the machine. Return 0 to quit
+static int prompt(cpu *cpuData, MemMaps *mem)
+{
+    char line[256], command[16];
+    unsigned int addr, count, index;
+    int args;
+
+    print_opcode(mem, cpuData->pc, cpuData->pc);
+
+    for (;;)
+    {
+        printf("(chip8) ");
+        fflush(stdout);
+
+        if (fgets(line, sizeof(line), stdin) == NULL) {
+            return 0;
+        }
+
+        if (line[0] == '\n') {
+            strcpy(line, last_command);
+        } else {
+            strcpy(last_command, line);
+        }
+
+        args = sscanf(line, "%15s %x %u", command, &addr, &count);
+        index = 0;
+        if (args < 1) {
+            continue;
+        }
+
+        if (!strcmp(command, "s")) {
+            // the first of them runs right after this
+            mode = DEBUG_STEP;
+            steps = args >= 2 ? strtoul(line + 1, NULL, 10) : 1;
+            steps = steps ? steps - 1 : 0;
+            return 1;
+        } else if (!strcmp(command, "n")) {
+            // over a CALL, the next stop is where it returns to
+            if (offset1(opcode_at(mem, cpuData->pc)) == 0x2) {
+                mode = DEBUG_UNTIL;
+                until_pc = cpuData->pc + 2;
+                until_sp = cpuData->sp;
+            } else {
+                mode = DEBUG_STEP;
+                steps = 0;
+            }
+            return 1;
+        } else if (!strcmp(command, "fin")) {
+            if (cpuData->sp == 0) {
+                printf("not in a subroutine\n");
+                continue;
+            }
+            mode = DEBUG_FINISH;
+            until_sp = cpuData->sp;
+            return 1;
+        } else if (!strcmp(command, "c")) {
+            mode = DEBUG_RUN;
+            return 1;
+        } else if (!strcmp(command, "b") && args >= 2 && addr < RAM_SIZE) {
+            set_breakpoint(addr, 1);
+        } else if (!strcmp(command, "d")) {
+            if (args >= 2 && addr < RAM_SIZE) {
+                set_breakpoint(addr, 0);
+            } else {
+                memset(breakpoints, 0, sizeof(breakpoints));
+                breakpoints_count = 0;
+            }
+        } else if (!strcmp(command, "bl")) {
+            for (index = 0; index < RAM_SIZE; ++index)
+            {
+                if (breakpoint(index)) {
+                    print_opcode(mem, index, cpuData->pc);
+                }
+            }
+        } else if (!strcmp(command, "l")) {
+            if (args >= 2) {
+                print_disassembly(mem, addr, 2 * DEBUG_CONTEXT + 1, 
+                                  cpuData->pc);
+            } else {
+                // opcodes are 2 bytes, so the lines before pc are assumed
+                // to be aligned like it
+                addr = cpuData->pc >= 2 * DEBUG_CONTEXT 
+                       ? cpuData->pc - 2 * DEBUG_CONTEXT : cpuData->pc % 2;
+                print_disassembly(mem, addr, 
+                                  (cpuData->pc - addr) / 2 + DEBUG_CONTEXT + 1,
+                                  cpuData->pc);
+            }
+        } else if (!strcmp(command, "r")) {
+            print_registers(cpuData);
+        } else if (!strcmp(command, "x") && args >= 2) {
+            print_memory(mem, addr, args >= 3 ? count : 16);
+        } else if (!strcmp(command, "w")) {
+            add_watchpoint(mem, line);
+        } else if (!strcmp(command, "if")) {
+            add_condition(cpuData, line);
+            rearm();
+        } else if (!strcmp(command, "wl")) {
+            print_watchpoints(cpuData);
+        } else if (!strcmp(command, "dw")) {
+            args = sscanf(line, "%*s %u", &index) + 1;
+            delete_entry(watchpoints, &watchpoints_count, sizeof(Watchpoint),
+                         args, index);
+            update_watch(mem);
+        } else if (!strcmp(command, "dc")) {
+            args = sscanf(line, "%*s %u", &index) + 1;
+            delete_entry(conditions, &conditions_count, sizeof(Condition),
+                         args, index);
+            rearm();
+        } else if (!strcmp(command, "q")) {
+            return 0;
+        } else {
+            print_help();
+        }
+    }
+}
+
+// whether the machine has to stop before the opcode at pc
+static int should_stop(cpu *cpuData)
+{
+    // conditions are looked at first, so that they see every opcode
+    Condition *met = conditions_count ? condition_met(cpuData) : NULL;
+
+    if (met) {
+        if (met->reg == DEBUG_REG_I) {
+            printf("I is %#.3X\n", cpuData->i);
+        } else {
+            printf("V%X is %#.2X\n", met->reg, cpuData->regs[met->reg]);
+        }
+        return 1;
+    }
+
+    switch (mode)
+    {
+        case DEBUG_STOP:
+            return 1;
+        case DEBUG_STEP:
+            return steps-- == 0;
+        case DEBUG_UNTIL:
+            if (cpuData->pc == until_pc && cpuData->sp == until_sp) {
+                return 1;
+            }
+            break;
+        case DEBUG_FINISH:
+            if (cpuData->sp < until_sp) {
+                return 1;
+            }
+            break;
+    }
+
+    if (breakpoint(cpuData->pc)) {
+        printf("breakpoint at %#.3X\n", cpuData->pc);
+        return 1;
+    }
+
+    return 0;
+}
+
+int debug_cycles(cpu *cpuData, MemMaps *mem, unsigned int cycles,
+                 unsigned int game_size)
+{
+    unsigned int cycle;
+
+    for (cycle = 0; cycle < cycles; ++cycle)
+    {
+        if (cpuData->pc > game_size + PROG_RAM_START) {
+            printf("the rom ended at %#.3X\n", cpuData->pc);
+            return 0;
+        }
+
+        if (should_stop(cpuData)) {
+            mode = DEBUG_STOP;
+            if (!prompt(cpuData, mem)) {
+                return 0;
+            }
+            rearm();
+        }
+
+        if (step(cpuData, mem) != FAULT_NONE) {
+            if (cpuData->fault == FAULT_EXIT) {
+                printf("the rom exited at %#.3X\n", cpuData->pc - 2);
+                return 0;
+            }
+
+            printf("%s at %#.3X\n", fault_name(cpuData->fault), cpuData->pc);
+            return debug_fault(cpuData, mem);
+        }
+    }
+
+    return 1;
+}
+
+int debug_fault(cpu *cpuData, MemMaps *mem)
+{
+    if (!enabled) {
+        return 0;
+    }
+
+    // a watchpoint stops after the opcode that hit it, showing what it did.
+    // Any other fault didn't change the machine, so it can be looked at as 
+    // it was right before it
+    if (cpuData->fault == FAULT_WATCH) {
+        printf("%s by %#.3X:\n", 
+               mem->watch_kind == WATCH_READ ? "read" : "write", 
+               cpuData->pc - 2);
+        print_memory(mem, mem->watch_addr, mem->watch_len);
+    }
+
+    mode = DEBUG_STOP;
+    debug_armed = 1;
+    return 1;
+}
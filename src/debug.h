@@ -0,0 +1,60 @@
+/*
+ * Terminal debugger. With -D the emulator stops before the first opcode and
+ * reads commands from stdin, gdb style, and Ctrl-C stops it again later.
+ *
+ * Breakpoints are kept in a bitmap with a bit per address, and only looked 
+ * at by debug_cycles(), the variant of the main loop that runs while 
+ * debug_armed is set: when there are breakpoints, or the debugger is 
+ * stepping or was asked to stop. Otherwise the main loop runs its own 
+ * cycles, the same ones it runs without the debugger, and only checks 
+ * debug_armed once per frame
+ *
+ * Watchpoints don't need it either: the opcodes that read or write ram as
+ * data check the bitmaps of watched 64-byte blocks in MemMaps, and only look
+ * up the exact addresses when a block is watched, raising FAULT_WATCH on a
+ * hit. Conditions on registers are evaluated before every opcode, so they 
+ * arm the debugger like breakpoints do
+ * */
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include <signal.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define DEBUG_BREAKPOINT_WORDS (4096 / 64)
+
+#define DEBUG_MAX_WATCHPOINTS 16
+#define DEBUG_MAX_CONDITIONS 16
+
+// register number conditions use for I
+#define DEBUG_REG_I 16
+
+// lines of disassembly shown before and after pc
+#define DEBUG_CONTEXT 4
+
+// whether the main loop has to run its cycles through debug_cycles()
+extern volatile sig_atomic_t debug_armed;
+
+// start the debugger, stopped before the first opcode
+void debug_init();
+
+// whether debug_init() started it
+int debug_enabled();
+
+// put the watchpoints back into mem, after initialize() cleared them from
+// it. The machine is reset by rom switches, the watchpoints aren't
+void debug_rearm(MemMaps *mem);
+
+// run at most cycles opcodes, stopping at breakpoints and steps to read
+// commands. Return 0 if the emulation should end, because the debugger was 
+// told to quit or the rom ended
+int debug_cycles(cpu *cpuData, MemMaps *mem, unsigned int cycles,
+                 unsigned int game_size);
+
+// the opcode before pc raised a fault. Return 1 if the debugger is going to
+// stop, on the next frame, and 0 if it isn't running
+int debug_fault(cpu *cpuData, MemMaps *mem);
+
+#endif
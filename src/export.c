@@ -0,0 +1,115 @@
+/*
+ * Frame export. See export.h
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "export.h"
+#include "shm.h"
+
+static char segment_name[64];
+static Export *segment = NULL;
+
+// keys of the readers as they were at the last export_keys()
+static uint16_t last_keys;
+
+static void close_atexit()
+{
+    export_close();
+}
+
+int export_init()
+{
+    snprintf(segment_name, sizeof(segment_name), "%s%d", 
+             EXPORT_PREFIX, (int) getpid());
+
+    Export *exp = shm_create(segment_name, sizeof(Export));
+    if (exp == NULL) {
+        return 0;
+    }
+
+    exp->version = EXPORT_VERSION;
+    exp->size = sizeof(Export);
+    exp->pid = getpid();
+    exp->ring = EXPORT_RING;
+    exp->width = WINDOW_WIDTH;
+    exp->height = WINDOW_HEIGHT;
+
+    // readers check the magic last, so they never see a half made header
+    atomic_thread_fence(memory_order_release);
+    exp->magic = EXPORT_MAGIC;
+
+    if (segment == NULL) {
+        atexit(close_atexit);
+    }
+    segment = exp;
+    last_keys = 0;
+
+    return 1;
+}
+
+void export_frame(uint64_t frame, uint64_t now_ns, const cpu *cpuData,
+                  const MemMaps *mem)
+{
+    if (segment == NULL) {
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&segment->head, memory_order_relaxed);
+    ExportFrame *slot = &segment->frames[head % EXPORT_RING];
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    // odd seq first, and the fence keeps the writes of the slot after it
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->frame = frame;
+    slot->now_ns = now_ns;
+    screen_lores(mem, slot->screen);
+    memcpy(slot->regs, cpuData->regs, sizeof(slot->regs));
+    memcpy(slot->stack, cpuData->stack, sizeof(slot->stack));
+    slot->i = cpuData->i;
+    slot->pc = cpuData->pc;
+    slot->sp = cpuData->sp;
+    slot->dt = cpuData->dt;
+    slot->st = cpuData->st;
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&segment->head, head + 1, memory_order_release);
+}
+
+uint16_t export_keys(uint8_t *keys)
+{
+    if (segment == NULL) {
+        return 0;
+    }
+
+    uint16_t now = atomic_load_explicit(&segment->keys, memory_order_relaxed);
+    uint16_t changed = now ^ last_keys;
+    uint8_t key;
+
+    for (key = 0; key < 16; ++key)
+    {
+        if (changed & (1 << key)) {
+            keys[key] = (now >> key) & 1;
+        }
+    }
+
+    last_keys = now;
+    return changed;
+}
+
+void export_close()
+{
+    if (segment == NULL) {
+        return;
+    }
+
+    shm_unlink(segment_name);
+    shm_detach(segment, sizeof(Export));
+    segment = NULL;
+}
@@ -0,0 +1,120 @@
+/*
+ * Frame export. With -X, every completed frame is published to the shared 
+ * memory segment EXPORT_PREFIX<pid>: the packed screen, the cpu registers 
+ * and the frame number, so that other processes can read them in place, 
+ * without copies or syscalls per frame. They can also press keys, by 
+ * writing a key mask to the same segment.
+ *
+ * Frames go to a ring of EXPORT_RING slots, each one guarded by a seqlock:
+ * its seq is odd while the emulator writes the slot, and goes up by 2 every
+ * time the slot is written. A reader loads seq with acquire ordering, reads
+ * the slot if seq is even, and then checks, after an acquire fence, that seq
+ * didn't change, otherwise it read a torn slot and must read it again, see
+ * export_begin() and export_valid(). A slot is only written again
+ * EXPORT_RING frames later, so readers that keep up rarely have to retry
+ * */
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define EXPORT_PREFIX "/chip8-frames-"
+#define EXPORT_MAGIC 0x43384658             // "XF8C"
+#define EXPORT_VERSION 1
+
+// slots in the ring, a power of 2
+#define EXPORT_RING 8
+
+// a published frame. Slots are aligned to cache lines so that reading one 
+// doesn't share a line with the one being written
+typedef struct ExportFrame
+{
+    _Atomic uint32_t seq;                   // odd while being written
+    uint32_t pad;
+    uint64_t frame;                         // frames since the start
+    uint64_t now_ns;                        // CLOCK_MONOTONIC of the frame
+
+    uint64_t screen[WINDOW_HEIGHT];         // same layout as MemMaps.screen
+
+    // cpu registers
+    uint8_t regs[16];
+    uint16_t stack[STACK_SIZE];
+    uint16_t i;
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t dt;
+    uint8_t st;
+} __attribute__((aligned(64))) ExportFrame;
+
+// layout of the segment
+typedef struct Export
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                          // sizeof(Export) of the writer
+    int32_t pid;
+    uint32_t ring;                          // EXPORT_RING of the writer
+    uint16_t width;                         // pixels of a screen row
+    uint16_t height;                        // rows of the screen
+
+    // frames published, the latest is in frames[(head - 1) % ring]
+    _Atomic uint64_t head;
+
+    // keys held by readers, bit n being key n. The emulator reads it once 
+    // per frame, and a bit that changes is handled like a key event
+    _Atomic uint16_t keys;
+
+    ExportFrame frames[EXPORT_RING];
+} Export;
+
+// publish frames, and read keys, from now on. Return 0 if the segment 
+// couldn't be created
+int export_init();
+
+// publish the state of the frame that just ended
+void export_frame(uint64_t frame, uint64_t now_ns, const cpu *cpuData,
+                  const MemMaps *mem);
+
+// apply the keys pressed and released by readers since the last call to 
+// keys. Return the mask of keys that changed, like set_keys()
+uint16_t export_keys(uint8_t *keys);
+
+// remove the segment. It's also removed at exit, if it wasn't before
+void export_close();
+
+//******************************************************************************
+//*                                 readers                                    *
+//******************************************************************************
+
+// the latest slot published, NULL if none was yet
+static inline const ExportFrame *export_latest(const Export *exp)
+{
+    uint64_t head = atomic_load_explicit(&((Export *) exp)->head, 
+                                         memory_order_acquire);
+
+    return head ? &exp->frames[(head - 1) % exp->ring] : NULL;
+}
+
+// start reading slot. Return the seq to pass to export_valid(), odd if the 
+// slot is being written and can't be read now
+static inline uint32_t export_begin(const ExportFrame *slot)
+{
+    return atomic_load_explicit(&((ExportFrame *) slot)->seq, 
+                                memory_order_acquire);
+}
+
+// whether what was read from slot since export_begin() returned seq is a 
+// whole frame
+static inline int export_valid(const ExportFrame *slot, uint32_t seq)
+{
+    atomic_thread_fence(memory_order_acquire);
+
+    return !(seq & 1) 
+           && atomic_load_explicit(&((ExportFrame *) slot)->seq, 
+                                   memory_order_relaxed) == seq;
+}
+
+#endif
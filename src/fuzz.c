@@ -0,0 +1,228 @@
+/*
+ * Snapshot based fuzzer. See fuzz.h
+ * */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "fuzz.h"
+
+// a fault and where it was raised, and how to get there again
+typedef struct Finding
+{
+    uint8_t fault;
+    uint16_t pc;
+    unsigned long hits;          // amount of cases that raised it
+    unsigned long first_case;    // index of the first case that raised it
+} Finding;
+
+static Finding findings[FUZZ_MAX_FINDINGS];
+static unsigned int findings_count = 0;
+
+// the random number generator driving the test cases. It's kept apart from
+// the one in the cpu so that the machine itself can be seeded per case
+static uint32_t next_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+void snapshot_take(Snapshot *snap, cpu *cpuData, MemMaps *mems)
+{
+    mems->dirty = 0;
+    snap->cpuData = *cpuData;
+    snap->mems = *mems;
+}
+
+void snapshot_restore(const Snapshot *snap, cpu *cpuData, MemMaps *mems)
+{
+    uint64_t dirty = mems->dirty;
+
+    while (dirty)
+    {
+        unsigned int block = __builtin_ctzll(dirty);
+        unsigned int start = block << mems->block_shift;
+        unsigned int len = 1 << mems->block_shift;
+
+        // the last block is shorter, since RAM_SIZE isn't a multiple of it
+        if (start + len > mems->ram_size) {
+            len = mems->ram_size - start;
+        }
+
+        memcpy(&mems->ram[start], &snap->mems.ram[start], len);
+        dirty &= dirty - 1;
+    }
+
+    // everything but the ram is copied back whole, the fields around it
+    size_t after = offsetof(MemMaps, ram) + sizeof(mems->ram);
+
+    memcpy(mems, &snap->mems, offsetof(MemMaps, ram));
+    memcpy((uint8_t *) mems + after, (const uint8_t *) &snap->mems + after,
+           sizeof(MemMaps) - after);
+    mems->dirty = 0;
+
+    *cpuData = snap->cpuData;
+}
+
+static const char *finding_name(uint8_t fault)
+{
+    return fault == FUZZ_HANG ? "Hang" : fault_name(fault);
+}
+
+static void record(uint8_t fault, uint16_t pc, unsigned long test_case)
+{
+    unsigned int index;
+
+    for (index = 0; index < findings_count; ++index)
+    {
+        if (findings[index].fault == fault && findings[index].pc == pc) {
+            ++findings[index].hits;
+            return;
+        }
+    }
+
+    if (findings_count == FUZZ_MAX_FINDINGS) {
+        return;
+    }
+
+    findings[findings_count].fault = fault;
+    findings[findings_count].pc = pc;
+    findings[findings_count].hits = 1;
+    findings[findings_count].first_case = test_case;
+    ++findings_count;
+}
+
+// run a single test case. Return the amount of cycles executed
+static unsigned long run_case(unsigned int game_size, cpu *cpuData,
+                              MemMaps *mems, unsigned long cycles,
+                              uint32_t case_seed, unsigned long test_case)
+{
+    uint32_t state = case_seed ? case_seed : 1;
+    unsigned long cycle;
+    unsigned long next_input = 0;
+    unsigned long stuck = 0;     // cycles pc didn't move
+    unsigned int mutations, index;
+    uint16_t last_pc;
+
+    // flip some bytes of the program, so the rom itself gets fuzzed too
+    mutations = next_rand(&state) % (FUZZ_MAX_MUTATIONS + 1);
+    for (index = 0; index < mutations && game_size > 0; ++index)
+    {
+        uint16_t addr = PROG_RAM_START + next_rand(&state) % game_size;
+
+        mems->ram[addr] = (uint8_t) next_rand(&state);
+        ram_touch(mems, addr, 1);
+    }
+
+    cpuData->rng = next_rand(&state) | 1;
+
+    for (cycle = 0; cycle < cycles; ++cycle)
+    {
+        // change the keys down every 1 to 64 cycles
+        if (cycle == next_input) {
+            uint32_t mask = next_rand(&state);
+
+            for (index = 0; index < 16; ++index)
+            {
+                mems->keys[index] = (mask >> index) & 1;
+            }
+            next_input += 1 + (next_rand(&state) >> 26);
+        }
+
+        last_pc = cpuData->pc;
+        if (step(cpuData, mems) != FAULT_NONE) {
+            // 00FD ends the program the way it's meant to
+            if (cpuData->fault == FAULT_EXIT) {
+                return cycle + 1;
+            }
+
+            // a fault raised by an opcode leaves pc right after it
+            uint16_t pc = cpuData->pc;
+            if (cpuData->fault != FAULT_PC_OVERRUN) {
+                pc -= 2;
+            }
+
+            record(cpuData->fault, pc, test_case);
+            return cycle + 1;
+        }
+
+        // the program ran past its end, same as the emulate() loop
+        if (cpuData->pc > game_size + PROG_RAM_START) {
+            return cycle + 1;
+        }
+
+        stuck = cpuData->pc == last_pc ? stuck + 1 : 0;
+
+        if ((cycle + 1) % CYCLES_PER_TICK == 0) {
+            timers_step(cpuData);
+        }
+    }
+
+    // the cap was reached without the program going anywhere
+    if (stuck >= FUZZ_HANG_CYCLES || (stuck && stuck == cycles)) {
+        record(FUZZ_HANG, cpuData->pc, test_case);
+    }
+
+    return cycles;
+}
+
+void fuzz(unsigned int game_size, cpu *cpuData, MemMaps *mems,
+          unsigned long cases, unsigned long cycles, uint32_t seed)
+{
+    // the snapshot holds a whole machine, keep it out of the stack
+    Snapshot *snap = malloc(sizeof(Snapshot));
+    if (snap == NULL) {
+        perror("chip8: ");
+        exit(1);
+    }
+
+    snapshot_take(snap, cpuData, mems);
+
+    struct timespec start, end;
+    unsigned long test_case;
+    unsigned long total_cycles = 0;
+    uint32_t state = seed ? seed : 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (test_case = 0; test_case < cases; ++test_case)
+    {
+        total_cycles += run_case(game_size, cpuData, mems, cycles,
+                                 next_rand(&state), test_case);
+        snapshot_restore(snap, cpuData, mems);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = (end.tv_sec - start.tv_sec)
+                     + (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+    printf("cases: %lu cycles: %lu time: %.3fs (%.0f cases/s, %.0f cycles/s)\n",
+           cases, total_cycles, elapsed,
+           elapsed > 0 ? cases / elapsed : 0.0,
+           elapsed > 0 ? total_cycles / elapsed : 0.0);
+
+    unsigned int index;
+    for (index = 0; index < findings_count; ++index)
+    {
+        printf("finding: %s at %#.3X, hit by %lu cases, first by case %lu "
+               "(reproduce with -Q %s -s %u -n %lu -F %lu)\n",
+               finding_name(findings[index].fault), findings[index].pc,
+               findings[index].hits, findings[index].first_case,
+               machine_quirks(mems), seed, cycles,
+               findings[index].first_case + 1);
+    }
+
+    free(snap);
+}
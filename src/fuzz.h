@@ -0,0 +1,51 @@
+/*
+ * In-process fuzzing of roms and input sequences. The machine is booted once,
+ * a snapshot is taken and every test case runs from it, so that resetting
+ * between cases only costs copying back the ram blocks the case wrote to
+ * */
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+// amount of cycles each test case runs for, when not told otherwise
+#define FUZZ_DEFAULT_CYCLES 2000
+
+// maximum amount of distinct findings, a finding being a (fault, pc) pair.
+// 00FD isn't one, it's how SUPER-CHIP programs end
+#define FUZZ_MAX_FINDINGS 256
+
+// a case that reaches its last cycle with pc on the same opcode for this
+// many cycles, a jump to itself or FX0A with no key down, is a hang
+#define FUZZ_HANG_CYCLES 256
+
+// the fault of the findings that are hangs, past those of the cpu
+#define FUZZ_HANG FAULT_COUNT
+
+// maximum amount of rom bytes mutated by a single test case
+#define FUZZ_MAX_MUTATIONS 4
+
+// a copy of the whole machine that the test cases start from
+typedef struct Snapshot
+{
+    cpu cpuData;
+    MemMaps mems;
+} Snapshot;
+
+// copy the machine into snap and start tracking the ram blocks written from
+// now on
+void snapshot_take(Snapshot *snap, cpu *cpuData, MemMaps *mems);
+
+// bring the machine back to snap. Only the ram blocks marked as dirty since
+// the snapshot was taken are copied back, and the rest of the machine whole
+void snapshot_restore(const Snapshot *snap, cpu *cpuData, MemMaps *mems);
+
+// run cases test cases of at most cycles cycles each, starting from the
+// current state of the machine, and print the faults found. Each case is
+// derived from seed and its own index, so any finding can be reproduced
+void fuzz(unsigned int game_size, cpu *cpuData, MemMaps *mems,
+          unsigned long cases, unsigned long cycles, uint32_t seed);
+
+#endif
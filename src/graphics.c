@@ -10,6 +10,8 @@
 
 #include "graphics.h"
 #include "chip8.h"
+#include "blit.h"
+#include "control.h"
 
 
 uint8_t sprites[4] = {104, 195, 163, 1};
@@ -24,6 +26,10 @@ uint8_t sprites[4] = {104, 195, 163, 1};
  */
 uint8_t bg[4] = {0, 0, 0, 255};
 
+// colors of the pixels lit only in the second XO-CHIP plane, and in both
+uint8_t second_plane[4] = {255, 255, 255, 255};
+uint8_t both_planes[4] = {85, 85, 85, 255};
+
 
 // remap the chip8 keys to conform better to new keyboards
 // 
@@ -81,6 +87,14 @@ struct WindowDrawData
 static SDL_Window *ScreenWindow = NULL;
 static SDL_Renderer *ScreenRenderer = NULL;
 
+// texture with the size of the window, the screen is scaled into it by 
+// the cpu, so the renderer only copies it, even without a gpu. The high 
+// resolution is scaled half as much as the low one to fill it
+static SDL_Texture *ChipTexture = NULL;
+static BlitTable ChipBlit;
+static BlitTable HiresBlit;
+static uint32_t PlaneColors[4];
+
 
 void init_win(char *game_name, uint8_t scale_factor)
 {
@@ -103,53 +117,60 @@ void init_win(char *game_name, uint8_t scale_factor)
             fprintf(stderr, "Could not create window: %s\n", SDL_GetError());
         }
 
-        ScreenRenderer = SDL_CreateRenderer(ScreenWindow,
-                                            -1,
-                                            SDL_RENDERER_ACCELERATED);
+        // let SDL fall back to the software renderer when there's no gpu
+        ScreenRenderer = SDL_CreateRenderer(ScreenWindow, -1, 0);
 
         if (ScreenRenderer == NULL) {
             fprintf(stderr, "Could not create renderer: %s\n", SDL_GetError());
     	}
-   
-	
-        SDL_RenderSetScale(ScreenRenderer, scale_factor, scale_factor);
+
+        init_texture(scale_factor);
     }
 }
 
+void set_title(const char *title)
+{
+    SDL_SetWindowTitle(ScreenWindow, title);
+}
 
-
-void clean_screen()
-{   
-    SDL_SetRenderDrawColor(ScreenRenderer, 
-                           bg[0], bg[1], bg[2], bg[3]);
-    SDL_RenderClear(ScreenRenderer);
+void close_win()
+{
+    blit_free(&ChipBlit);
+    blit_free(&HiresBlit);
+    SDL_DestroyTexture(ChipTexture);
+    SDL_DestroyRenderer(ScreenRenderer);
+    SDL_DestroyWindow(ScreenWindow);
+    SDL_Quit();
 }
 
-// TODO: add error checking
-void update_window(MemMaps *mem)
+void init_texture(uint8_t scale_factor)
 {
-    
-    // create texture that will hold the pixels to the screen
-    SDL_Texture *ChipTexture = SDL_CreateTexture(ScreenRenderer,
-                                                 SDL_PIXELFORMAT_RGBA32,
-                                                 SDL_TEXTUREACCESS_STREAMING,
-                                                 WINDOW_WIDTH, WINDOW_HEIGHT);
+    // an odd scale loses a column of pixels, which the renderer stretches
+    uint8_t hires_scale = scale_factor > 1 ? scale_factor / 2 : 1;
+
+    ChipTexture = SDL_CreateTexture(ScreenRenderer,
+                                    SDL_PIXELFORMAT_RGBA32,
+                                    SDL_TEXTUREACCESS_STREAMING,
+                                    HIRES_WIDTH * hires_scale, 
+                                    HIRES_HEIGHT * hires_scale);
 
     if (ChipTexture == NULL) {
-        fprintf(stderr, "Couldn't create texture from renderer: %s",
+        fprintf(stderr, "Couldn't create texture from renderer: %s\n",
                 SDL_GetError());
+        return;
     }
 
     //--------------------------------------------------------------------------
     // get our texture format and map the rgba colors to it
     uint32_t pixelformat;
     if (SDL_QueryTexture(ChipTexture, &pixelformat, NULL, NULL, NULL) == -1) {
-        fprintf(stderr, "Couldn't querry texture format: %s", SDL_GetError());
+        fprintf(stderr, "Couldn't querry texture format: %s\n", SDL_GetError());
     }
 
     SDL_PixelFormat *format = SDL_AllocFormat(pixelformat);
     if (format == NULL) {
-        fprintf(stderr, "Couldn't allocate format: %s", SDL_GetError());
+        fprintf(stderr, "Couldn't allocate format: %s\n", SDL_GetError());
+        return;
     }
 
     uint32_t spriteRGBA = SDL_MapRGBA(format, 
@@ -161,37 +182,77 @@ void update_window(MemMaps *mem)
                                    bg[0], bg[1],
                                    bg[2], bg[3]);
 
+    PlaneColors[0] = bgRGBA;
+    PlaneColors[1] = spriteRGBA;
+    PlaneColors[2] = SDL_MapRGBA(format, second_plane[0], second_plane[1],
+                                 second_plane[2], second_plane[3]);
+    PlaneColors[3] = SDL_MapRGBA(format, both_planes[0], both_planes[1],
+                                 both_planes[2], both_planes[3]);
+
+    SDL_FreeFormat(format);
     //--------------------------------------------------------------------------
 
-    int HeightIndex, WidthIndex;
-    //uint32_t SurfaceIndex;       // which pixel to access
+    if (!blit_init(&ChipBlit, 2 * hires_scale, spriteRGBA, bgRGBA)
+        || !blit_init(&HiresBlit, hires_scale, spriteRGBA, bgRGBA)) {
+        fprintf(stderr, "Couldn't allocate the blit table\n");
+        blit_free(&ChipBlit);
+    }
+}
 
-    // unlock texture so we can manipulate its pixels
-    uint32_t *pixels;
-    int pitch;
-    SDL_LockTexture(ChipTexture, NULL, (void **) &pixels, &pitch);
+// whether a rom drew to the second plane, which is only the case for some 
+// XO-CHIP ones
+static int second_plane_used(MemMaps *mem)
+{
+    unsigned int word;
 
-    // iterate the entire screen array, updates the ChipTexture with 
-    // the new frame, then unlocks it and effectivates the changes
-    for(HeightIndex = 0; HeightIndex < WINDOW_HEIGHT; ++HeightIndex)
+    for (word = 0; word < SCREEN_WORDS; ++word)
     {
-        for(WidthIndex = 0; WidthIndex < WINDOW_WIDTH; ++WidthIndex)
-        {
-            // set the texture value to a RGBA pixel, according to the
-            // memory map that stores the memory map of our screen
-            if (mem->screen[HeightIndex][WidthIndex]) {
-                pixels[(WINDOW_WIDTH * HeightIndex) + WidthIndex] = spriteRGBA;
-            } else {
-                pixels[(WINDOW_WIDTH * HeightIndex) + WidthIndex] = bgRGBA;
-            }
+        if (mem->screen[1][word]) {
+            return 1;
         }
     }
+
+    return 0;
+}
+
+
+void clean_screen()
+{   
+    SDL_SetRenderDrawColor(ScreenRenderer, 
+                           bg[0], bg[1], bg[2], bg[3]);
+    SDL_RenderClear(ScreenRenderer);
+}
+
+void update_window(MemMaps *mem)
+{
+    // lock texture so we can manipulate its pixels
+    uint32_t *pixels;
+    int pitch;
+
+    if (ChipTexture == NULL || ChipBlit.entries == NULL) {
+        return;
+    }
+
+    if (SDL_LockTexture(ChipTexture, NULL, (void **) &pixels, &pitch) != 0) {
+        fprintf(stderr, "Couldn't lock texture: %s\n", SDL_GetError());
+        return;
+    }
+
+    // expand the screen map straight into the texture, already scaled
+    BlitTable *table = mem->hires ? &HiresBlit : &ChipBlit;
+    unsigned int width = mem->hires ? HIRES_WIDTH : WINDOW_WIDTH;
+    unsigned int height = mem->hires ? HIRES_HEIGHT : WINDOW_HEIGHT;
+
+    if (second_plane_used(mem)) {
+        blit_planes(table, mem->screen[0], mem->screen[1], PlaneColors, 
+                    width, height, pixels, pitch);
+    } else {
+        blit_rows(table, mem->screen[0], width, height, pixels, pitch);
+    }
     SDL_UnlockTexture(ChipTexture);
 
     SDL_RenderCopy(ScreenRenderer, ChipTexture, NULL, NULL);
     SDL_RenderPresent(ScreenRenderer);
-    
-    SDL_DestroyTexture(ChipTexture);
 }
 
 //******************************************************************************
@@ -199,9 +260,10 @@ void update_window(MemMaps *mem)
 //******************************************************************************
 
 
-void set_keys(uint8_t *keys)
+uint16_t set_keys(uint8_t *keys)
 {
     SDL_Event event;
+    uint16_t changed = 0;
 
     //memset(keys, 0, sizeof(uint8_t) * sizeof(keys));
     while (SDL_PollEvent(&event))
@@ -210,8 +272,11 @@ void set_keys(uint8_t *keys)
         {
             case SDL_QUIT:
             {
-                SDL_Quit();
-                exit( 0 );
+                // the loop ends the emulation when it drains the queue, if
+                // it's full the next SDL_QUIT will do
+                ControlCommand quit = { .type = CONTROL_SHUTDOWN };
+                control_push(&control_ui, &quit);
+                break;
             }
 
             case SDL_KEYDOWN: 
@@ -219,6 +284,7 @@ void set_keys(uint8_t *keys)
                int8_t key = keymap(event.key.keysym.sym);
                 if (key >= 0 && key <= 15)
                 {
+                   changed |= (!keys[key]) << key;
                    keys[key] = 1;
                 }
                 break;
@@ -229,6 +295,7 @@ void set_keys(uint8_t *keys)
                int8_t key = keymap(event.key.keysym.sym);
                if (key >= 0 && key <= 15)
                {
+                    changed |= keys[key] << key;
                     keys[key] = 0;
                }
                break;
@@ -236,40 +303,8 @@ void set_keys(uint8_t *keys)
 
         }
     }
-}
 
-// TODO: rewrite
-uint8_t waitkey()
-{
-    fprintf(stdout, "\nWaiting for key\n");
-
-    SDL_Event event;
-    uint8_t key;
-
-    while (true)
-    {
-        SDL_WaitEvent(&event);
-
-        if (event.type == SDL_QUIT)
-        {
-            SDL_Quit();
-            exit( 0 );
-        }
-
-        if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
-            key = keymap(event.key.keysym.sym);
-
-            // break out of loop if key is in the expected range
-            if (key >= 0 && key <= 15) {
-                break;
-            }
-
-        } else {
-            continue;
-        }
-    }
-
-    return key;
+    return changed;
 }
 
 uint8_t keymap(uint key)
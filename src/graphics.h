@@ -10,12 +10,25 @@
 // start SDL2
 void init_win(char *game_name, uint8_t scale_factor);
 
+// show title, the name of the rom, on the window
+void set_title(const char *title);
+
+// free what init_win() made and quit SDL
+void close_win();
+
+// create the texture the screen is drawn to, scale_factor times the size of
+// the screen map
+void init_texture(uint8_t scale_factor);
+
 /* 
- * Draw the screen memory map to our screen. There are 3 steps to it:
- * step 1: first we translate the screen map to a surface SDL2 structure
- * step 2: on this step, we blit the surface and then convert it to a texture
- * step 3: we pass the data from the texture to the renderer and then render
- * it
+ * Draw the screen memory map to our screen. There are 2 steps to it:
+ * step 1: the packed rows of the screen map are expanded and scaled by the
+ * cpu into the texture, see blit.h
+ * step 2: we pass the texture to the renderer, without scaling, and then
+ * render it
+ *
+ * The high resolution is scaled half as much as the low one, and once the
+ * second plane has pixels the planes are blitted together in 4 colors
  */ 
 void update_window(MemMaps *mem);
 
@@ -25,12 +38,10 @@ void render(uint8_t data, uint16_t x, uint16_t y);
 // reset screen color
 void clean_screen();
 
-// wait for key and return it when found
-uint8_t waitkey();
-
-// handle events and return the pressed key, key is KEY_NULL(16) if 
-// there are no down keys
-void set_keys(uint8_t *keys);
+// handle events, updating the state of the keys. Closing the window queues
+// a CONTROL_SHUTDOWN for the loop, see control.h. Return a mask of the keys
+// that changed state, bit n being key n
+uint16_t set_keys(uint8_t *keys);
 
 uint8_t keymap(uint key);
 
@@ -0,0 +1,231 @@
+/*
+ * Ram access heatmap. See heatmap.h
+ * */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "opcodes.h"
+#include "heatmap.h"
+
+// ram of the quirk profile, covered by the maps
+static uint32_t ram_size;
+
+// accesses of the rom being run, HEAT_* flags per byte, and the WATCH_*
+// bits the opcodes left in the seen map
+static uint8_t heat[XO_RAM_SIZE];
+static uint8_t seen[XO_RAM_SIZE];
+
+// amount of roms that accessed each byte, per kind of access
+static uint32_t executed[XO_RAM_SIZE];
+static uint32_t read[XO_RAM_SIZE];
+static uint32_t written[XO_RAM_SIZE];
+
+// same as step(), but recording the bytes of the opcode as executed. What
+// it reads and writes goes to the seen map
+static uint8_t heatmap_step(cpu *cpuData, MemMaps *mem)
+{
+    uint32_t pc = cpuData->pc;
+
+    // let step() raise the fault
+    if (pc + 1 >= mem->ram_size) {
+        return step(cpuData, mem);
+    }
+
+    heat[pc] |= HEAT_EXEC;
+    heat[pc + 1] |= HEAT_EXEC;
+
+    // F000 NNNN, the address is fetched with the opcode
+    if (pc + 3 < mem->ram_size
+        && decode(mem, (mem->ram[pc] << 8) | mem->ram[pc + 1]) == long_i) {
+        heat[pc + 2] |= HEAT_EXEC;
+        heat[pc + 3] |= HEAT_EXEC;
+    }
+
+    return step(cpuData, mem);
+}
+
+// run the game loaded in the machine, pressing random keys
+static void run(unsigned int game_size, cpu *cpuData, MemMaps *mems,
+                unsigned long cycles)
+{
+    uint32_t keys_state = 0x2545F491;
+    unsigned long cycle;
+    unsigned int key, addr;
+
+    // watch the whole ram, without a watchpoint, for ram_watched() to record
+    // every access in seen
+    memset(seen, 0, sizeof(seen));
+    mems->seen = seen;
+    mems->watch_read = ~(uint64_t) 0;
+    mems->watch_write = ~(uint64_t) 0;
+
+    for (cycle = 0; cycle < cycles; ++cycle)
+    {
+        if (cycle % CYCLES_PER_TICK == 0) {
+            keys_state ^= keys_state << 13;
+            keys_state ^= keys_state >> 17;
+            keys_state ^= keys_state << 5;
+
+            for (key = 0; key < 16; ++key)
+            {
+                mems->keys[key] = (keys_state >> key) & 1;
+            }
+
+            timers_step(cpuData);
+        }
+
+        if (heatmap_step(cpuData, mems) != FAULT_NONE) {
+            fprintf(stderr, "chip8: %s at %#X, stopping\n", 
+                    fault_name(cpuData->fault), cpuData->pc);
+            break;
+        }
+
+        if (cpuData->pc > game_size + PROG_RAM_START) {
+            break;
+        }
+    }
+
+    for (addr = 0; addr < ram_size; ++addr)
+    {
+        heat[addr] |= (seen[addr] & WATCH_READ ? HEAT_READ : 0)
+                      | (seen[addr] & WATCH_WRITE ? HEAT_WRITE : 0);
+    }
+}
+
+// pack the bytes of heat with flag set into a bitmap
+static void pack(uint8_t flag, uint8_t *bitmap)
+{
+    unsigned int addr;
+
+    memset(bitmap, 0, HEATMAP_BITMAP_SIZE(ram_size));
+    for (addr = 0; addr < ram_size; ++addr)
+    {
+        if (heat[addr] & flag) {
+            bitmap[addr / 8] |= 1 << (addr % 8);
+        }
+    }
+}
+
+// print what the rom did with the memory. Return 1 if it modified its code
+static int summary(const char *game)
+{
+    unsigned int exec_bytes = 0, read_bytes = 0, write_bytes = 0;
+    unsigned int smc_bytes = 0, ranges = 0;
+    unsigned int addr, start;
+
+    for (addr = 0; addr < ram_size; ++addr)
+    {
+        exec_bytes += (heat[addr] & HEAT_EXEC) != 0;
+        read_bytes += (heat[addr] & HEAT_READ) != 0;
+        write_bytes += (heat[addr] & HEAT_WRITE) != 0;
+        smc_bytes += (heat[addr] & (HEAT_EXEC | HEAT_WRITE)) 
+                     == (HEAT_EXEC | HEAT_WRITE);
+    }
+
+    printf("%s: executed %u bytes, read %u, written %u, self-modified %u\n",
+           game, exec_bytes, read_bytes, write_bytes, smc_bytes);
+
+    // list the ranges of code that were written
+    for (addr = 0; addr < ram_size && ranges < HEATMAP_SUMMARY_RANGES; ++addr)
+    {
+        if ((heat[addr] & (HEAT_EXEC | HEAT_WRITE)) != (HEAT_EXEC | HEAT_WRITE)) {
+            continue;
+        }
+
+        for (start = addr; addr + 1 < ram_size; ++addr)
+        {
+            if ((heat[addr + 1] & (HEAT_EXEC | HEAT_WRITE)) 
+                != (HEAT_EXEC | HEAT_WRITE)) {
+                break;
+            }
+        }
+
+        printf("    code written at %#.3X-%#.3X\n", start, addr);
+        ++ranges;
+    }
+
+    return smc_bytes != 0;
+}
+
+void heatmap(const Corpus *corpus, unsigned long cycles, const char *path,
+             const char *quirks)
+{
+    static uint8_t bitmap[HEATMAP_BITMAP_SIZE(XO_RAM_SIZE)];
+    static cpu cpuData;
+    static MemMaps mems;
+    unsigned int game, addr, smc_roms = 0, count = 0;
+
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        perror("chip8: ");
+        exit(1);
+    }
+
+    // the ram of the profile, as initialize() sets it up
+    initialize(&cpuData, &mems, quirks);
+    ram_size = mems.ram_size;
+
+    uint32_t header[3] = { HEATMAP_VERSION, ram_size, 0 };
+    fwrite("CH8HEAT", 1, 8, out);
+    fwrite(header, sizeof(header[0]), 3, out);
+
+    // each image runs once, whatever the amount of copies of it
+    for (game = 0; game < corpus->count; ++game)
+    {
+        const char *name = corpus->roms[game].name;
+
+        if (corpus->roms[game].original != -1) {
+            continue;
+        }
+
+        initialize(&cpuData, &mems, quirks);
+        memset(heat, 0, sizeof(heat));
+
+        unsigned int game_size = corpus_load(corpus, game, &mems);
+        if (!game_size) {
+            continue;
+        }
+        run(game_size, &cpuData, &mems, cycles);
+        ++count;
+
+        smc_roms += summary(name);
+
+        uint16_t name_len = strlen(name);
+        fwrite(&name_len, sizeof(name_len), 1, out);
+        fwrite(name, 1, name_len, out);
+
+        pack(HEAT_EXEC, bitmap);
+        fwrite(bitmap, 1, HEATMAP_BITMAP_SIZE(ram_size), out);
+        pack(HEAT_READ, bitmap);
+        fwrite(bitmap, 1, HEATMAP_BITMAP_SIZE(ram_size), out);
+        pack(HEAT_WRITE, bitmap);
+        fwrite(bitmap, 1, HEATMAP_BITMAP_SIZE(ram_size), out);
+
+        for (addr = 0; addr < ram_size; ++addr)
+        {
+            executed[addr] += (heat[addr] & HEAT_EXEC) != 0;
+            read[addr] += (heat[addr] & HEAT_READ) != 0;
+            written[addr] += (heat[addr] & HEAT_WRITE) != 0;
+        }
+    }
+
+    fwrite(executed, sizeof(executed[0]), ram_size, out);
+    fwrite(read, sizeof(read[0]), ram_size, out);
+    fwrite(written, sizeof(written[0]), ram_size, out);
+
+    // the roms that couldn't be loaded aren't in the map
+    header[2] = count;
+    fseek(out, 8, SEEK_SET);
+    fwrite(header, sizeof(header[0]), 3, out);
+
+    if (ferror(out)) {
+        fprintf(stderr, "chip8: error writing heatmap\n");
+    }
+    fclose(out);
+
+    printf("%u roms, %u modify their own code\n", count, smc_roms);
+}
@@ -0,0 +1,67 @@
+/*
+ * Ram access heatmap. Runs a batch of roms headless, recording for each byte
+ * of ram whether it was executed, read as data(DXYN, FX65) or written(FX33,
+ * FX55), and flags the bytes that were both executed and written, which is
+ * where a rom modifies its own code. The reads and writes are those the
+ * opcodes report through ram_read() and ram_touch(), every block of ram
+ * being watched with a seen map and no watchpoint, so they are the accesses
+ * the interpreter made, whatever the profile and its opcodes.
+ *
+ * The map covers the ram of the quirk profile in use, the 64 KB of the
+ * XO-CHIP included.
+ *
+ * The map is written to a binary file:
+ *
+ *   char     magic[8]                "CH8HEAT\0"
+ *   uint32_t version                 HEATMAP_VERSION
+ *   uint32_t ram_size                bytes of ram covered by each map, that
+ *                                    of the quirk profile
+ *   uint32_t roms                    amount of roms in the batch
+ *
+ *   then, for each rom:
+ *   uint16_t name_len
+ *   char     name[name_len]
+ *   uint8_t  executed[HEATMAP_BITMAP_SIZE(ram_size)]
+ *                                    1 bit per byte of ram, lsb first
+ *   uint8_t  read[HEATMAP_BITMAP_SIZE(ram_size)]
+ *   uint8_t  written[HEATMAP_BITMAP_SIZE(ram_size)]
+ *
+ *   and at last, the amount of roms that executed, read and wrote each byte,
+ *   as wide as the amount of roms so that they can't wrap
+ *   uint32_t executed[ram_size]
+ *   uint32_t read[ram_size]
+ *   uint32_t written[ram_size]
+ *
+ * All the integers are in the byte order of the host that wrote them
+ * */
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "chip8.h"
+#include "corpus.h"
+
+#define HEATMAP_VERSION 3
+#define HEATMAP_BITMAP_SIZE(ram_size) (((ram_size) + 7) / 8)
+
+// amount of cycles each rom runs for, when not told otherwise
+#define HEATMAP_DEFAULT_CYCLES 100000
+
+// how many self-modified ranges are listed in the summary of a rom
+#define HEATMAP_SUMMARY_RANGES 8
+
+// kinds of access to a byte of ram
+enum HeatFlags
+{
+    HEAT_EXEC  = 1 << 0,
+    HEAT_READ  = 1 << 1,
+    HEAT_WRITE = 1 << 2
+};
+
+// run each rom of the corpus for cycles cycles, with random keys pressed and
+// the quirk profile called quirks, print a summary of their memory usage
+// and write the map to path. Copies of a rom and the roms that can't be
+// loaded are left out
+void heatmap(const Corpus *corpus, unsigned long cycles, const char *path,
+             const char *quirks);
+
+#endif
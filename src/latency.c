@@ -0,0 +1,145 @@
+/*
+ * Input to photon latency. See latency.h
+ * */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+
+// where the key event being followed is
+enum ProbeStates
+{
+    PROBE_IDLE,
+    PROBE_INPUT,
+    PROBE_OBSERVED,
+    PROBE_DRAWN
+};
+
+static const char *stage_names[LATENCY_STAGES] =
+{
+    "observe", "draw", "present", "total"
+};
+
+static int enabled = 0;
+static char report_path[4096];
+
+static uint8_t state = PROBE_IDLE;
+static uint16_t probe_keys;
+static uint64_t input_ns, observed_ns, drawn_ns;
+
+static uint32_t samples[LATENCY_STAGES][LATENCY_MAX_SAMPLES];  // in us
+static unsigned long samples_count = 0;
+
+static void report_atexit()
+{
+    latency_report();
+}
+
+void latency_init(const char *path)
+{
+    snprintf(report_path, sizeof(report_path), "%s", path);
+    enabled = 1;
+
+    atexit(report_atexit);
+}
+
+void latency_input(uint16_t changed, uint64_t now_ns)
+{
+    if (!enabled || !changed || state != PROBE_IDLE) {
+        return;
+    }
+
+    state = PROBE_INPUT;
+    probe_keys = changed;
+    input_ns = now_ns;
+}
+
+void latency_frame(uint16_t keys_read, uint8_t redraw, uint64_t now_ns)
+{
+    if (state == PROBE_INPUT && (keys_read & probe_keys)) {
+        state = PROBE_OBSERVED;
+        observed_ns = now_ns;
+    }
+
+    if ((state == PROBE_INPUT || state == PROBE_OBSERVED) 
+        && now_ns - input_ns > LATENCY_TIMEOUT_NS) {
+        state = PROBE_IDLE;
+        return;
+    }
+
+    // an opcode in the frame that observed the key may have drawn already
+    if (state == PROBE_OBSERVED && redraw) {
+        state = PROBE_DRAWN;
+        drawn_ns = now_ns;
+    }
+}
+
+void latency_present(uint64_t now_ns)
+{
+    if (state != PROBE_DRAWN) {
+        return;
+    }
+
+    unsigned long index = samples_count % LATENCY_MAX_SAMPLES;
+
+    samples[LATENCY_OBSERVE][index] = (observed_ns - input_ns) / 1000;
+    samples[LATENCY_DRAW][index] = (drawn_ns - observed_ns) / 1000;
+    samples[LATENCY_PRESENT][index] = (now_ns - drawn_ns) / 1000;
+    samples[LATENCY_TOTAL][index] = (now_ns - input_ns) / 1000;
+    ++samples_count;
+
+    state = PROBE_IDLE;
+}
+
+static int by_value(const void *a, const void *b)
+{
+    uint32_t va = *(const uint32_t *) a;
+    uint32_t vb = *(const uint32_t *) b;
+
+    return (va > vb) - (va < vb);
+}
+
+void latency_report()
+{
+    static uint32_t sorted[LATENCY_MAX_SAMPLES];
+    unsigned long count = samples_count < LATENCY_MAX_SAMPLES 
+                          ? samples_count : LATENCY_MAX_SAMPLES;
+    unsigned int stage;
+
+    if (!enabled) {
+        return;
+    }
+    enabled = 0;
+
+    FILE *out = strcmp(report_path, "-") ? fopen(report_path, "w") : stderr;
+    if (out == NULL) {
+        perror("chip8: ");
+        return;
+    }
+
+    fprintf(out, "%-8s %8s %10s %10s %10s\n", 
+            "stage", "samples", "p50_us", "p99_us", "max_us");
+    for (stage = 0; stage < LATENCY_STAGES; ++stage)
+    {
+        uint32_t p50 = 0, p99 = 0, max = 0;
+
+        if (count) {
+            memcpy(sorted, samples[stage], count * sizeof(sorted[0]));
+            qsort(sorted, count, sizeof(sorted[0]), by_value);
+
+            p50 = sorted[(count - 1) * 50 / 100];
+            p99 = sorted[(count - 1) * 99 / 100];
+            max = sorted[count - 1];
+        }
+
+        fprintf(out, "%-8s %8lu %10u %10u %10u\n", stage_names[stage], count,
+                p50, p99, max);
+    }
+
+    if (out != stderr) {
+        fclose(out);
+    }
+}
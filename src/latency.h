@@ -0,0 +1,50 @@
+/*
+ * Input to photon latency. Key events are timestamped when they are read 
+ * from SDL, and followed through the first frame in which an opcode(EX9E,
+ * EXA1 or FX0A) looks at the key, the first frame after that in which the 
+ * screen changes, and the present that shows that change.
+ *
+ * Only one key event is followed at a time, the ones that come while it's
+ * in flight aren't measured. The emulator runs all the cycles of a frame at
+ * once, so every stage but the present is measured with the resolution of
+ * a frame's cycles burst
+ * */
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+// samples kept per stage, the oldest are dropped when there are more
+#define LATENCY_MAX_SAMPLES 65536
+
+// a key event that doesn't change the screen in this many ns is dropped, 
+// since the game either ignored it or isn't showing anything for it
+#define LATENCY_TIMEOUT_NS 500000000ULL
+
+enum LatencyStages
+{
+    LATENCY_OBSERVE,             // key event -> opcode looked at the key
+    LATENCY_DRAW,                // opcode looked at the key -> screen changed
+    LATENCY_PRESENT,             // screen changed -> SDL_RenderPresent
+    LATENCY_TOTAL,               // key event -> SDL_RenderPresent
+    LATENCY_STAGES
+};
+
+// start measuring, and write the distribution to path at exit. "-" is 
+// stderr
+void latency_init(const char *path);
+
+// keys changed state at now_ns. changed has a bit set per key
+void latency_input(uint16_t changed, uint64_t now_ns);
+
+// the opcodes of a frame finished running at now_ns. keys_read is the mask
+// of keys they looked at and redraw if they changed the screen
+void latency_frame(uint16_t keys_read, uint8_t redraw, uint64_t now_ns);
+
+// the screen was presented at now_ns
+void latency_present(uint64_t now_ns);
+
+// write p50, p99 and max of each stage, in us, to path
+void latency_report();
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * libchip8. See libchip8.h
+ * */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "libchip8.h"
+
+// snapshots start with it, so restore can tell them apart from garbage
+#define CHIP8_SNAPSHOT_MAGIC 0x43385353     // "SS8C"
+
+_Static_assert(FAULT_COUNT == 7,
+               "a new fault of chip8.h needs a Chip8Status in run_status()");
+_Static_assert(CHIP8_OK == 0 && CHIP8_END == 5 && CHIP8_EXIT == 6,
+               "the values of Chip8Status are part of the abi");
+_Static_assert(CHIP8_WIDTH == WINDOW_WIDTH && CHIP8_HEIGHT == WINDOW_HEIGHT,
+               "libchip8.h and chip8.h disagree on the screen size");
+
+struct Chip8
+{
+    uint32_t magic;
+    cpu cpuData;
+    MemMaps mems;
+    unsigned long frame;                    // frames run since the reset
+    char quirks[16];                        // its profile, for the resets
+    unsigned int rom_size;                  // as given, it's cut to the ram
+    unsigned int rom_loaded;                // of the profile when loaded
+    uint8_t rom[XO_RAM_SIZE - PROG_RAM_START];
+};
+
+Chip8 *chip8_create(void)
+{
+    Chip8 *chip8 = calloc(1, sizeof(Chip8));
+    if (chip8 == NULL) {
+        return NULL;
+    }
+
+    chip8->magic = CHIP8_SNAPSHOT_MAGIC;
+    strcpy(chip8->quirks, "default");
+    chip8_reset(chip8, 0);
+
+    return chip8;
+}
+
+void chip8_destroy(Chip8 *chip8)
+{
+    free(chip8);
+}
+
+size_t chip8_load_rom(Chip8 *chip8, const void *rom, size_t size)
+{
+    if (size > sizeof(chip8->rom)) {
+        size = sizeof(chip8->rom);
+    }
+
+    memcpy(chip8->rom, rom, size);
+    chip8->rom_size = size;
+    chip8_reset(chip8, 0);
+
+    return chip8->rom_loaded;
+}
+
+int chip8_set_quirks(Chip8 *chip8, const char *name)
+{
+    if (strlen(name) >= sizeof(chip8->quirks) || !quirks_exist(name)) {
+        return 0;
+    }
+
+    strcpy(chip8->quirks, name);
+    chip8_reset(chip8, 0);
+    return 1;
+}
+
+void chip8_reset(Chip8 *chip8, uint32_t seed)
+{
+    initialize(&chip8->cpuData, &chip8->mems, chip8->quirks);
+    chip8->rom_loaded = load_rom(chip8->rom, chip8->rom_size, &chip8->mems);
+
+    if (seed) {
+        chip8->cpuData.rng = seed;
+    }
+    chip8->frame = 0;
+}
+
+// the Chip8Status of the fault an opcode raised, CHIP8_OK if the run can
+// go on
+static int run_status(cpu *cpuData)
+{
+    switch ((enum Faults) cpuData->fault)
+    {
+        case FAULT_NONE:
+        case FAULT_COUNT:
+            return CHIP8_OK;
+        case FAULT_WATCH:
+            // only the frontend sets watchpoints, and the opcode that hits 
+            // one did run, so there's nothing to stop for
+            return CHIP8_OK;
+        case FAULT_STACK_OVERFLOW:
+            return CHIP8_STACK_OVERFLOW;
+        case FAULT_STACK_UNDERFLOW:
+            return CHIP8_STACK_UNDERFLOW;
+        case FAULT_RAM_OVERRUN:
+            return CHIP8_RAM_OVERRUN;
+        case FAULT_PC_OVERRUN:
+            return CHIP8_PC_OVERRUN;
+        case FAULT_EXIT:
+            // back on the 00FD, so the machine stays ended
+            cpuData->pc -= 2;
+            return CHIP8_EXIT;
+    }
+
+    return CHIP8_OK;
+}
+
+int chip8_run_cycles(Chip8 *chip8, unsigned long cycles)
+{
+    cpu *cpuData = &chip8->cpuData;
+    int status;
+
+    for (; cycles; --cycles)
+    {
+        if (cpuData->pc > chip8->rom_loaded + PROG_RAM_START) {
+            return CHIP8_END;
+        }
+
+        if (step(cpuData, &chip8->mems) != FAULT_NONE) {
+            status = run_status(cpuData);
+            if (status != CHIP8_OK) {
+                return status;
+            }
+        }
+    }
+
+    return CHIP8_OK;
+}
+
+int chip8_run_frames(Chip8 *chip8, unsigned long frames)
+{
+    int status;
+
+    for (; frames; --frames)
+    {
+        // keys_read only matters to the latency probes of the frontend, but
+        // it's kept the same way so both see the same machine
+        chip8->mems.keys_read = 0;
+
+        status = chip8_run_cycles(chip8, frame_cycles(&chip8->mems,
+                                                      chip8->frame));
+        if (status != CHIP8_OK) {
+            return status;
+        }
+
+        timers_step(&chip8->cpuData);
+        ++chip8->frame;
+    }
+
+    return CHIP8_OK;
+}
+
+void chip8_set_keys(Chip8 *chip8, uint16_t keys)
+{
+    uint8_t key;
+
+    for (key = 0; key < 16; ++key)
+    {
+        chip8->mems.keys[key] = (keys >> key) & 1;
+    }
+}
+
+const uint64_t *chip8_get_framebuffer(Chip8 *chip8, int *changed)
+{
+    if (changed != NULL) {
+        *changed = chip8->mems.redraw;
+        chip8->mems.redraw = 0;
+    }
+
+    return chip8->mems.screen[0];
+}
+
+int chip8_hires(const Chip8 *chip8)
+{
+    return chip8->mems.hires;
+}
+
+size_t chip8_snapshot_size(void)
+{
+    return sizeof(Chip8);
+}
+
+void chip8_snapshot(const Chip8 *chip8, void *buffer)
+{
+    memcpy(buffer, chip8, sizeof(Chip8));
+}
+
+int chip8_restore(Chip8 *chip8, const void *buffer)
+{
+    uint32_t magic;
+
+    // buffer may not be aligned like a Chip8
+    memcpy(&magic, buffer, sizeof(magic));
+    if (magic != CHIP8_SNAPSHOT_MAGIC) {
+        return 0;
+    }
+
+    memcpy(chip8, buffer, sizeof(Chip8));
+    return 1;
+}
@@ -0,0 +1,101 @@
+/*
+ * libchip8: the chip8 machine as a library, for programs that want to run
+ * it on their own terms, like test harnesses, or python through ctypes.
+ *
+ * Every machine lives behind its own handle, its quirk profile and clock
+ * included, so the machines of a process can run different profiles at once
+ * and from different threads: the library writes no global state, and
+ * doesn't use SDL. Once a rom is loaded, running cycles or frames,
+ * setting keys, reading the screen and taking or restoring snapshots don't
+ * allocate memory nor make syscalls, only chip8_create(), chip8_load_rom(),
+ * chip8_set_quirks() and chip8_reset() do.
+ *
+ * Frames are timed by the caller: chip8_run_frames() runs a frame's worth of
+ * cycles and ticks the timers once per frame, as fast as it can
+ * */
+#ifndef LIBCHIP8_H
+#define LIBCHIP8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the functions below are the only symbols libchip8.so exports, the rest
+// of the machine is built with -fvisibility=hidden
+#define CHIP8_API __attribute__((visibility("default")))
+
+#define CHIP8_WIDTH 64
+#define CHIP8_HEIGHT 32
+
+// what stopped a run. The faults leave the machine as it was before the 
+// opcode that raised them. The library sets no watchpoints, so there's no
+// status for them
+enum Chip8Status
+{
+    CHIP8_OK,
+    CHIP8_STACK_OVERFLOW,        // CALL with a full stack
+    CHIP8_STACK_UNDERFLOW,       // RET with an empty stack
+    CHIP8_RAM_OVERRUN,           // FX33, FX55, FX65 or DXYN past the ram end
+    CHIP8_PC_OVERRUN,            // pc points outside of ram
+    CHIP8_END,                   // pc went past the end of the rom
+    CHIP8_EXIT                   // 00FD of the schip and xochip profiles,
+                                 // the program ended. pc stays on the 00FD,
+                                 // so the machine keeps returning it until
+                                 // it's reset
+};
+
+typedef struct Chip8 Chip8;
+
+// create a machine with no rom, running the original chip8. Return NULL if
+// there's no memory for it
+CHIP8_API Chip8 *chip8_create(void);
+
+CHIP8_API void chip8_destroy(Chip8 *chip8);
+
+// copy rom into the machine and reset it with a random seed. Return the 
+// amount of bytes loaded, roms bigger than the program ram are cut
+CHIP8_API size_t chip8_load_rom(Chip8 *chip8, const void *rom, size_t size);
+
+// make the machine behave like another interpreter: "vip", "chip48",
+// "schip", "modern", "xochip", or "default" for the original chip8, as the
+// -Q option of the emulator does. The machine is reset, and a rom that
+// didn't fit in the ram of the last profile is loaded again, whole if it
+// fits now. Return 0, leaving the machine as it was, if there's no profile
+// with that name
+CHIP8_API int chip8_set_quirks(Chip8 *chip8, const char *name);
+
+// bring the machine back to the state right after the rom was loaded. seed
+// is the state of the random number generator, 0 for a random one
+CHIP8_API void chip8_reset(Chip8 *chip8, uint32_t seed);
+
+// run at most cycles opcodes. Return CHIP8_OK if all of them ran
+CHIP8_API int chip8_run_cycles(Chip8 *chip8, unsigned long cycles);
+
+// run at most frames frames, each one being 1/60 of a second worth of 
+// opcodes followed by a timers tick. Return CHIP8_OK if all of them ran
+CHIP8_API int chip8_run_frames(Chip8 *chip8, unsigned long frames);
+
+// set the keys held down, bit n being key n
+CHIP8_API void chip8_set_keys(Chip8 *chip8, uint16_t keys);
+
+// return the screen, CHIP8_HEIGHT rows of CHIP8_WIDTH pixels, 1 bit each, 
+// each row a word with its leftmost pixel in the msb. The pointer stays 
+// valid until the machine is destroyed. If changed isn't NULL, it's set to 
+// whether the screen changed since the last call. In the high resolution of
+// the schip and xochip profiles, see chip8_hires(), there are twice the rows
+// and each is 2 words, and it's the first of the planes of the xochip
+CHIP8_API const uint64_t *chip8_get_framebuffer(Chip8 *chip8, int *changed);
+
+// whether the screen is in the 128x64 high resolution
+CHIP8_API int chip8_hires(const Chip8 *chip8);
+
+// size of the buffers used by chip8_snapshot() and chip8_restore()
+CHIP8_API size_t chip8_snapshot_size(void);
+
+// copy the whole machine, rom included, to buffer
+CHIP8_API void chip8_snapshot(const Chip8 *chip8, void *buffer);
+
+// bring the machine back to the snapshot in buffer. Return 0 if buffer 
+// doesn't hold a snapshot of this version of the library
+CHIP8_API int chip8_restore(Chip8 *chip8, const void *buffer);
+
+#endif
@@ -0,0 +1,630 @@
+/*
+ * The chip8 program: the SDL frontend, and the fuzzing, heatmap and 
+ * profiling tools, over the machine in chip8.c
+ * */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "graphics.h"
+#include "fuzz.h"
+#include "heatmap.h"
+#include "trace.h"
+#include "telemetry.h"
+#include "latency.h"
+#include "export.h"
+#include "server.h"
+#include "record.h"
+#include "debug.h"
+#include "romcache.h"
+#include "corpus.h"
+#include "audio.h"
+#include "conform.h"
+#include "workloads.h"
+#include "cfg.h"
+#include "control.h"
+#include "pacing.h"
+
+// the chip8-profile build variant runs every opcode through the profiler,
+// the normal build doesn't even know it exists
+#ifdef CHIP8_PROFILE
+#include "profile.h"
+#define STEP profile_step
+#else
+#define STEP step
+#endif
+
+// drain what's left of the traces when the process exits
+static void trace_finish()
+{
+    trace_stop();
+    trace_dump(stderr);
+    trace_summary(stderr);
+}
+
+static uint64_t timespec_ns(struct timespec *time)
+{
+    return (uint64_t) time->tv_sec * 1000000000 + time->tv_nsec;
+}
+
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return timespec_ns(&now);
+}
+
+// when main() started, the cold start is measured from there
+static uint64_t process_start_ns;
+
+static void usage()
+{
+    fprintf(stderr, "usage: ./chip8 [-F cases [-n cycles] [-s seed]] "
+                    "[-P report] [-L latency] [-X] [-R recording] [-D] "
+                    "[-Q quirks] [-A samples] [-c socket] <game>\n"
+                    "       ./chip8 -c socket [options]\n"
+                    "       ./chip8 -H heatmap [-n cycles] <game|dir|tar>...\n"
+                    "       ./chip8 -C <game|dir|tar>...\n"
+                    "       ./chip8 -G report <game|dir|tar>...\n"
+                    "       ./chip8 -V dir [-u] [-T workers]\n"
+                    "       ./chip8 -W [-n cycles] [-Q quirks] [game]...\n"
+                    "       ./chip8 -S socket [-T threads] <game>\n"
+                    "       ./chip8 -E recording <out.gif|out>\n"
+                    "quirks: vip, chip48, schip, modern or xochip\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    uint game_size;
+    unsigned long fuzz_cases = 0;
+    unsigned long cycles = 0;
+    uint32_t fuzz_seed = 1;
+#ifdef CHIP8_PROFILE
+    char *profile_path = "chip8-profile";
+#endif
+    char *heatmap_path = NULL;
+    char *cfg_path = NULL;
+    char *control_path = NULL;
+    char *server_path = NULL;
+    char *export_path = NULL;
+    unsigned int server_threads = SERVER_DEFAULT_THREADS;
+    unsigned int audio_samples = AUDIO_DEFAULT_SAMPLES;
+    char *conform_dir = NULL;
+    const char *quirks = "default";         // of the machines started, -Q
+    unsigned int workers = 0;
+    int update = 0;
+    int catalog = 0;
+    int training = 0;
+    int opt;
+
+    process_start_ns = monotonic_ns();
+
+    while ((opt = getopt(argc, argv, "F:n:s:P:H:L:XS:T:R:E:DQ:CA:V:uWG:c:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'F':
+                fuzz_cases = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                cycles = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                fuzz_seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'P':
+#ifdef CHIP8_PROFILE
+                profile_path = optarg;
+                break;
+#else
+                fprintf(stderr, "chip8: -P needs the chip8-profile build, "
+                        "make profile\n");
+                exit(1);
+#endif
+            case 'H':
+                heatmap_path = optarg;
+                break;
+            case 'L':
+                latency_init(optarg);
+                break;
+            case 'X':
+                if (!export_init()) {
+                    exit(1);
+                }
+                break;
+            case 'S':
+                server_path = optarg;
+                break;
+            case 'T':
+                server_threads = workers = strtoul(optarg, NULL, 0);
+                break;
+            case 'R':
+                if (!record_init(optarg)) {
+                    exit(1);
+                }
+                break;
+            case 'E':
+                export_path = optarg;
+                break;
+            case 'D':
+                debug_init();
+                break;
+            case 'C':
+                catalog = 1;
+                break;
+            case 'A':
+                audio_samples = strtoul(optarg, NULL, 0);
+                break;
+            case 'V':
+                conform_dir = optarg;
+                break;
+            case 'u':
+                update = 1;
+                break;
+            case 'W':
+                training = 1;
+                break;
+            case 'G':
+                cfg_path = optarg;
+                break;
+            case 'c':
+                control_path = optarg;
+                break;
+            case 'Q':
+                if (!quirks_exist(optarg)) {
+                    fprintf(stderr, "chip8: no quirk profile %s\n", optarg);
+                    usage();
+                }
+                quirks = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if (training) {
+        return !train(argv + optind, argc - optind,
+                      cycles ? cycles : TRAIN_DEFAULT_CYCLES, quirks);
+    }
+
+    if (conform_dir != NULL) {
+        return conform(conform_dir, workers, update) != 0;
+    }
+
+    if ((heatmap_path != NULL || cfg_path != NULL || catalog)
+        && optind < argc) {
+        Corpus *corpus = corpus_open();
+
+        if (corpus == NULL) {
+            fprintf(stderr, "chip8: no memory for the corpus\n");
+            return 1;
+        }
+
+        for (; optind < argc; ++optind)
+        {
+            corpus_add(corpus, argv[optind]);
+        }
+
+        int written = 1;
+        if (catalog) {
+            corpus_print(corpus, stdout);
+        } else if (cfg_path != NULL) {
+            written = cfg(corpus, cfg_path);
+        } else {
+            atexit(trace_finish);
+            heatmap(corpus, cycles ? cycles : HEATMAP_DEFAULT_CYCLES,
+                    heatmap_path, quirks);
+        }
+        corpus_close(corpus);
+        return !written;
+    }
+
+    if (export_path != NULL && optind == argc - 1) {
+        return !record_export(export_path, argv[optind]);
+    }
+
+    // the warm start mode can start without a game, see control.h
+    int no_game = optind == argc && control_path != NULL && !fuzz_cases
+                  && server_path == NULL;
+
+    // initialize interpreter and load game into memory
+    if (optind == argc - 1 || no_game) {
+        cpu cpuData;
+        MemMaps mems;
+        
+        // initialize general variables and arrays to the desired values
+        initialize(&cpuData, &mems, quirks);
+
+        // open game and load it in memory
+        game_size = no_game ? 0 : load_game(argv[optind], &mems);
+
+        if (fuzz_cases) {
+            fuzz(game_size, &cpuData, &mems, fuzz_cases,
+                 cycles ? cycles : FUZZ_DEFAULT_CYCLES, fuzz_seed);
+            return 0;
+        }
+
+        if (server_path != NULL) {
+            trace_start(stderr);
+            atexit(trace_finish);
+
+            // the sessions load the game from the ram of this machine
+            server(server_path, mems.ram + PROG_RAM_START, game_size,
+                   server_threads ? server_threads : 1, quirks);
+            return 1;
+        }
+
+#ifdef CHIP8_PROFILE
+        profile_init(&mems, profile_path);
+#endif
+
+        // warnings are written by a thread of their own, so they don't slow
+        // down the emulation
+        trace_start(stderr);
+        atexit(trace_finish);
+
+	    char *game_name = no_game ? "chip8" : argv[optind];
+        // start window using sdl 
+        init_win(game_name, WINDOW_SCALLING);
+        audio_init(audio_samples);
+        pacing_init();
+
+        if (control_path != NULL && !control_listen(control_path)) {
+            exit(1);
+        }
+
+        // start cpu emulation
+        emulate(game_size, &cpuData, &mems);
+
+        audio_close();
+        close_win();
+
+#ifdef CHIP8_PROFILE
+        // the machine goes away with this scope, report while it's still here
+        profile_report();
+#endif
+    } else {
+        usage();
+    }
+}
+
+// read the rom at game_name into rom, of size bytes. Return the bytes read,
+// -1 after saying why if it can't be read
+static int read_game(const char *game_name, uint8_t *rom, uint size)
+{
+    FILE *filep = fopen(game_name, "r");
+
+    if (filep == NULL) {
+        fprintf(stderr, "chip8: %s: %s\n", game_name, strerror(errno));
+        return -1;
+    }
+
+    // anything past what fits in ram is ignored by load_rom() anyway
+    uint bread = (uint) fread(rom, sizeof(char), size, filep);
+
+    if(ferror(filep)) {
+        fprintf(stderr, "chip8: error reading file\n");
+        fclose(filep);
+        return -1;
+    }
+    fclose(filep);
+
+    return bread;
+}
+
+// what the commands of the control queue change in the loop of emulate()
+typedef struct LoopState
+{
+    uint game_size;
+    int paused;
+    unsigned long steps;         // opcodes left to step while paused
+    char quirks[CONTROL_PATH_SIZE];
+                                 // profile of the next rom
+    unsigned int clock_hz;       // of the clock command, 0 for the profile's,
+                                 // kept over roms and states
+    uint64_t start_ns;           // when the rom being started was asked for,
+    const char *start_kind;      // until its first present
+} LoopState;
+
+// reset the machine and load the rom at path, with the profile asked for.
+// Return 0, leaving the machine as it was, if it can't be read
+static int switch_game(const char *path, LoopState *state, cpu *cpuData,
+                       MemMaps *mems)
+{
+    static uint8_t rom[XO_RAM_SIZE - PROG_RAM_START];
+    int bread = read_game(path, rom, sizeof(rom));
+
+    if (bread == -1) {
+        return 0;
+    }
+
+    if (!initialize(cpuData, mems, state->quirks)) {
+        fprintf(stderr, "chip8: no quirk profile %s\n", state->quirks);
+        return 0;
+    }
+
+    state->game_size = load_rom(rom, bread, mems);
+    set_clock_hz(mems, state->clock_hz);
+    if (debug_enabled()) {
+        romcache_open(rom, state->game_size, mems);
+        debug_rearm(mems);
+    }
+    set_title(path);
+
+    // a fresh machine runs, whatever the last one was doing
+    state->paused = 0;
+    state->steps = 0;
+    mems->redraw = 1;
+    return 1;
+}
+
+// run a command of the control queue. Return 0 if the emulation has to end
+static int control_run(const ControlCommand *command, LoopState *state,
+                       cpu *cpuData, MemMaps *mems)
+{
+    switch (command->type)
+    {
+        case CONTROL_PAUSE:
+        case CONTROL_RESUME:
+            state->paused = command->type == CONTROL_PAUSE;
+            state->steps = 0;
+            break;
+        case CONTROL_STEP:
+            state->paused = 1;
+            state->steps += command->arg;
+            break;
+        case CONTROL_CLOCK:
+            state->clock_hz = command->arg;
+            set_clock_hz(mems, state->clock_hz);
+            break;
+        case CONTROL_SAVE:
+            state_save(command->path, cpuData, mems, state->game_size);
+            break;
+        case CONTROL_LOAD:
+            if (state_load(command->path, cpuData, mems, &state->game_size)) {
+                set_clock_hz(mems, state->clock_hz);
+                mems->redraw = 1;
+            }
+            break;
+        case CONTROL_ROM:
+            if (switch_game(command->path, state, cpuData, mems)) {
+                state->start_ns = command->queued_ns;
+                state->start_kind = "rom switch";
+            }
+            break;
+        case CONTROL_QUIRKS:
+            strcpy(state->quirks, command->path);
+            break;
+        case CONTROL_SHUTDOWN:
+            return 0;
+    }
+
+    return 1;
+}
+
+// the rom ended or faulted. Return 0 if the emulation ends with it, in warm
+// start mode the machine is paused until another rom is loaded instead
+static int rom_ended(LoopState *state)
+{
+    if (!control_active()) {
+        return 0;
+    }
+
+    fprintf(stderr, "chip8: the rom ended, waiting for another one\n");
+    state->paused = 1;
+    state->steps = 0;
+    return 1;
+}
+
+void emulate(uint game_size, cpu *cpuData, MemMaps *memoryMaps)
+{
+    FrameReport report;
+    ControlCommand command;
+    unsigned long frame;
+    unsigned int cycle, cycles;
+    LoopState state = { .game_size = game_size, .start_kind = "cold start",
+                        .start_ns = process_start_ns };
+
+    // without a rom, in warm start mode, wait for one. Outside of it an
+    // empty rom runs off its end as it always did
+    state.paused = game_size == 0 && control_active();
+
+    // the roms of the control socket keep the profile of this one, until a
+    // quirks command picks another
+    strcpy(state.quirks, machine_quirks(memoryMaps));
+
+    // the screen changed and wasn't presented yet. The first frame is
+    // presented whatever the rom does, it's where the start is measured
+    int pending = 1;
+
+    // when the current frame should have started, and when it did
+    struct timespec deadline, frameStart;
+    uint64_t lastStart = 0;
+
+    Telemetry *telemetry = telemetry_open();
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    for (frame = 0; ; ++frame)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &frameStart);
+        report.jitter_ns = lastStart 
+                           ? (int64_t) (timespec_ns(&frameStart) - lastStart)
+                             - TIMERS_HZ_NS 
+                           : 0;
+        lastStart = timespec_ns(&frameStart);
+
+        uint16_t changed = set_keys(memoryMaps->keys);
+        changed |= export_keys(memoryMaps->keys);
+        if (changed) {
+            latency_input(changed, monotonic_ns());
+        }
+        memoryMaps->keys_read = 0;
+
+        // the commands only run between frames, the opcodes never see them
+        while (control_next(&command))
+        {
+            if (!control_run(&command, &state, cpuData, memoryMaps)) {
+                telemetry_close(telemetry);
+                return;
+            }
+        }
+
+        cycles = frame_cycles(memoryMaps, frame);
+
+        // paused, only the opcodes asked for run, as fast as the clock goes
+        if (state.paused) {
+            cycles = state.steps < cycles ? state.steps : cycles;
+            state.steps -= cycles;
+        }
+
+        // breakpoints and steps are only looked at by the loop of the 
+        // debugger, so this one is the same with or without it
+        if (debug_armed) {
+            if (!debug_cycles(cpuData, memoryMaps, cycles, state.game_size)) {
+                telemetry_close(telemetry);
+                return;
+            }
+        } else {
+            for (cycle = 0; cycle < cycles; ++cycle)
+            {
+                if (cpuData->pc > state.game_size + PROG_RAM_START) {
+                    if (rom_ended(&state)) {
+                        break;
+                    }
+                    telemetry_close(telemetry);
+                    return;
+                }
+
+                if (STEP(cpuData, memoryMaps) != FAULT_NONE) {
+                    if (cpuData->fault == FAULT_EXIT) {
+                        if (rom_ended(&state)) {
+                            break;
+                        }
+                        telemetry_close(telemetry);
+                        return;
+                    }
+
+                    trace(TRACE_ERROR, TRACE_FAULT, cpuData->pc, 
+                          cpuData->fault, 0);
+                    fprintf(stderr, "chip8: %s at %#X\n",
+                            fault_name(cpuData->fault), cpuData->pc);
+                    if (debug_fault(cpuData, memoryMaps)
+                        || rom_ended(&state)) {
+                        break;
+                    }
+                    telemetry_close(telemetry);
+                    exit(1);
+                }
+            }
+        }
+
+        if (state.paused) {
+            audio_silence(memoryMaps);
+        } else {
+            audio_tick(cpuData, memoryMaps);
+            timers_step(cpuData);
+        }
+        latency_frame(memoryMaps->keys_read, memoryMaps->redraw, 
+                      monotonic_ns());
+
+        // every screen is recorded, presented or not
+        if (memoryMaps->redraw) {
+            uint64_t rows[WINDOW_HEIGHT];
+
+            screen_lores(memoryMaps, rows);
+            record_frame(frame, rows);
+            memoryMaps->redraw = 0;
+            pending = 1;
+        }
+
+        report.presents = 0;
+        if (pending && pacing_present() == PACING_PRESENT) {
+            update_window(memoryMaps);
+            latency_present(monotonic_ns());
+            pending = 0;
+            report.presents = 1;
+
+            if (state.start_ns && control_active()) {
+                fprintf(stderr, "chip8: %s presented in %.2f ms\n",
+                        state.start_kind,
+                        (monotonic_ns() - state.start_ns) / 1000000.0);
+            }
+            state.start_ns = 0;
+        }
+
+        export_frame(frame, lastStart, cpuData, memoryMaps);
+
+        uint64_t busy = monotonic_ns() - lastStart;
+        report.overshoot_ns = frame_wait(&deadline);
+        pacing_frame(busy, report.overshoot_ns);
+
+        report.now_ns = lastStart;
+        report.instructions = cycles;
+        report.unknown_opcodes = cpuData->unknown;
+        report.pc = cpuData->pc;
+        report.skipped_catchup = pacing_skipped(PACING_CATCHUP);
+        report.skipped_interval = pacing_skipped(PACING_INTERVAL);
+        report.dropped = pacing_dropped();
+        report.present_interval = pacing_interval();
+        telemetry_frame(telemetry, &report);
+    }
+}
+
+int64_t frame_wait(struct timespec *deadline)
+{
+    struct timespec now;
+
+    deadline->tv_nsec += TIMERS_HZ_NS;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_nsec -= 1000000000;
+        ++deadline->tv_sec;
+    }
+
+    // sleep until an absolute time, so the time spent running the frame
+    // and any sleep overshoot don't add up from one frame to the next
+    int error;
+    while ((error = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, 
+                                    deadline, NULL)) == EINTR);
+    if (error) {
+        fprintf(stderr, "chip8: %s\n", strerror(error));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t overshoot = (int64_t) timespec_ns(&now) - timespec_ns(deadline);
+
+    // the frames missed run back to back, without presenting, until the
+    // loop is on time again. Too far behind, drop them instead of running
+    // them all at once, see pacing.h
+    if (overshoot > PACING_MAX_CATCHUP * TIMERS_HZ_NS) {
+        pacing_drop(overshoot / TIMERS_HZ_NS);
+        *deadline = now;
+    }
+
+    return overshoot;
+}
+
+uint load_game(char *game_name, MemMaps *mems)
+{
+    static uint8_t rom[XO_RAM_SIZE - PROG_RAM_START];
+    int bread = read_game(game_name, rom, sizeof(rom));
+
+    if (bread == -1) {
+        exit(1);
+    }
+
+    uint size = load_rom(rom, bread, mems);
+
+    // the debugger shows what the analysis found, the rest run without it
+    if (debug_enabled()) {
+        romcache_open(rom, size, mems);
+    }
+    return size;
+}
@@ -10,7 +10,7 @@
 
 #include "chip8.h"
 #include "opcodes.h"
-#include "graphics.h"
+#include "trace.h"
 
 //******************************************************************************
 //*                             hardware functions                             *
@@ -67,10 +67,10 @@ static void (*generalop[]) (uint16_t opcode, cpu *cpuData, MemMaps *mem) =
     msbisf
 };*/
 
-/*  TODO: Some of the instructions implemented here are not compatible with the
- * S-CHIP implementation, and hence need some tweaks to compute things the way the 
- * program expects, so we should actually make a command-line option for doing
- * that 
+/*  Some of the instructions implemented here behaved differently on each
+ * interpreter, so they come in variants, one per behavior, and the quirk
+ * profiles in chip8.c pick a variant of each for their tables. See 
+ * initialize()
  */
 
 // data registers functions
@@ -107,20 +107,12 @@ void vxaddvy(uint16_t opcode, cpu *cpuData, MemMaps *mem)
     uint8_t *vx = &cpuData->regs[offset2(opcode)];
     uint8_t *vy = &cpuData->regs[offset3(opcode)];
 
-    uint8_t result = *vx + *vy;
+    // VF is written last, so that 8FY4 leaves the carry in it and not the 
+    // sum, and 8XF4 adds VF before it changes
+    uint8_t carry = *vx + *vy > 0xFF;
 
-    // we probably don't need to perform the second result check, but as 
-    // soon as the first one passes, the other shouldn't be performed
-    if (((*vx) > 0) && ((*vy) > 0) && (result < (*vx) || result < (*vy))) {
-        cpuData->regs[0xf] = 1;
-    } else { 
-        cpuData->regs[0xf] = 0;
-    }
-
-    // change data at the address pointed to by vx. First we get the address at 
-    // which vx is stored, then we deference it and store the result of the 
-    // addition
-    *vx = result;
+    *vx = *vx + *vy;
+    cpuData->regs[0xf] = carry;
 }
 
 void vxsubvy(uint16_t opcode, cpu *cpuData, MemMaps *mem)
@@ -132,14 +124,11 @@ void vxsubvy(uint16_t opcode, cpu *cpuData, MemMaps *mem)
     // (vx - vy), then we set the register vf to be NOT borrow.
     //
     // If there is a borrow, vf is set to 0.
-    // If there isn't a borrow, vf is set to 1
-    if ((*vy) > (*vx)) {
-        cpuData->regs[0xf] = 0;
-    } else {
-        cpuData->regs[0xf] = 1;
-    }
+    // If there isn't a borrow, vf is set to 1. As in vxaddvy, it's set last
+    uint8_t not_borrow = *vy <= *vx;
 
     *vx = *vx - *vy;
+    cpuData->regs[0xf] = not_borrow;
 }
 
 void vysubvx(uint16_t opcode, cpu *cpuData, MemMaps *mem)
@@ -151,13 +140,10 @@ void vysubvx(uint16_t opcode, cpu *cpuData, MemMaps *mem)
     // (vy - vx), then we set the register vf to NOT(borrow). 
     // If there is a borrow, vf is set to 0.
     // If there isn't a borrow, vf is set to 1
-    if (*vx > *vy) {
-        cpuData->regs[0xf] = 0;
-    } else {
-        cpuData->regs[0xf] = 1;
-    }
+    uint8_t not_borrow = *vx <= *vy;
 
     *vx = *vy - *vx;
+    cpuData->regs[0xf] = not_borrow;
 }
 
 // TODO: change the names of variables and maybe of functions
@@ -185,38 +171,60 @@ void vxxorvy(uint16_t opcode, cpu *cpuData, MemMaps *mem)
     cpuData->regs[x] = cpuData->regs[x] ^ cpuData->regs[y];
 }
 
-void shr(uint16_t opcode, cpu *cpuData, MemMaps *mem)
-{
-    uint8_t *vx = &cpuData->regs[offset2(opcode)];
-
-    // set vf to 1 if lsb of vx is 1 and 0 if the lsb is 0
-    cpuData->regs[0xf] = *vx & 0x01;
-
-    *vx = *vx >> 1;
+// the COSMAC VIP did the logic opcodes in its alu, which left VF at 0
 
-    //cpuData->regs[0xf] = cpuData->regs[vy] & 0x01; 
+void vxorvy_vf(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    vxorvy(opcode, cpuData, mem);
+    cpuData->regs[0xf] = 0;
 }
 
-// TODO: implementing the s-chip instruction, add command-line option to
-// change it if needed
-void shl(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+void vxandvy_vf(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
-    uint8_t *vx = &cpuData->regs[offset2(opcode)];
+    vxandvy(opcode, cpuData, mem);
+    cpuData->regs[0xf] = 0;
+}
 
-    // store msb of vx in vf. 0x80 = 0b10000000
-    cpuData->regs[0xf] = (*vx & 0x80) >> 7;
+void vxxorvy_vf(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    vxxorvy(opcode, cpuData, mem);
+    cpuData->regs[0xf] = 0;
+}
 
-    // shift vx to the right by 1.
-    *vx = *vx << 1;
+// 8XY6 and 8XYE shift VX on the CHIP-48 and later, and VY into VX on the 
+// COSMAC VIP. Each variant is written out by this macro with left and 
+// from_vy as constants, so there's no branch left in any of them, even
+// without optimizations
+#define SHIFT_OP(name, left, from_vy)                                       \
+void name(uint16_t opcode, cpu *cpuData, MemMaps *mem)                      \
+{                                                                           \
+    uint8_t *vx = &cpuData->regs[offset2(opcode)];                          \
+    uint8_t value = (from_vy) ? cpuData->regs[offset3(opcode)] : *vx;       \
+                                                                            \
+    /* VF last, as in vxaddvy */                                            \
+    if (left) {                                                             \
+        /* store msb of the value in vf. 0x80 = 0b10000000 */               \
+        *vx = value << 1;                                                   \
+        cpuData->regs[0xf] = (value & 0x80) >> 7;                           \
+    } else {                                                                \
+        /* set vf to 1 if lsb of the value is 1 and 0 if it's 0 */          \
+        *vx = value >> 1;                                                   \
+        cpuData->regs[0xf] = value & 0x01;                                  \
+    }                                                                       \
 }
 
+SHIFT_OP(shr, 0, 0)
+SHIFT_OP(shr_vy, 0, 1)
+SHIFT_OP(shl, 1, 0)
+SHIFT_OP(shl_vy, 1, 1)
+
 
 // TODO: rewrite when possible
 void vxandrand(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
     uint8_t x = offset2(opcode);             // register index
     uint8_t mask = opcode & 0x00ff;  // mask value
-    uint8_t rand = randnum();                 // random number
+    uint8_t rand = randnum(cpuData);          // random number
 
     cpuData->regs[x] = rand & mask;
 }
@@ -249,15 +257,21 @@ void jmpaddv0(uint16_t opcode, cpu *cpuData, MemMaps *mem)
     cpuData->pc = addr;
 }
 
+void jmpaddvx(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    // the CHIP-48 read BNNN as BXNN, the register being the first digit 
+    // of the address
+    cpuData->pc = (opcode & 0x0fff) + cpuData->regs[offset2(opcode)];
+}
+
 // subroutines
 
 void call(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
 
-    // subtract 1 because of array displacement
-    if (cpuData->sp >= (STACK_SIZE - 1)) {
-        fprintf(stderr, "chip8: Stack overflow\n");
-        exit(1);
+    if (cpuData->sp >= STACK_SIZE) {
+        cpuData->fault = FAULT_STACK_OVERFLOW;
+        return;
     }
 
     // push the current pc to the stack
@@ -269,6 +283,11 @@ void call(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 
 void ret(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
+    if (cpuData->sp == 0) {
+        cpuData->fault = FAULT_STACK_UNDERFLOW;
+        return;
+    }
+
     // pop the last value stored in the stack
     --cpuData->sp;
     cpuData->pc = cpuData->stack[cpuData->sp];
@@ -345,20 +364,36 @@ void set_st(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 }
 
 
-// TODO: rewrite this function and the functions handling input on the sdl side
-
 void vx_to_key(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
     uint8_t x = offset2(opcode);
-    cpuData->regs[x] = waitkey();
+    uint8_t key;
+
+    // every key is looked at
+    mem->keys_read = 0xFFFF;
+
+    for (key = 0; key < 16; ++key)
+    {
+        if (mem->keys[key]) {
+            cpuData->regs[x] = key;
+            return;
+        }
+    }
+
+    // no key is down, so execute this opcode again on the next cycle. This
+    // waits for the key without blocking whoever is driving the cpu
+    cpuData->pc -= 2;
+    trace(TRACE_DEBUG, TRACE_KEY_WAIT, cpuData->pc, x, 0);
 }
 
 void skipifdown(uint16_t opcode, cpu *cpuData, MemMaps *mem) 
 {
-    uint8_t vx = cpuData->regs[offset2(opcode)]; // value stored in register vx
+    // value stored in register vx, there are only 16 keys
+    uint8_t vx = cpuData->regs[offset2(opcode)] & 0xF;
     
     // 1 if key in vx is pressed, 0 if not
     uint8_t is_pressed = mem->keys[vx];
+    mem->keys_read |= 1 << vx;
 
     // skip if key is pressed
     if (is_pressed) 
@@ -369,10 +404,12 @@ void skipifdown(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 
 void skipnotdown(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
-    uint8_t vx = cpuData->regs[offset2(opcode)]; // value stored in register vx
+    // value stored in register vx, there are only 16 keys
+    uint8_t vx = cpuData->regs[offset2(opcode)] & 0xF;
 
     // 1 if pressed, 0 if not
     uint8_t is_pressed = mem->keys[vx];
+    mem->keys_read |= 1 << vx;
 
     // skip instruction if key is not pressed
     if (!is_pressed) 
@@ -397,80 +434,83 @@ void iaddvx(uint16_t opcode, cpu *cpuData, MemMaps *mem)
     cpuData->i += vx;
 }
 
-void draw(uint16_t opcode, cpu *cpuData, MemMaps *mem)
-{
-    // where to draw and how many bytes
-    uint16_t vx = cpuData->regs[offset2(opcode)];
-    uint16_t vy = cpuData->regs[offset3(opcode)];
-
-    // number of rows, in bytes, to write to the screen
-    uint8_t rowsb = offset4(opcode);
-    printf("Writing %i bytes of data to (%i, %i)\n", rowsb, vx, vy);
-
-    // biti for the index of the bit we are inside the byte, and bytei
-    // for how many bytes we have already iterated
-    uint16_t biti, bytei;
-    
-    // byte containing the pixels we will draw
-    // and the pixel is the monochromatic pixel to be rendered
-    uint8_t pixelb, pixel;
-    
-    // pointer, in the screen, to the pixel we are gonna render
-    uint8_t *screen_pixel;
-
-    cpuData->regs[0xf] = 0;
-
-    // chip8 can draw up to 
-    for (bytei = 0; bytei < rowsb; ++bytei)
-    {
-        pixelb = mem->ram[cpuData->i + bytei];
-        
-        for (biti = 0; biti < 8; ++biti)
-        {
-            // separate the bit to be drawn from the byte containing it
-            pixel = ((0x80 >> biti)  & pixelb) >> (7 - biti);
-
-            /*  Get the pixel, on the screen, which the draw operation will be
-             * performed upon.
-             *
-             *  The ((bytei * y) % (WINDOW_HEIGHT - 1)) operation tell on which row 
-             * position we must operate. Modulus for wrapping
-             * 
-             *  The ((biti + x) % (WINDOW_WIDTH - 1)) decide on which screen pixel
-             * column we should operate. Modulus for wrapping.
-             * 
-             *  In the operations (WINDOW_WIDTH - 1) and (WINDOW_HEIGHT - 1),
-             * the sizes are being subtracted by one because the screen 
-             * positions start at 0 and not 1, and this creates a displacement
-             * in the maximum (x, y) coordinates of 1 for both x and y, just
-             * like what happens with arrays.
-             * 
-             *  The preceding operations just map a 2d coordinate to a 1d 
-             * coordinate for a contigous array in memory
-             * 
-             *  Adding these 2 to the starting address of the array that maps
-             * the screen on memory gives us the address of the pixel to 
-             * perform the operation upon
-             */
-             screen_pixel = &(mem->screen[(bytei + vy) % (WINDOW_HEIGHT)]
-                                         [(biti  + vx) % (WINDOW_WIDTH)]);
-            
-	     if (*screen_pixel && pixel) 
-                   cpuData->regs[0xf] = 1;
-
-            *screen_pixel ^= pixel;
-        }
-    }
-
-    update_window(mem);
+// sprites wrap around the edges of the screen, or get clipped by them when
+// clip is set. Written out by the macro for each value of it, as SHIFT_OP.
+//
+// Each row of the screen is a 64 bit word with the leftmost pixel in the
+// msb, so the sprite byte is rotated into place, which also wraps the
+// pixels that go past the right edge around to the left one. The position
+// itself always wraps, and so do the rows past the bottom unless clipped
+#define DRAW_OP(name, clip)                                                 \
+void name(uint16_t opcode, cpu *cpuData, MemMaps *mem)                      \
+{                                                                           \
+    /* where to draw and how many bytes */                                  \
+    uint16_t vx = cpuData->regs[offset2(opcode)];                           \
+    uint16_t vy = cpuData->regs[offset3(opcode)];                           \
+                                                                            \
+    /* number of rows, in bytes, to write to the screen */                  \
+    uint8_t rowsb = offset4(opcode);                                        \
+                                                                            \
+    if (cpuData->i + rowsb > mem->ram_size) {                               \
+        cpuData->fault = FAULT_RAM_OVERRUN;                                 \
+        return;                                                             \
+    }                                                                       \
+                                                                            \
+    trace(TRACE_DEBUG, TRACE_DRAW, cpuData->pc - 2, opcode, (vx << 8) | vy);\
+                                                                            \
+    uint8_t shift = vx % WINDOW_WIDTH;                                      \
+    uint8_t top = vy % WINDOW_HEIGHT;                                       \
+    uint8_t bytei;                                                          \
+    uint64_t sprite, *row;                                                  \
+                                                                            \
+    cpuData->regs[0xf] = 0;                                                 \
+                                                                            \
+    for (bytei = 0; bytei < rowsb; ++bytei)                                 \
+    {                                                                       \
+        if ((clip) && top + bytei >= WINDOW_HEIGHT) {                       \
+            break;                                                          \
+        }                                                                   \
+                                                                            \
+        sprite = (uint64_t) mem->ram[cpuData->i + bytei] << 56;             \
+        if (clip) {                                                         \
+            sprite >>= shift;                                               \
+        } else {                                                            \
+            sprite = (sprite >> shift)                                      \
+                     | (sprite << ((WINDOW_WIDTH - shift) % WINDOW_WIDTH)); \
+        }                                                                   \
+                                                                            \
+        row = &mem->screen[0][(bytei + top) % WINDOW_HEIGHT];               \
+                                                                            \
+        /* a pixel was unset if the sprite overlaps the screen */           \
+        if (*row & sprite) {                                                \
+            cpuData->regs[0xf] = 1;                                         \
+        }                                                                   \
+                                                                            \
+        *row ^= sprite;                                                     \
+    }                                                                       \
+                                                                            \
+    mem->redraw = 1;                                                        \
+                                                                            \
+    if (rowsb && ram_read(mem, cpuData->i, rowsb)) {                        \
+        cpuData->fault = FAULT_WATCH;                                       \
+    }                                                                       \
 }
 
+DRAW_OP(draw, 0)
+DRAW_OP(draw_clip, 1)
+
 void cls(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
-    // set the screen array to 0, theoretically effectively
-    memset(mem->screen, 0, WINDOW_WIDTH * WINDOW_HEIGHT);
+    // set the planes being drawn to to 0, theoretically effectively. That's
+    // the whole screen unless an XO-CHIP rom selected some of them
+    if (mem->planes & 1) {
+        memset(mem->screen[0], 0, sizeof(mem->screen[0]));
+    }
+    if (mem->planes & 2) {
+        memset(mem->screen[1], 0, sizeof(mem->screen[1]));
+    }
 
-    clean_screen();
+    mem->redraw = 1;
 }
 
 // drawing fonts
@@ -495,52 +535,572 @@ void set_BCD(uint16_t opcode, cpu *cpuData, MemMaps *mem)
     uint8_t digits[3];
     uint8_t number = cpuData->regs[offset2(opcode)];  // VX
 
-    // store separate digits into the digits array
-    for (int i = 2; number > 0; --i)
-    {
-        digits[i] = number % 10;
-        number /= 10;
+    if (cpuData->i + 3 > mem->ram_size) {
+        cpuData->fault = FAULT_RAM_OVERRUN;
+        return;
     }
 
+    // store separate digits into the digits array, all 3 of them, as the
+    // leading ones are zeros
+    digits[0] = number / 100;
+    digits[1] = number / 10 % 10;
+    digits[2] = number % 10;
+
     // store digits into the ram address starting at I
     memcpy(&mem->ram[cpuData->i], &digits, 3);
+    if (ram_touch(mem, cpuData->i, 3)) {
+        cpuData->fault = FAULT_WATCH;
+    }
 }
 
 // register values and memory storage
 
-void reg_dump(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+// FX55 and FX65 leave I alone on the SUPER-CHIP, the CHIP-48 adds X to it
+// and the COSMAC VIP X + 1. i_step is 0, 1 or 2 for each of them, and the 
+// macro writes out a variant for each, as SHIFT_OP
+#define STORE_OP(name, i_step)                                              \
+void name(uint16_t opcode, cpu *cpuData, MemMaps *mem)                      \
+{                                                                           \
+    uint8_t x = offset2(opcode);                                            \
+    uint16_t base_addr = cpuData->i;                                        \
+    int index;                                                              \
+                                                                            \
+    if (base_addr + x >= mem->ram_size) {                                   \
+        cpuData->fault = FAULT_RAM_OVERRUN;                                 \
+        return;                                                             \
+    }                                                                       \
+                                                                            \
+    for (index = 0x0; index <= x; ++index)                                  \
+    {                                                                       \
+        mem->ram[base_addr + index] = cpuData->regs[index];                 \
+    }                                                                       \
+                                                                            \
+    if (ram_touch(mem, base_addr, x + 1)) {                                 \
+        cpuData->fault = FAULT_WATCH;                                       \
+    }                                                                       \
+                                                                            \
+    if (i_step) {                                                           \
+        cpuData->i += x + (i_step) - 1;                                     \
+    }                                                                       \
+}
+
+#define LOAD_OP(name, i_step)                                               \
+void name(uint16_t opcode, cpu *cpuData, MemMaps *mem)                      \
+{                                                                           \
+    uint8_t x = offset2(opcode);                                            \
+    uint16_t base_addr = cpuData->i;                                        \
+    int index;                                                              \
+                                                                            \
+    if (base_addr + x >= mem->ram_size) {                                   \
+        cpuData->fault = FAULT_RAM_OVERRUN;                                 \
+        return;                                                             \
+    }                                                                       \
+                                                                            \
+    for (index = 0x0; index <= x; ++index)                                  \
+    {                                                                       \
+        cpuData->regs[index] = mem->ram[base_addr + index];                 \
+    }                                                                       \
+                                                                            \
+    if (ram_read(mem, base_addr, x + 1)) {                                  \
+        cpuData->fault = FAULT_WATCH;                                       \
+    }                                                                       \
+                                                                            \
+    if (i_step) {                                                           \
+        cpuData->i += x + (i_step) - 1;                                     \
+    }                                                                       \
+}
+
+STORE_OP(reg_dump, 0)
+STORE_OP(reg_dump_incx, 1)
+STORE_OP(reg_dump_inc, 2)
+
+LOAD_OP(reg_load, 0)
+LOAD_OP(reg_load_incx, 1)
+LOAD_OP(reg_load_inc, 2)
+
+//******************************************************************************
+//*                      SUPER-CHIP and XO-CHIP opcodes                        *
+//******************************************************************************
+// Only the tables of the schip and xochip profiles in chip8.c point to these.
+//
+// The planes are packed a row after the other, a word per row in low 
+// resolution and 2 in high, so scrolling a plane is moving whole rows or 
+// shifting words, and a sprite row is drawn with a 128 bit shift
+
+// words per row, rows and columns of the current resolution
+#define ROW_WORDS(mem) (1 + (mem)->hires)
+#define ROWS(mem) (WINDOW_HEIGHT << (mem)->hires)
+#define COLUMNS(mem) (WINDOW_WIDTH << (mem)->hires)
+
+typedef unsigned __int128 row128;
+
+// the row y of a plane, left aligned in 128 bits
+static inline row128 load_row(const uint64_t *plane, unsigned int y, 
+                              uint8_t hires)
 {
-    uint8_t x = offset2(opcode);
-    uint16_t base_addr = cpuData->i;
-    int index;
+    if (hires) {
+        return ((row128) plane[2 * y] << 64) | plane[2 * y + 1];
+    }
+    return (row128) plane[y] << 64;
+}
+
+static inline void store_row(uint64_t *plane, unsigned int y, uint8_t hires,
+                             row128 row)
+{
+    if (hires) {
+        plane[2 * y] = row >> 64;
+        plane[2 * y + 1] = (uint64_t) row;
+    } else {
+        plane[y] = row >> 64;
+    }
+}
+
+// scroll the selected planes n rows down, or up when up is set
+static void scroll_rows(MemMaps *mem, unsigned int n, int up)
+{
+    unsigned int words = ROW_WORDS(mem) * n;
+    unsigned int total = ROW_WORDS(mem) * ROWS(mem);
+    unsigned int plane;
+
+    if (n > ROWS(mem)) {
+        n = ROWS(mem);
+        words = total;
+    }
 
-    for (index = 0x0; index <= x; ++index)
+    for (plane = 0; plane < SCREEN_PLANES; ++plane)
     {
-        mem->ram[base_addr + index] = cpuData->regs[index];
+        uint64_t *rows = mem->screen[plane];
+
+        if (!(mem->planes & (1 << plane))) {
+            continue;
+        }
+
+        if (up) {
+            memmove(rows, rows + words, (total - words) * sizeof(rows[0]));
+            memset(rows + total - words, 0, words * sizeof(rows[0]));
+        } else {
+            memmove(rows + words, rows, (total - words) * sizeof(rows[0]));
+            memset(rows, 0, words * sizeof(rows[0]));
+        }
     }
-    
-    // TODO: toggle this behavior using command-line options
-    // cpuData->i = cpuData->i + cpuData->regs[x] + 1;
+
+    mem->redraw = 1;
 }
 
-void reg_load(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+void scroll_down(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
-    uint8_t x = offset2(opcode);
-    uint16_t base_addr = cpuData->i;
-    int index;
+    scroll_rows(mem, offset4(opcode), 0);
+}
+
+void scroll_up(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    scroll_rows(mem, offset4(opcode), 1);
+}
+
+// scroll the selected planes 4 pixels sideways, a word shift per row in low
+// resolution and a pair of them in high
+static void scroll_columns(MemMaps *mem, int left)
+{
+    unsigned int plane, row;
+
+    for (plane = 0; plane < SCREEN_PLANES; ++plane)
+    {
+        uint64_t *rows = mem->screen[plane];
+
+        if (!(mem->planes & (1 << plane))) {
+            continue;
+        }
+
+        if (!mem->hires) {
+            for (row = 0; row < WINDOW_HEIGHT; ++row)
+            {
+                rows[row] = left ? rows[row] << 4 : rows[row] >> 4;
+            }
+            continue;
+        }
+
+        for (row = 0; row < 2 * HIRES_HEIGHT; row += 2)
+        {
+            if (left) {
+                rows[row] = (rows[row] << 4) | (rows[row + 1] >> 60);
+                rows[row + 1] <<= 4;
+            } else {
+                rows[row + 1] = (rows[row + 1] >> 4) | (rows[row] << 60);
+                rows[row] >>= 4;
+            }
+        }
+    }
+
+    mem->redraw = 1;
+}
+
+void scroll_right(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    scroll_columns(mem, 0);
+}
+
+void scroll_left(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    scroll_columns(mem, 1);
+}
+
+void exit_rom(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    cpuData->fault = FAULT_EXIT;
+}
+
+// switching resolutions clears the screen, as the XO-CHIP does
+static void set_resolution(MemMaps *mem, uint8_t hires)
+{
+    mem->hires = hires;
+    memset(mem->screen, 0, sizeof(mem->screen));
+    mem->redraw = 1;
+}
+
+void lores(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    set_resolution(mem, 0);
+}
+
+void hires(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    set_resolution(mem, 1);
+}
+
+// DXYN on the SUPER-CHIP and XO-CHIP: sprites of N rows of 8 pixels, or 16
+// rows of 16 pixels when N is 0, drawn to every selected plane, each plane 
+// taking the sprite that follows the one of the previous plane. Each row is
+// a 128 bit shift of the sprite row, and the variants are written out for 
+// clip as DRAW_OP
+#define DRAW_EXT_OP(name, clip)                                             \
+void name(uint16_t opcode, cpu *cpuData, MemMaps *mem)                      \
+{                                                                           \
+    uint8_t n = offset4(opcode);                                            \
+    unsigned int rows = n ? n : 16;                                         \
+    unsigned int wide = n ? 0 : 1;                                          \
+    unsigned int size = rows << wide;                                       \
+    unsigned int planes = __builtin_popcount(mem->planes);                  \
+    unsigned int width = COLUMNS(mem), height = ROWS(mem);                  \
+    unsigned int x = cpuData->regs[offset2(opcode)] % width;                \
+    unsigned int top = cpuData->regs[offset3(opcode)] % height;             \
+    unsigned int plane, row, addr = cpuData->i;                             \
+    row128 mask = width == 128 ? ~(row128) 0 : ~(row128) 0 << 64;           \
+    row128 sprite, line;                                                    \
+                                                                            \
+    if (cpuData->i + size * planes > mem->ram_size) {                       \
+        cpuData->fault = FAULT_RAM_OVERRUN;                                 \
+        return;                                                             \
+    }                                                                       \
+                                                                            \
+    trace(TRACE_DEBUG, TRACE_DRAW, cpuData->pc - 2, opcode,                 \
+          (cpuData->regs[offset2(opcode)] << 8)                             \
+          | cpuData->regs[offset3(opcode)]);                                \
+                                                                            \
+    cpuData->regs[0xf] = 0;                                                 \
+                                                                            \
+    for (plane = 0; plane < SCREEN_PLANES; ++plane)                         \
+    {                                                                       \
+        if (!(mem->planes & (1 << plane))) {                                \
+            continue;                                                       \
+        }                                                                   \
+                                                                            \
+        for (row = 0; row < rows; ++row)                                    \
+        {                                                                   \
+            if ((clip) && top + row >= height) {                            \
+                break;                                                      \
+            }                                                               \
+                                                                            \
+            /* the sprite row left aligned, then moved to x */              \
+            if (wide) {                                                     \
+                sprite = (row128) ((mem->ram[addr + 2 * row] << 8)          \
+                                   | mem->ram[addr + 2 * row + 1]) << 112;  \
+            } else {                                                        \
+                sprite = (row128) mem->ram[addr + row] << 120;              \
+            }                                                               \
+            if (clip || x == 0) {                                           \
+                sprite = (sprite >> x) & mask;                              \
+            } else {                                                        \
+                sprite = ((sprite >> x) | (sprite << (width - x))) & mask;  \
+            }                                                               \
+                                                                            \
+            line = load_row(mem->screen[plane], (top + row) % height,       \
+                            mem->hires);                                    \
+            if (line & sprite) {                                            \
+                cpuData->regs[0xf] = 1;                                     \
+            }                                                               \
+            store_row(mem->screen[plane], (top + row) % height, mem->hires, \
+                      line ^ sprite);                                       \
+        }                                                                   \
+                                                                            \
+        addr += size;                                                       \
+    }                                                                       \
+                                                                            \
+    mem->redraw = 1;                                                        \
+                                                                            \
+    if (planes && ram_read(mem, cpuData->i, size * planes)) {               \
+        cpuData->fault = FAULT_WATCH;                                       \
+    }                                                                       \
+}
+
+DRAW_EXT_OP(draw_ext, 0)
+DRAW_EXT_OP(draw_ext_clip, 1)
 
-    for (index = 0x0; index <= x; ++index)
+// 5XY2 and 5XY3 go from VX to VY, backwards if Y is smaller than X, and 
+// leave I alone
+void save_range(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    uint8_t x = offset2(opcode), y = offset3(opcode);
+    uint8_t count = (x < y ? y - x : x - y) + 1;
+    int step = x < y ? 1 : -1;
+    uint8_t index;
+
+    if (cpuData->i + count > mem->ram_size) {
+        cpuData->fault = FAULT_RAM_OVERRUN;
+        return;
+    }
+
+    for (index = 0; index < count; ++index)
+    {
+        mem->ram[cpuData->i + index] = cpuData->regs[x + step * index];
+    }
+
+    if (ram_touch(mem, cpuData->i, count)) {
+        cpuData->fault = FAULT_WATCH;
+    }
+}
+
+void load_range(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    uint8_t x = offset2(opcode), y = offset3(opcode);
+    uint8_t count = (x < y ? y - x : x - y) + 1;
+    int step = x < y ? 1 : -1;
+    uint8_t index;
+
+    if (cpuData->i + count > mem->ram_size) {
+        cpuData->fault = FAULT_RAM_OVERRUN;
+        return;
+    }
+
+    for (index = 0; index < count; ++index)
     {
-        cpuData->regs[index] = mem->ram[base_addr + index];
+        cpuData->regs[x + step * index] = mem->ram[cpuData->i + index];
     }
 
-    // TODO: toggle this behavior using command-line options
-    // cpuData->i = cpuData->i + cpuData->regs[x] + 1;
+    if (ram_read(mem, cpuData->i, count)) {
+        cpuData->fault = FAULT_WATCH;
+    }
+}
+
+void long_i(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    // the address is the word after the opcode
+    if (cpuData->pc + 1 >= mem->ram_size) {
+        cpuData->fault = FAULT_PC_OVERRUN;
+        return;
+    }
+
+    cpuData->i = (mem->ram[cpuData->pc] << 8) | mem->ram[cpuData->pc + 1];
+    cpuData->pc += 2;
+}
+
+void select_planes(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    mem->planes = offset2(opcode) & ((1 << SCREEN_PLANES) - 1);
+}
+
+void audio_pattern(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    if (cpuData->i + sizeof(mem->audio) > mem->ram_size) {
+        cpuData->fault = FAULT_RAM_OVERRUN;
+        return;
+    }
+
+    memcpy(mem->audio, &mem->ram[cpuData->i], sizeof(mem->audio));
+
+    if (ram_read(mem, cpuData->i, sizeof(mem->audio))) {
+        cpuData->fault = FAULT_WATCH;
+    }
+}
+
+void set_pitch(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    mem->pitch = cpuData->regs[offset2(opcode)];
+}
+
+void load_big_char_addr(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    uint8_t hex = cpuData->regs[offset2(opcode)] & 0xF;
+
+    cpuData->i = BIG_FONTSET_START + hex * BIG_FONTSET_BYTES_PER_CHAR;
+}
+
+void save_flags(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    memcpy(cpuData->flags, cpuData->regs, offset2(opcode) + 1);
+}
+
+void load_flags(uint16_t opcode, cpu *cpuData, MemMaps *mem)
+{
+    memcpy(cpuData->regs, cpuData->flags, offset2(opcode) + 1);
+}
+
+// the XO-CHIP skips step over the whole of F000 NNNN. Each variant runs the
+// original skip, and then skips the address too if it skipped a F000
+#define XO_SKIP(name)                                                       \
+void name##_xo(uint16_t opcode, cpu *cpuData, MemMaps *mem)                 \
+{                                                                           \
+    uint16_t pc = cpuData->pc;                                              \
+                                                                            \
+    name(opcode, cpuData, mem);                                             \
+    if (cpuData->pc != pc && pc + 1u < mem->ram_size                        \
+        && mem->ram[pc] == 0xF0 && mem->ram[pc + 1] == 0) {                 \
+        cpuData->pc += 2;                                                   \
+    }                                                                       \
+}
+
+XO_SKIP(se)
+XO_SKIP(sne)
+XO_SKIP(svxevy)
+XO_SKIP(next_if_vx_not_vy)
+XO_SKIP(skipifdown)
+XO_SKIP(skipnotdown)
+
+// opcode descriptions
+
+const OpInfo opinfo[] =
+{
+    { msbis0,            "0000", "NOP"            },
+    { cls,               "00E0", "CLS"            },
+    { ret,               "00EE", "RET"            },
+    { jump,              "1NNN", "JP NNN"         },
+    { call,              "2NNN", "CALL NNN"       },
+    { se,                "3XNN", "SE VX, NN"      },
+    { sne,               "4XNN", "SNE VX, NN"     },
+    { svxevy,            "5XY0", "SE VX, VY"      },
+    { setvx,             "6XNN", "LD VX, NN"      },
+    { addvx,             "7XNN", "ADD VX, NN"     },
+    { setvxtovy,         "8XY0", "LD VX, VY"      },
+    { vxorvy,            "8XY1", "OR VX, VY"      },
+    { vxandvy,           "8XY2", "AND VX, VY"     },
+    { vxxorvy,           "8XY3", "XOR VX, VY"     },
+    { vxaddvy,           "8XY4", "ADD VX, VY"     },
+    { vxsubvy,           "8XY5", "SUB VX, VY"     },
+    { shr,               "8XY6", "SHR VX"         },
+    { vysubvx,           "8XY7", "SUBN VX, VY"    },
+    { shl,               "8XYE", "SHL VX"         },
+    { next_if_vx_not_vy, "9XY0", "SNE VX, VY"     },
+    { itoa,              "ANNN", "LD I, NNN"      },
+    { jmpaddv0,          "BNNN", "JP V0, NNN"     },
+    { vxandrand,         "CXNN", "RND VX, NN"     },
+    { draw,              "DXYN", "DRW VX, VY, N"  },
+    { skipifdown,        "EX9E", "SKP VX"         },
+    { skipnotdown,       "EXA1", "SKNP VX"        },
+    { vx_to_dt,          "FX07", "LD VX, DT"      },
+    { vx_to_key,         "FX0A", "LD VX, K"       },
+    { set_dt,            "FX15", "LD DT, VX"      },
+    { set_st,            "FX18", "LD ST, VX"      },
+    { iaddvx,            "FX1E", "ADD I, VX"      },
+    { load_char_addr,    "FX29", "LD F, VX"       },
+    { set_BCD,           "FX33", "LD B, VX"       },
+    { reg_dump,          "FX55", "LD [I], VX"     },
+    { reg_load,          "FX65", "LD VX, [I]"     },
+    { scroll_down,       "00CN", "SCD N"          },
+    { scroll_up,         "00DN", "SCU N"          },
+    { scroll_right,      "00FB", "SCR"            },
+    { scroll_left,       "00FC", "SCL"            },
+    { exit_rom,          "00FD", "EXIT"           },
+    { lores,             "00FE", "LOW"            },
+    { hires,             "00FF", "HIGH"           },
+    { save_range,        "5XY2", "LD [I], VX-VY"  },
+    { load_range,        "5XY3", "LD VX-VY, [I]"  },
+    { long_i,            "F000", "LD I, LONG"     },
+    { select_planes,     "FN01", "PLANE"          },
+    { audio_pattern,     "F002", "AUDIO"          },
+    { load_big_char_addr,"FX30", "LD HF, VX"      },
+    { set_pitch,         "FX3A", "PITCH VX"       },
+    { save_flags,        "FX75", "LD R, VX"       },
+    { load_flags,        "FX85", "LD VX, R"       },
+
+    // the variants of the quirk profiles, named as the opcodes they run
+    { vxorvy_vf,         "8XY1", "OR VX, VY"      },
+    { vxandvy_vf,        "8XY2", "AND VX, VY"     },
+    { vxxorvy_vf,        "8XY3", "XOR VX, VY"     },
+    { shr_vy,            "8XY6", "SHR VX, VY"     },
+    { shl_vy,            "8XYE", "SHL VX, VY"     },
+    { jmpaddvx,          "BXNN", "JP VX, NNN"     },
+    { draw_clip,         "DXYN", "DRW VX, VY, N"  },
+    { draw_ext,          "DXYN", "DRW VX, VY, N"  },
+    { draw_ext_clip,     "DXYN", "DRW VX, VY, N"  },
+    { reg_dump_incx,     "FX55", "LD [I], VX"     },
+    { reg_load_incx,     "FX65", "LD VX, [I]"     },
+    { reg_dump_inc,      "FX55", "LD [I], VX"     },
+    { reg_load_inc,      "FX65", "LD VX, [I]"     },
+    { se_xo,             "3XNN", "SE VX, NN"      },
+    { sne_xo,            "4XNN", "SNE VX, NN"     },
+    { svxevy_xo,         "5XY0", "SE VX, VY"      },
+    { next_if_vx_not_vy_xo, "9XY0", "SNE VX, VY"  },
+    { skipifdown_xo,     "EX9E", "SKP VX"         },
+    { skipnotdown_xo,    "EXA1", "SKNP VX"        },
+    { cpuNULL,           "????", "DW NNNN"        }
+};
+
+const unsigned int opinfo_count = sizeof(opinfo) / sizeof(opinfo[0]);
+
+unsigned int opcode_class(const MemMaps *mem, uint16_t opcode)
+{
+    opfunc handler = decode(mem, opcode);
+    unsigned int index;
+
+    for (index = 0; index < opinfo_count - 1; ++index)
+    {
+        if (opinfo[index].handler == handler) {
+            break;
+        }
+    }
+
+    return index;
+}
+
+void disassemble(const MemMaps *mem, uint16_t opcode, char *text,
+                 unsigned int size)
+{
+    const char *mnemonic = opinfo[opcode_class(mem, opcode)].mnemonic;
+    unsigned int len = 0, digits;
+    const char *word;
+
+    for (word = mnemonic; *word && len + 1 < size; ++word)
+    {
+        // VX and VY are registers, X and Y alone are part of other words
+        if ((*word == 'X' || *word == 'Y') && word > mnemonic 
+            && word[-1] == 'V') {
+            len += snprintf(text + len, size - len, "%X", *word == 'X' 
+                            ? offset2(opcode) : offset3(opcode));
+            continue;
+        }
+
+        // N, NN, NNN and NNNN are operands when they are whole words
+        for (digits = 0; word[digits] == 'N'; ++digits);
+        if (digits && (word == mnemonic || word[-1] == ' ') 
+            && (word[digits] == '\0' || word[digits] == ',')) {
+            len += snprintf(text + len, size - len, digits == 1 ? "%u" 
+                            : "%#.*X", digits == 1 ? opcode & 0xF : digits, 
+                            opcode & ((1 << (digits * 4)) - 1));
+            word += digits - 1;
+            continue;
+        }
+
+        text[len++] = *word;
+    }
+
+    if (len >= size) {
+        len = size - 1;
+    }
+    text[len] = '\0';
 }
 
 void cpuNULL(uint16_t opcode, cpu *cpuData, MemMaps *mem)
 {
-    fprintf(stderr, "[WARNING] Unknown opcode %#X at %#X\n", opcode,
-                     cpuData->pc);
+    ++cpuData->unknown;
+    trace(TRACE_WARN, TRACE_UNKNOWN_OPCODE, cpuData->pc - 2, opcode, 0);
 }
 
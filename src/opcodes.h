@@ -15,6 +15,23 @@
 
 void cpuNULL(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
+// type of the functions that execute opcodes
+typedef void (*opfunc) (uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// describe the opcode executed by a function. The pattern is the opcode
+// written as in the comments below, and the mnemonic is a template in which 
+// the X, Y, N, NN and NNN words are replaced by the operands
+typedef struct OpInfo
+{
+    opfunc handler;
+    const char *pattern;
+    const char *mnemonic;
+} OpInfo;
+
+// all the functions that execute opcodes, the last one is cpuNULL
+extern const OpInfo opinfo[];
+extern const unsigned int opinfo_count;
+
 //******************************************************************************
 //*                         FUNCTIONS DECLARATIONS                             *
 //******************************************************************************
@@ -61,6 +78,11 @@ void vxandvy(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 // Sets VX to VX xor VY. 8XY3
 void vxxorvy(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
+// 8XY1, 8XY2 and 8XY3 as on the COSMAC VIP, which also set VF to 0
+void vxorvy_vf(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void vxandvy_vf(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void vxxorvy_vf(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
 // Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't.
 // 8XY4
 void vxaddvy(uint16_t opcode, cpu *cpuData, MemMaps *mem);
@@ -81,6 +103,10 @@ void vysubvx(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 // shifts VX to the left by 1. 8XYE
 void shl(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
+// 8XY6 and 8XYE as on the COSMAC VIP, which shifted VY and stored it in VX
+void shr_vy(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void shl_vy(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
 // Skips the next instruction if VX doesn't equal VY. 9XY0
 void next_if_vx_not_vy(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
@@ -90,15 +116,21 @@ void itoa(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 // Jumps to the address NNN plus V0. BNNN
 void jmpaddv0(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
+// Jumps to the address XNN plus VX, as the CHIP-48 did. BXNN
+void jmpaddvx(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
 // Sets VX to the result of a bitwise and operation on
 // a random number (Typically: 0 to 255) and NN. CXNN
 void vxandrand(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
 // Draw a sprite at position VX, VY with N bytes of sprite data starting 
 // at the address stored in I Set VF to 01 if any set pixels are changed
-// to unset, and 00 otherwise
+// to unset, and 00 otherwise. The pixels past the edges wrap around
 void draw(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
+// DXYN clipping the sprite at the edges of the screen instead
+void draw_clip(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
 // Skips the next instruction if the key stored in VX is pressed. EX9E
 void skipifdown(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
@@ -139,6 +171,79 @@ void reg_dump(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 // FX65
 void reg_load(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
+// FX55 and FX65 adding X to I afterwards, as the CHIP-48 did
+void reg_dump_incx(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void reg_load_incx(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// FX55 and FX65 adding X + 1 to I afterwards, as the COSMAC VIP did
+void reg_dump_inc(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void reg_load_inc(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+//******************************************************************************
+//* SUPER-CHIP and XO-CHIP                                                     *
+//******************************************************************************
+
+// Scroll the selected planes N rows down. 00CN
+void scroll_down(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Scroll the selected planes N rows up, XO-CHIP only. 00DN
+void scroll_up(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Scroll the selected planes 4 pixels right. 00FB
+void scroll_right(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Scroll the selected planes 4 pixels left. 00FC
+void scroll_left(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// End the program, raising FAULT_EXIT. 00FD
+void exit_rom(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Switch to 64x32 pixels, clearing the screen. 00FE
+void lores(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Switch to 128x64 pixels, clearing the screen. 00FF
+void hires(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// DXYN with 16x16 sprites for N = 0 and the XO-CHIP planes, wrapping or 
+// clipping the sprites at the edges
+void draw_ext(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void draw_ext_clip(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Store VX to VY in memory starting at address I, leaving I alone. 5XY2
+void save_range(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Load VX to VY from memory starting at address I, leaving I alone. 5XY3
+void load_range(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Set I to the 16 bit address in the word after the opcode. F000 NNNN
+void long_i(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Select the planes drawn to, scrolled and cleared, bit 0 being the first
+// one. FN01
+void select_planes(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Load the 16 bytes at I into the audio pattern. F002
+void audio_pattern(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Set the pitch of the audio pattern to VX. FX3A
+void set_pitch(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Sets I to the location of the 8x10 sprite for the digit in VX. FX30
+void load_big_char_addr(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Store V0 to VX in the RPL flags. FX75
+void save_flags(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// Load V0 to VX from the RPL flags. FX85
+void load_flags(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+
+// the skips of the XO-CHIP, which skip F000 NNNN whole
+void se_xo(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void sne_xo(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void svxevy_xo(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void next_if_vx_not_vy_xo(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void skipifdown_xo(uint16_t opcode, cpu *cpuData, MemMaps *mem);
+void skipnotdown_xo(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
 //******************************************************************************
 // * ARRAYS OF POINTERS TO FUNCTIONS                                           *
@@ -161,6 +266,20 @@ void msbise(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 // 0X5, if it's 0X5 then the 3rd offset is the index
 void msbisf(uint16_t opcode, cpu *cpuData, MemMaps *mem);
 
+// return the function that executes opcode on the machine, looking it up in
+// the tables of its quirk profile that step() runs it through. Return 
+// msbis0 for the 0000 opcode, which the interpreter ignores
+opfunc decode(const MemMaps *mem, uint16_t opcode);
+
+// return the index in opinfo of the function that executes opcode on the
+// machine
+unsigned int opcode_class(const MemMaps *mem, uint16_t opcode);
+
+// write the mnemonic of opcode on the machine to text, with the operands
+// filled in, at most size bytes of it
+void disassemble(const MemMaps *mem, uint16_t opcode, char *text,
+                 unsigned int size);
+
 /*static void (*zeroop[15])    (uint16_t opcode, cpu *cpuData, MemMaps *mem);
 static void (*eightop[15])   (uint16_t opcode, cpu *cpuData, MemMaps *mem);
 static void (*e_op[11])      (uint16_t opcode, cpu *cpuData, MemMaps *mem);
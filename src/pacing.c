@@ -0,0 +1,113 @@
+/*
+ * Frame pacing for hosts that can't keep up. See pacing.h
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "chip8.h"
+#include "pacing.h"
+
+// a frame is late when its sleep ends this long after it should
+#define PACING_LATE_NS (TIMERS_HZ_NS / 4)
+
+static unsigned int interval = 1;
+static unsigned int worst_interval = 1;
+static unsigned int since_present = PACING_MAX_INTERVAL;
+static unsigned int late_frames, easy_frames;
+static int64_t behind_ns;
+
+static uint64_t skipped[PACING_SKIPS];
+static uint64_t dropped;
+
+static void report_atexit()
+{
+    if (skipped[PACING_CATCHUP] || skipped[PACING_INTERVAL] || dropped) {
+        fprintf(stderr, "chip8: pacing: %lu presents skipped catching up, "
+                "%lu at a lower rate, down to 1 in %u frames, %lu frames "
+                "dropped\n", (unsigned long) skipped[PACING_CATCHUP],
+                (unsigned long) skipped[PACING_INTERVAL], worst_interval,
+                (unsigned long) dropped);
+    }
+}
+
+void pacing_init()
+{
+    atexit(report_atexit);
+}
+
+uint8_t pacing_present()
+{
+    uint8_t skip = PACING_PRESENT;
+
+    if (since_present < PACING_MAX_INTERVAL) {
+        if (behind_ns > TIMERS_HZ_NS) {
+            skip = PACING_CATCHUP;
+        } else if (since_present < interval) {
+            skip = PACING_INTERVAL;
+        }
+    }
+
+    if (skip == PACING_PRESENT) {
+        since_present = 0;
+    } else {
+        ++skipped[skip];
+    }
+
+    return skip;
+}
+
+void pacing_frame(uint64_t busy_ns, int64_t late_ns)
+{
+    behind_ns = late_ns;
+    if (since_present < PACING_MAX_INTERVAL) {
+        ++since_present;
+    }
+
+    if (late_ns > PACING_LATE_NS) {
+        easy_frames = 0;
+        if (++late_frames < PACING_LATE_FRAMES) {
+            return;
+        }
+
+        late_frames = 0;
+        if (interval < PACING_MAX_INTERVAL) {
+            ++interval;
+        }
+        if (interval > worst_interval) {
+            worst_interval = interval;
+        }
+    } else if (busy_ns < TIMERS_HZ_NS / 2) {
+        late_frames = 0;
+        if (++easy_frames < PACING_EASY_FRAMES) {
+            return;
+        }
+
+        easy_frames = 0;
+        if (interval > 1) {
+            --interval;
+        }
+    } else {
+        late_frames = easy_frames = 0;
+    }
+}
+
+void pacing_drop(unsigned long frames)
+{
+    dropped += frames;
+}
+
+unsigned int pacing_interval()
+{
+    return interval;
+}
+
+uint64_t pacing_skipped(uint8_t reason)
+{
+    return reason < PACING_SKIPS ? skipped[reason] : 0;
+}
+
+uint64_t pacing_dropped()
+{
+    return dropped;
+}
@@ -0,0 +1,60 @@
+/*
+ * Frame pacing for hosts that can't keep up. The opcodes and the timers of
+ * every frame run, at 60 Hz on average, whatever the host does: when the
+ * loop wakes up late, the frames it missed run back to back until it's on
+ * time again. Only when it's more than PACING_MAX_CATCHUP frames behind are
+ * the missed frames dropped, and the timers lose that time.
+ *
+ * What gives instead are the presents, the most expensive part of a frame
+ * with software rendering at large scales. They are skipped
+ *   - while catching up, so the frames behind run as fast as they can
+ *   - when the loop was late PACING_LATE_FRAMES frames in a row: from then
+ *     on the screen is presented every other frame, at 30 Hz, and if that's
+ *     not enough every third and fourth frame, up to PACING_MAX_INTERVAL.
+ *     After PACING_EASY_FRAMES frames that took less than half their time
+ *     the interval goes back down one step
+ * but a changed screen is never left unpresented for more than
+ * PACING_MAX_INTERVAL frames. The skips are counted by reason, published by
+ * the telemetry, and summed up on stderr at exit
+ * */
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdint.h>
+
+#define PACING_MAX_CATCHUP 4
+#define PACING_MAX_INTERVAL 4
+#define PACING_LATE_FRAMES 3
+#define PACING_EASY_FRAMES 120
+
+// why a present was skipped
+enum PacingSkip
+{
+    PACING_PRESENT,              // it wasn't
+    PACING_CATCHUP,
+    PACING_INTERVAL,
+    PACING_SKIPS
+};
+
+// report the skips on stderr at exit, if there were any
+void pacing_init();
+
+// whether the screen, changed since the last present, should be presented
+// in this frame. Return PACING_PRESENT if it should, or the reason not to
+uint8_t pacing_present();
+
+// account a frame that took busy_ns to run and present, and whose sleep
+// ended late_ns after the start of the next one, to adapt the interval
+void pacing_frame(uint64_t busy_ns, int64_t late_ns);
+
+// frames dropped by frame_wait(), being too far behind
+void pacing_drop(unsigned long frames);
+
+// frames between presents the policy is at, 1 when it presents every frame
+unsigned int pacing_interval();
+
+// totals since the start: presents skipped for a reason, and frames dropped
+uint64_t pacing_skipped(uint8_t reason);
+uint64_t pacing_dropped();
+
+#endif
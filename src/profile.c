@@ -0,0 +1,408 @@
+/*
+ * Execution profiler. See profile.h
+ * */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "opcodes.h"
+#include "profile.h"
+
+#define MAX_CLASSES 128
+
+// opinfo index of every possible opcode, so we don't decode at each step,
+// for the quirk profile of class_quirks. A rom loaded with another profile
+// from the control socket decodes them again
+static uint8_t class_of[0x10000];
+static int class_quirks = -1;
+
+static uint64_t class_hits[MAX_CLASSES];     // opcodes executed
+static uint64_t class_sampled[MAX_CLASSES];  // opcodes executed and timed
+static uint64_t class_ns[MAX_CLASSES];       // time spent on the timed ones
+static uint64_t pc_hits[XO_RAM_SIZE];        // opcodes executed per address
+static uint64_t total_hits;
+
+// what a timed section costs with nothing in it, taken out of class_ns when
+// the report is written
+static double timer_overhead_ns;
+
+static MemMaps *profiled = NULL;
+static char report_path[4096];
+
+// sampling is done at random intervals, so that loops with a length that
+// divides the sampling period don't always get the same opcode timed
+static uint32_t sample_state = 0x9E3779B9;
+static uint32_t countdown = PROFILE_SAMPLE_PERIOD;
+
+// a loop closed by a backward jump
+typedef struct Loop
+{
+    uint16_t from;               // address of the jump
+    uint16_t to;                 // address jumped to
+    uint64_t iterations;         // times the jump was taken
+    uint64_t executed;           // opcodes executed inside the loop
+} Loop;
+
+static uint32_t next_period()
+{
+    uint32_t x = sample_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sample_state = x;
+
+    return 1 + x % (2 * PROFILE_SAMPLE_PERIOD - 1);
+}
+
+static uint64_t elapsed_ns(struct timespec *start, struct timespec *end)
+{
+    return (uint64_t) (end->tv_sec - start->tv_sec) * 1000000000
+           + end->tv_nsec - start->tv_nsec;
+}
+
+static void report_atexit()
+{
+    profile_report();
+}
+
+// time PROFILE_CALIBRATION empty sections, the way profile_step() times an
+// opcode, and keep the average
+static void calibrate()
+{
+    struct timespec start, end;
+    uint64_t total = 0;
+    unsigned int run;
+
+    for (run = 0; run < PROFILE_CALIBRATION; ++run)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        total += elapsed_ns(&start, &end);
+    }
+
+    timer_overhead_ns = (double) total / PROFILE_CALIBRATION;
+}
+
+static void classify(const MemMaps *mem)
+{
+    unsigned int opcode;
+
+    for (opcode = 0; opcode <= 0xFFFF; ++opcode)
+    {
+        class_of[opcode] = opcode_class(mem, opcode);
+    }
+    class_quirks = mem->quirks;
+}
+
+void profile_init(MemMaps *mem, const char *path)
+{
+    classify(mem);
+    calibrate();
+    profiled = mem;
+    snprintf(report_path, sizeof(report_path), "%s", path);
+
+    atexit(report_atexit);
+}
+
+uint8_t profile_step(cpu *cpuData, MemMaps *mem)
+{
+    uint16_t pc = cpuData->pc;
+
+    // let step() raise the fault
+    if (pc >= mem->ram_size - 1) {
+        return step(cpuData, mem);
+    }
+
+    if (mem->quirks != class_quirks) {
+        classify(mem);
+    }
+
+    uint8_t class = class_of[(mem->ram[pc] << 8) | mem->ram[pc + 1]];
+    uint8_t fault;
+
+    ++pc_hits[pc];
+    ++class_hits[class];
+    ++total_hits;
+
+    if (--countdown) {
+        return step(cpuData, mem);
+    }
+
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fault = step(cpuData, mem);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    class_ns[class] += elapsed_ns(&start, &end);
+    ++class_sampled[class];
+    countdown = next_period();
+
+    return fault;
+}
+
+//******************************************************************************
+//*                              report                                        *
+//******************************************************************************
+
+static uint16_t opcode_at(uint16_t addr)
+{
+    return (profiled->ram[addr] << 8) | profiled->ram[addr + 1];
+}
+
+// average host time, in ns, of a timed opcode of a class, without what
+// timing it costs
+static double class_ns_per_op(unsigned int class)
+{
+    if (class_sampled[class] == 0) {
+        return 0.0;
+    }
+
+    double ns = (double) class_ns[class] / class_sampled[class]
+                - timer_overhead_ns;
+
+    return ns > 0.0 ? ns : 0.0;
+}
+
+// estimated host time, in ns, spent executing the opcodes of a class
+static double class_time(unsigned int class)
+{
+    return class_ns_per_op(class) * class_hits[class];
+}
+
+static int by_class_time(const void *a, const void *b)
+{
+    double ta = class_time(*(const unsigned int *) a);
+    double tb = class_time(*(const unsigned int *) b);
+
+    return (ta < tb) - (ta > tb);
+}
+
+static int by_pc_hits(const void *a, const void *b)
+{
+    uint64_t ha = pc_hits[*(const uint16_t *) a];
+    uint64_t hb = pc_hits[*(const uint16_t *) b];
+
+    return (ha < hb) - (ha > hb);
+}
+
+static int by_loop_executed(const void *a, const void *b)
+{
+    uint64_t ea = ((const Loop *) a)->executed;
+    uint64_t eb = ((const Loop *) b)->executed;
+
+    return (ea < eb) - (ea > eb);
+}
+
+// collect the addresses that were executed, most executed first. Return how
+// many there are
+static unsigned int hot_addresses(uint16_t *addrs)
+{
+    unsigned int count = 0, addr;
+
+    for (addr = 0; addr < profiled->ram_size - 1; ++addr)
+    {
+        if (pc_hits[addr]) {
+            addrs[count++] = addr;
+        }
+    }
+
+    qsort(addrs, count, sizeof(addrs[0]), by_pc_hits);
+
+    return count;
+}
+
+// collect the loops closed by executed backward jumps, the ones that
+// executed the most opcodes first. Return how many there are
+static unsigned int hot_loops(Loop *loops)
+{
+    unsigned int count = 0, addr, body;
+
+    for (addr = 0; addr < profiled->ram_size - 1; ++addr)
+    {
+        uint16_t opcode = opcode_at(addr);
+
+        if (!pc_hits[addr] || offset1(opcode) != 0x1 
+            || (opcode & 0x0FFF) > addr) {
+            continue;
+        }
+
+        loops[count].from = addr;
+        loops[count].to = opcode & 0x0FFF;
+        loops[count].iterations = pc_hits[addr];
+        loops[count].executed = 0;
+
+        for (body = loops[count].to; body <= addr; ++body)
+        {
+            loops[count].executed += pc_hits[body];
+        }
+        ++count;
+    }
+
+    qsort(loops, count, sizeof(loops[0]), by_loop_executed);
+
+    return count;
+}
+
+static double percent(uint64_t part)
+{
+    return total_hits ? 100.0 * part / total_hits : 0.0;
+}
+
+static void report_text(FILE *out, unsigned int *classes, uint16_t *addrs,
+                        unsigned int addrs_count, Loop *loops, 
+                        unsigned int loops_count)
+{
+    unsigned int index, shown;
+
+    fprintf(out, "chip8 profile: %lu opcodes executed, %.1f ns of timer "
+            "overhead taken out of each sample\n\n",
+            (unsigned long) total_hits, timer_overhead_ns);
+
+    fprintf(out, "%-6s %-16s %12s %7s %10s %12s\n",
+            "opcode", "mnemonic", "count", "%", "ns/op", "est. total ms");
+    for (index = 0; index < opinfo_count; ++index)
+    {
+        unsigned int class = classes[index];
+
+        if (class_hits[class] == 0) {
+            continue;
+        }
+
+        fprintf(out, "%-6s %-16s %12lu %6.2f%% %10.1f %12.3f\n",
+                opinfo[class].pattern, opinfo[class].mnemonic,
+                (unsigned long) class_hits[class], percent(class_hits[class]),
+                class_ns_per_op(class), class_time(class) / 1000000.0);
+    }
+
+    fprintf(out, "\nhot addresses\n%-6s %-6s %12s %7s\n", 
+            "addr", "opcode", "count", "%");
+    for (index = 0; index < addrs_count && index < PROFILE_REPORT_TOP; ++index)
+    {
+        fprintf(out, "%#.3X  %.4X   %12lu %6.2f%%\n", addrs[index],
+                opcode_at(addrs[index]), (unsigned long) pc_hits[addrs[index]],
+                percent(pc_hits[addrs[index]]));
+    }
+
+    fprintf(out, "\nhot loops\n%-6s %-6s %12s %12s %7s\n", 
+            "from", "to", "iterations", "executed", "%");
+    for (index = 0; index < loops_count && index < PROFILE_REPORT_TOP; ++index)
+    {
+        fprintf(out, "%#.3X  %#.3X  %12lu %12lu %6.2f%%\n", 
+                loops[index].from, loops[index].to, 
+                (unsigned long) loops[index].iterations,
+                (unsigned long) loops[index].executed, 
+                percent(loops[index].executed));
+    }
+
+    fprintf(out, "\nhot draw sites\n%-6s %-6s %12s\n", "addr", "opcode", "count");
+    for (index = 0, shown = 0; index < addrs_count && shown < PROFILE_REPORT_TOP;
+         ++index)
+    {
+        uint16_t opcode = opcode_at(addrs[index]);
+
+        if (offset1(opcode) == 0xD) {
+            fprintf(out, "%#.3X  %.4X   %12lu\n", addrs[index], opcode,
+                    (unsigned long) pc_hits[addrs[index]]);
+            ++shown;
+        }
+    }
+}
+
+static void report_json(FILE *out, uint16_t *addrs, unsigned int addrs_count,
+                        Loop *loops, unsigned int loops_count)
+{
+    unsigned int index;
+
+    fprintf(out, "{\n  \"total\": %lu,\n  \"timer_overhead_ns\": %.1f,\n"
+            "  \"classes\": [", (unsigned long) total_hits, timer_overhead_ns);
+    for (index = 0; index < opinfo_count; ++index)
+    {
+        fprintf(out, "%s\n    {\"pattern\": \"%s\", \"mnemonic\": \"%s\", "
+                "\"count\": %lu, \"sampled\": %lu, \"sampled_ns\": %lu}",
+                index ? "," : "", opinfo[index].pattern, opinfo[index].mnemonic,
+                (unsigned long) class_hits[index],
+                (unsigned long) class_sampled[index],
+                (unsigned long) class_ns[index]);
+    }
+
+    fprintf(out, "\n  ],\n  \"addresses\": [");
+    for (index = 0; index < addrs_count; ++index)
+    {
+        fprintf(out, "%s\n    {\"addr\": %u, \"opcode\": %u, \"count\": %lu}",
+                index ? "," : "", addrs[index], opcode_at(addrs[index]),
+                (unsigned long) pc_hits[addrs[index]]);
+    }
+
+    fprintf(out, "\n  ],\n  \"loops\": [");
+    for (index = 0; index < loops_count; ++index)
+    {
+        fprintf(out, "%s\n    {\"from\": %u, \"to\": %u, \"iterations\": %lu, "
+                "\"executed\": %lu}", index ? "," : "", 
+                loops[index].from, loops[index].to, 
+                (unsigned long) loops[index].iterations,
+                (unsigned long) loops[index].executed);
+    }
+
+    fprintf(out, "\n  ],\n  \"draws\": [");
+    unsigned int shown = 0;
+    for (index = 0; index < addrs_count; ++index)
+    {
+        uint16_t opcode = opcode_at(addrs[index]);
+
+        if (offset1(opcode) == 0xD) {
+            fprintf(out, "%s\n    {\"addr\": %u, \"opcode\": %u, \"count\": %lu}",
+                    shown++ ? "," : "", addrs[index], opcode,
+                    (unsigned long) pc_hits[addrs[index]]);
+        }
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+}
+
+void profile_report()
+{
+    if (profiled == NULL) {
+        return;
+    }
+
+    static unsigned int classes[MAX_CLASSES];
+    static uint16_t addrs[XO_RAM_SIZE];
+    static Loop loops[XO_RAM_SIZE];
+    unsigned int index, addrs_count, loops_count;
+    char path[sizeof(report_path) + 8];
+    FILE *out;
+
+    for (index = 0; index < opinfo_count; ++index)
+    {
+        classes[index] = index;
+    }
+    qsort(classes, opinfo_count, sizeof(classes[0]), by_class_time);
+
+    addrs_count = hot_addresses(addrs);
+    loops_count = hot_loops(loops);
+
+    snprintf(path, sizeof(path), "%s.txt", report_path);
+    if ((out = fopen(path, "w")) == NULL) {
+        perror("chip8: ");
+    } else {
+        report_text(out, classes, addrs, addrs_count, loops, loops_count);
+        fclose(out);
+    }
+
+    snprintf(path, sizeof(path), "%s.json", report_path);
+    if ((out = fopen(path, "w")) == NULL) {
+        perror("chip8: ");
+    } else {
+        report_json(out, addrs, addrs_count, loops, loops_count);
+        fclose(out);
+    }
+
+    // don't report again at exit
+    profiled = NULL;
+}
@@ -0,0 +1,36 @@
+/*
+ * Execution profiler. Counts how many times each kind of opcode and each 
+ * address was executed, and samples the host time spent on the opcodes.
+ *
+ * It's only compiled into the chip8-profile build variant(make profile), so 
+ * that the normal build runs exactly the same loop as if it didn't exist
+ * */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+// on average, one out of this many opcodes has its execution timed
+#define PROFILE_SAMPLE_PERIOD 64
+
+// empty timed sections run at start, to measure what timing an opcode costs.
+// The report takes it out of the times of the opcodes
+#define PROFILE_CALIBRATION 10000
+
+// how many entries the report lists for each of its sections
+#define PROFILE_REPORT_TOP 16
+
+// start profiling the machine. The report is written to <path>.txt and
+// <path>.json when the process exits
+void profile_init(MemMaps *mem, const char *path);
+
+// same as step(), but counting and timing the opcode executed
+uint8_t profile_step(cpu *cpuData, MemMaps *mem);
+
+// write the report for everything executed so far. It's only written once,
+// either by calling this or at exit
+void profile_report();
+
+#endif
@@ -0,0 +1,548 @@
+/*
+ * Gameplay recording and export. See record.h
+ * */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "record.h"
+
+#define RECORD_MAGIC "CH8REC\0\0"
+#define FRAME_BYTES (WINDOW_WIDTH * WINDOW_HEIGHT / 8)
+
+// most zeros a single token skips
+#define RECORD_MAX_SKIP (15 + 255)
+
+typedef struct RecordSlot
+{
+    uint64_t frame;
+    uint64_t screen[WINDOW_HEIGHT];
+} RecordSlot;
+
+// single producer, single consumer ring. Only the emulation writes to head
+// and the slots, only the writer thread writes to tail
+typedef struct RecordRing
+{
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+    RecordSlot slots[RECORD_RING_SIZE];
+} RecordRing;
+
+static RecordRing ring;
+static FILE *record_out = NULL;
+static pthread_t writer_thread;
+static _Atomic int writing = 0;
+
+// only touched by the writer thread
+static uint8_t previous[FRAME_BYTES];
+static uint64_t last_frame, last_keyframe;
+static unsigned long frames_stored, frames_dropped;
+
+//******************************************************************************
+//*                               encoding                                     *
+//******************************************************************************
+
+static void put_varint(uint64_t value, FILE *out)
+{
+    while (value >= 0x80)
+    {
+        fputc((value & 0x7F) | 0x80, out);
+        value >>= 7;
+    }
+    fputc(value, out);
+}
+
+// encode the runs of zero bytes of data, see record.h
+static void put_zero_runs(const uint8_t *data, unsigned int len, FILE *out)
+{
+    unsigned int start = 0, skip, literal;
+
+    for (;;)
+    {
+        for (skip = 0; start + skip < len && data[start + skip] == 0; ++skip);
+        start += skip;
+
+        // the zeros up to the end are left to the end token
+        if (start == len) {
+            break;
+        }
+
+        // a single zero costs the same inside the literals as in a new 
+        // token, so only 2 or more of them end the literals
+        for (literal = 1; start + literal < len && literal < 15; ++literal)
+        {
+            if (data[start + literal] == 0 
+                && (start + literal + 1 == len 
+                    || data[start + literal + 1] == 0)) {
+                break;
+            }
+        }
+
+        for (; skip > RECORD_MAX_SKIP; skip -= RECORD_MAX_SKIP)
+        {
+            fputc(0xF0, out);
+            fputc(RECORD_MAX_SKIP - 15, out);
+        }
+
+        if (skip >= 15) {
+            fputc(0xF0 | literal, out);
+            fputc(skip - 15, out);
+        } else {
+            fputc(skip << 4 | literal, out);
+        }
+
+        fwrite(&data[start], 1, literal, out);
+        start += literal;
+    }
+
+    fputc(0, out);
+}
+
+// the screen as bytes, the leftmost pixel first, whatever the host order is
+static void screen_bytes(const uint64_t *screen, uint8_t *bytes)
+{
+    unsigned int row, byte;
+
+    for (row = 0; row < WINDOW_HEIGHT; ++row)
+    {
+        for (byte = 0; byte < WINDOW_WIDTH / 8; ++byte)
+        {
+            bytes[row * WINDOW_WIDTH / 8 + byte] = 
+                screen[row] >> (56 - byte * 8);
+        }
+    }
+}
+
+static void store(const RecordSlot *slot)
+{
+    uint8_t current[FRAME_BYTES], delta[FRAME_BYTES];
+    unsigned int index;
+    int keyframe = frames_stored == 0 
+                   || slot->frame - last_keyframe >= RECORD_KEYFRAME_FRAMES;
+    uint8_t changed = 0;
+
+    screen_bytes(slot->screen, current);
+    for (index = 0; index < FRAME_BYTES; ++index)
+    {
+        uint8_t xor = current[index] ^ previous[index];
+
+        delta[index] = keyframe ? current[index] : xor;
+        changed |= xor;
+    }
+
+    if (!changed && !keyframe) {
+        return;
+    }
+
+    put_varint((slot->frame - last_frame) << 1 | keyframe, record_out);
+    put_zero_runs(delta, FRAME_BYTES, record_out);
+
+    memcpy(previous, current, FRAME_BYTES);
+    last_frame = slot->frame;
+    if (keyframe) {
+        last_keyframe = slot->frame;
+    }
+    ++frames_stored;
+}
+
+// store the frames waiting in the ring
+static void drain()
+{
+    uint32_t tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring.head, memory_order_acquire);
+
+    for (; tail != head; ++tail)
+    {
+        store(&ring.slots[tail & (RECORD_RING_SIZE - 1)]);
+    }
+
+    atomic_store_explicit(&ring.tail, tail, memory_order_release);
+}
+
+static void *writer(void *arg)
+{
+    struct timespec period = { 0, RECORD_DRAIN_MS * 1000000L };
+
+    (void) arg;
+
+    while (atomic_load_explicit(&writing, memory_order_relaxed))
+    {
+        drain();
+        nanosleep(&period, NULL);
+    }
+
+    return NULL;
+}
+
+int record_init(const char *path)
+{
+    uint32_t version = RECORD_VERSION;
+    uint16_t size[2] = { WINDOW_WIDTH, WINDOW_HEIGHT };
+
+    record_out = fopen(path, "wb");
+    if (record_out == NULL) {
+        perror("chip8: ");
+        return 0;
+    }
+
+    fwrite(RECORD_MAGIC, 1, 8, record_out);
+    fwrite(&version, sizeof(version), 1, record_out);
+    fwrite(size, sizeof(size), 1, record_out);
+
+    atomic_store(&writing, 1);
+    if (pthread_create(&writer_thread, NULL, writer, NULL) != 0) {
+        fprintf(stderr, "chip8: couldn't start the recording thread\n");
+        atomic_store(&writing, 0);
+        fclose(record_out);
+        record_out = NULL;
+        return 0;
+    }
+
+    atexit(record_finish);
+    return 1;
+}
+
+void record_frame(uint64_t frame, const uint64_t *screen)
+{
+    if (record_out == NULL) {
+        return;
+    }
+
+    uint32_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+
+    // the writer is too far behind, lose the frame instead of waiting
+    if (head - tail == RECORD_RING_SIZE) {
+        ++frames_dropped;
+        return;
+    }
+
+    RecordSlot *slot = &ring.slots[head & (RECORD_RING_SIZE - 1)];
+    slot->frame = frame;
+    memcpy(slot->screen, screen, sizeof(slot->screen));
+
+    atomic_store_explicit(&ring.head, head + 1, memory_order_release);
+}
+
+void record_finish()
+{
+    if (record_out == NULL) {
+        return;
+    }
+
+    if (atomic_exchange(&writing, 0)) {
+        pthread_join(writer_thread, NULL);
+    }
+    drain();
+
+    fprintf(stderr, "chip8: recorded %lu frames in %ld bytes", 
+            frames_stored, ftell(record_out));
+    if (frames_dropped) {
+        fprintf(stderr, ", %lu dropped", frames_dropped);
+    }
+    fputc('\n', stderr);
+
+    fclose(record_out);
+    record_out = NULL;
+}
+
+//******************************************************************************
+//*                                 export                                     *
+//******************************************************************************
+
+static int get_varint(FILE *in, uint64_t *value)
+{
+    unsigned int shift = 0;
+    int byte;
+
+    *value = 0;
+    do {
+        if ((byte = fgetc(in)) == EOF || shift > 63) {
+            return 0;
+        }
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return 1;
+}
+
+static int get_zero_runs(FILE *in, uint8_t *data, unsigned int len)
+{
+    unsigned int done = 0, skip, literal;
+    int token, extra;
+
+    memset(data, 0, len);
+    while ((token = fgetc(in)) != 0)
+    {
+        if (token == EOF) {
+            return 0;
+        }
+
+        skip = token >> 4;
+        literal = token & 0xF;
+        if (skip == 15) {
+            if ((extra = fgetc(in)) == EOF) {
+                return 0;
+            }
+            skip += extra;
+        }
+
+        done += skip;
+        if (done + literal > len 
+            || fread(&data[done], 1, literal, in) != literal) {
+            return 0;
+        }
+        done += literal;
+    }
+
+    return 1;
+}
+
+static int pixel(const uint8_t *frame, unsigned int x, unsigned int y)
+{
+    return (frame[y * WINDOW_WIDTH / 8 + x / 8] >> (7 - x % 8)) & 1;
+}
+
+static int write_ppm(const char *out, uint64_t number, const uint8_t *frame)
+{
+    char name[4096];
+    unsigned int x, y;
+
+    snprintf(name, sizeof(name), "%s-%07lu.ppm", out, (unsigned long) number);
+    FILE *file = fopen(name, "wb");
+    if (file == NULL) {
+        perror("chip8: ");
+        return 0;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", WINDOW_WIDTH * RECORD_EXPORT_SCALE,
+            WINDOW_HEIGHT * RECORD_EXPORT_SCALE);
+    for (y = 0; y < WINDOW_HEIGHT * RECORD_EXPORT_SCALE; ++y)
+    {
+        for (x = 0; x < WINDOW_WIDTH * RECORD_EXPORT_SCALE; ++x)
+        {
+            int lit = pixel(frame, x / RECORD_EXPORT_SCALE, 
+                            y / RECORD_EXPORT_SCALE);
+            fputc(lit ? 255 : 0, file);
+            fputc(lit ? 255 : 0, file);
+            fputc(lit ? 255 : 0, file);
+        }
+    }
+
+    fclose(file);
+    return 1;
+}
+
+// the GIF writer: two colors, one LZW compressed image per frame
+typedef struct GifBits
+{
+    FILE *out;
+    uint8_t block[255];
+    unsigned int block_len;
+    uint32_t bits;
+    unsigned int bits_len;
+} GifBits;
+
+static void gif_flush_block(GifBits *gif)
+{
+    if (gif->block_len) {
+        fputc(gif->block_len, gif->out);
+        fwrite(gif->block, 1, gif->block_len, gif->out);
+        gif->block_len = 0;
+    }
+}
+
+static void gif_put_code(GifBits *gif, unsigned int code, unsigned int size)
+{
+    gif->bits |= code << gif->bits_len;
+    gif->bits_len += size;
+
+    while (gif->bits_len >= 8)
+    {
+        gif->block[gif->block_len++] = gif->bits & 0xFF;
+        gif->bits >>= 8;
+        gif->bits_len -= 8;
+
+        if (gif->block_len == sizeof(gif->block)) {
+            gif_flush_block(gif);
+        }
+    }
+}
+
+// LZW with a minimum code size of 2, the smallest GIF allows, over pixels
+// that are either 0 or 1
+static void gif_image(FILE *out, const uint8_t *frame, unsigned int delay)
+{
+    static uint16_t children[4096][2];
+    GifBits gif = { .out = out };
+    unsigned int width = WINDOW_WIDTH * RECORD_EXPORT_SCALE;
+    unsigned int height = WINDOW_HEIGHT * RECORD_EXPORT_SCALE;
+    unsigned int clear = 4, stop = 5, next = 6, size = 3;
+    unsigned int x, y, code = 0, first = 1;
+
+    // graphic control extension, for the delay, and the image descriptor
+    fputc(0x21, out); fputc(0xF9, out); fputc(4, out); fputc(0, out);
+    fputc(delay & 0xFF, out); fputc(delay >> 8, out); 
+    fputc(0, out); fputc(0, out);
+    fputc(0x2C, out);
+    fputc(0, out); fputc(0, out); fputc(0, out); fputc(0, out);
+    fputc(width & 0xFF, out); fputc(width >> 8, out);
+    fputc(height & 0xFF, out); fputc(height >> 8, out);
+    fputc(0, out);
+    fputc(2, out);
+
+    memset(children, 0, sizeof(children));
+    gif_put_code(&gif, clear, size);
+
+    for (y = 0; y < height; ++y)
+    {
+        for (x = 0; x < width; ++x)
+        {
+            unsigned int lit = pixel(frame, x / RECORD_EXPORT_SCALE, 
+                                     y / RECORD_EXPORT_SCALE);
+
+            if (first) {
+                code = lit;
+                first = 0;
+            } else if (children[code][lit]) {
+                code = children[code][lit];
+            } else {
+                gif_put_code(&gif, code, size);
+
+                if (next < 4096) {
+                    if (next == (1U << size)) {
+                        ++size;
+                    }
+                    children[code][lit] = next++;
+                } else {
+                    // the table is full, start over
+                    gif_put_code(&gif, clear, size);
+                    memset(children, 0, sizeof(children));
+                    next = 6;
+                    size = 3;
+                }
+                code = lit;
+            }
+        }
+    }
+
+    gif_put_code(&gif, code, size);
+    gif_put_code(&gif, stop, size);
+    if (gif.bits_len) {
+        gif_put_code(&gif, 0, 8 - gif.bits_len);
+    }
+    gif_flush_block(&gif);
+    fputc(0, out);
+}
+
+static void gif_header(FILE *out)
+{
+    unsigned int width = WINDOW_WIDTH * RECORD_EXPORT_SCALE;
+    unsigned int height = WINDOW_HEIGHT * RECORD_EXPORT_SCALE;
+
+    fwrite("GIF89a", 1, 6, out);
+    fputc(width & 0xFF, out); fputc(width >> 8, out);
+    fputc(height & 0xFF, out); fputc(height >> 8, out);
+
+    // a global table of 2 colors, black and white
+    fputc(0x80, out); fputc(0, out); fputc(0, out);
+    fputc(0, out); fputc(0, out); fputc(0, out);
+    fputc(255, out); fputc(255, out); fputc(255, out);
+
+    // loop forever
+    fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, out);
+}
+
+// GIF delays are in 1/100 s, so they are rounded from the frame numbers
+static unsigned int gif_delay(uint64_t from, uint64_t to)
+{
+    return to * 100 / TIMERS_HZ - from * 100 / TIMERS_HZ;
+}
+
+int record_export(const char *path, const char *out)
+{
+    char magic[8];
+    uint32_t version;
+    uint16_t size[2];
+    uint8_t frame[FRAME_BYTES], delta[FRAME_BYTES], shown[FRAME_BYTES];
+    uint64_t header, number = 0, shown_number = 0;
+    unsigned long frames = 0;
+    unsigned int index;
+    size_t out_len = strlen(out);
+    int gif = out_len > 4 && strcmp(out + out_len - 4, ".gif") == 0;
+    FILE *gif_out = NULL;
+
+    FILE *in = fopen(path, "rb");
+    if (in == NULL) {
+        perror("chip8: ");
+        return 0;
+    }
+
+    if (fread(magic, 1, 8, in) != 8 || memcmp(magic, RECORD_MAGIC, 8) != 0
+        || fread(&version, sizeof(version), 1, in) != 1 
+        || version != RECORD_VERSION
+        || fread(size, sizeof(size), 1, in) != 1 
+        || size[0] != WINDOW_WIDTH || size[1] != WINDOW_HEIGHT) {
+        fprintf(stderr, "chip8: %s isn't a recording this version can read\n",
+                path);
+        fclose(in);
+        return 0;
+    }
+
+    if (gif) {
+        gif_out = fopen(out, "wb");
+        if (gif_out == NULL) {
+            perror("chip8: ");
+            fclose(in);
+            return 0;
+        }
+        gif_header(gif_out);
+    }
+
+    memset(frame, 0, sizeof(frame));
+    while (get_varint(in, &header))
+    {
+        if (!get_zero_runs(in, delta, FRAME_BYTES)) {
+            fprintf(stderr, "chip8: %s is truncated\n", path);
+            break;
+        }
+
+        number += header >> 1;
+        for (index = 0; index < FRAME_BYTES; ++index)
+        {
+            frame[index] = (header & 1) ? delta[index] 
+                                        : frame[index] ^ delta[index];
+        }
+
+        // a GIF frame is written once the next one tells how long it lasts
+        if (gif) {
+            if (frames) {
+                gif_image(gif_out, shown, gif_delay(shown_number, number));
+            }
+            memcpy(shown, frame, sizeof(shown));
+            shown_number = number;
+        } else if (!write_ppm(out, number, frame)) {
+            break;
+        }
+        ++frames;
+    }
+
+    if (gif) {
+        if (frames) {
+            gif_image(gif_out, shown, 
+                      gif_delay(shown_number, shown_number + 1));
+        }
+        fputc(0x3B, gif_out);
+        fclose(gif_out);
+    }
+    fclose(in);
+
+    fprintf(stderr, "chip8: exported %lu frames\n", frames);
+    return 1;
+}
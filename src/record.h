@@ -0,0 +1,72 @@
+/*
+ * Gameplay recording. With -R, every presented frame is handed to a writer
+ * thread through a lock-free ring, and the thread stores it as the XOR of 
+ * the previous frame, with the runs of zeros of the XOR, the pixels that 
+ * didn't change, encoded as lengths. Recording costs the emulation a 256 
+ * byte copy per present and no I/O. Frames identical to the previous one
+ * aren't stored at all. Every RECORD_KEYFRAME_FRAMES frames a keyframe, 
+ * XORed with a blank screen, is stored instead, so a player can start from 
+ * it.
+ *
+ * The recording is a binary file:
+ *
+ *   char     magic[8]                "CH8REC\0\0"
+ *   uint32_t version                 RECORD_VERSION
+ *   uint16_t width                   pixels of a row
+ *   uint16_t height                  rows of a frame
+ *
+ *   then, for each frame stored:
+ *   varint   gap << 1 | keyframe     gap being the frames since the last 
+ *                                    one stored, or since the start
+ *   runs     frame                   height * width / 8 bytes, the rows
+ *                                    top to bottom, the leftmost pixel in
+ *                                    the msb of the first byte of its row
+ *
+ * The varints are little endian base 128, and the rest of the integers are
+ * in the byte order of the host that wrote them. The runs are a sequence of
+ * tokens, each a byte with the amount of zero bytes to skip in its high 
+ * nibble and the amount of bytes that follow the token, copied as they are,
+ * in the low nibble. A skip of 15 is followed by a byte to add to it. A 0 
+ * token ends the frame, the rest of its bytes being zeros.
+ *
+ * An hour long recording takes about 15 bytes for each frame in which a 
+ * small sprite moves, and nothing for the frames that don't change
+ * */
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define RECORD_VERSION 1
+
+// frames between keyframes, 10 seconds
+#define RECORD_KEYFRAME_FRAMES 600
+
+// frames the ring holds, several seconds worth so a slow disk doesn't drop 
+// any
+#define RECORD_RING_SIZE 512
+
+// how often the writer thread empties the ring, in ms
+#define RECORD_DRAIN_MS 50
+
+// size of each pixel in the exported images
+#define RECORD_EXPORT_SCALE 4
+
+// start recording to path. Return 0 if it can't be written
+int record_init(const char *path);
+
+// hand a presented screen to the writer thread
+void record_frame(uint64_t frame, const uint64_t *screen);
+
+// stop the writer thread, write what's left and close the recording. It's 
+// also called at exit
+void record_finish();
+
+// convert the recording at path to out: an animated GIF when out ends in 
+// .gif, otherwise a sequence of PPM images named out-<frame>.ppm. Return 0
+// if it couldn't be done
+int record_export(const char *path, const char *out);
+
+#endif
@@ -0,0 +1,360 @@
+/*
+ * Persistent cache of the analysis of roms. See romcache.h
+ * */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "romcache.h"
+#include "opcodes.h"
+
+#define ROMCACHE_MAGIC "CH8MAP\0\0"
+
+// see romcache.h
+#ifndef ROMCACHE_BUILD
+#define ROMCACHE_BUILD \
+    ((uint32_t) hash_bytes(HASH_SEED, __DATE__ " " __TIME__, \
+                           sizeof(__DATE__ " " __TIME__)))
+#endif
+
+// the map of the rom loaded last, and whether it's mapped from its file or
+// only in memory
+static const RomMap *current = NULL;
+static int current_mapped;
+
+// the classes of a map are indexes in opinfo, a build where the table is
+// different can't use them
+static uint32_t opcodes_hash()
+{
+    uint64_t hash = HASH_SEED;
+    unsigned int index;
+
+    for (index = 0; index < opinfo_count; ++index)
+    {
+        hash = hash_bytes(hash, opinfo[index].pattern,
+                     strlen(opinfo[index].pattern) + 1);
+    }
+
+    return (uint32_t) (hash ^ (hash >> 32));
+}
+
+//******************************************************************************
+//*                                 analysis                                   *
+//******************************************************************************
+
+static uint16_t opcode_at(const MemMaps *mems, uint32_t addr)
+{
+    return (mems->ram[addr] << 8) | mems->ram[addr + 1];
+}
+
+static void mark(RomMap *map, uint32_t addr, uint8_t flag)
+{
+    if (addr < map->ram_size) {
+        map->flags[addr] |= flag;
+    }
+}
+
+// queue addr to be followed, once
+static void follow(RomMap *map, uint32_t *pending, uint32_t *count,
+                   uint32_t addr)
+{
+    if (!(map->flags[addr] & ROMMAP_BLOCK)) {
+        map->flags[addr] |= ROMMAP_BLOCK;
+        pending[(*count)++] = addr;
+    }
+}
+
+static unsigned int add_edge(const MemMaps *mems, RomEdge *edges,
+                             unsigned int count, uint32_t to, uint8_t kind)
+{
+    if (to + 1 < mems->ram_size) {
+        edges[count].to = to;
+        edges[count++].kind = kind;
+    }
+
+    return count;
+}
+
+unsigned int romcache_edges(const MemMaps *mems, uint32_t addr,
+                            RomEdge *edges, uint32_t *next)
+{
+    uint16_t opcode = opcode_at(mems, addr);
+    opfunc handler = decode(mems, opcode);
+
+    *next = addr + 2;
+    if (handler == long_i) {
+        *next += 2;
+    }
+
+    if (handler == jump) {
+        return add_edge(mems, edges, 0, opcode & 0x0FFF, ROMEDGE_JUMP);
+    } else if (handler == call) {
+        unsigned int count = add_edge(mems, edges, 0, opcode & 0x0FFF,
+                                      ROMEDGE_CALL);
+        return add_edge(mems, edges, count, *next, ROMEDGE_NEXT);
+    } else if (handler == jmpaddv0 || handler == jmpaddvx) {
+        return add_edge(mems, edges, 0, opcode & 0x0FFF, ROMEDGE_TABLE);
+    } else if (handler == ret || handler == exit_rom) {
+        return 0;
+    } else if (handler == se || handler == sne || handler == svxevy
+               || handler == next_if_vx_not_vy
+               || handler == skipifdown || handler == skipnotdown
+               || handler == se_xo || handler == sne_xo 
+               || handler == svxevy_xo || handler == next_if_vx_not_vy_xo
+               || handler == skipifdown_xo || handler == skipnotdown_xo) {
+        uint32_t skipped = *next + 2;
+
+        // the XO-CHIP skips over F000 NNNN as a whole
+        if ((handler == se_xo || handler == sne_xo || handler == svxevy_xo
+             || handler == next_if_vx_not_vy_xo || handler == skipifdown_xo
+             || handler == skipnotdown_xo)
+            && *next + 1 < mems->ram_size
+            && opcode_at(mems, *next) == 0xF000) {
+            skipped += 2;
+        }
+
+        unsigned int count = add_edge(mems, edges, 0, *next, ROMEDGE_NEXT);
+        return add_edge(mems, edges, count, skipped, ROMEDGE_SKIP);
+    }
+
+    return add_edge(mems, edges, 0, *next, ROMEDGE_NEXT);
+}
+
+// fill the flags and classes of map with what's found following the code
+// from PROG_RAM_START
+static int analyse(RomMap *map, const MemMaps *mems)
+{
+    uint8_t *classes = map->flags + map->ram_size;
+    uint32_t *pending = malloc(map->ram_size * sizeof(*pending));
+    uint32_t count = 0, pc, next;
+    RomEdge edges[ROMCACHE_MAX_EDGES];
+    unsigned int edge, edges_count;
+
+    if (pending == NULL) {
+        return 0;
+    }
+
+    follow(map, pending, &count, PROG_RAM_START);
+
+    while (count)
+    {
+        pc = pending[--count];
+
+        while (!(map->flags[pc] & ROMMAP_CODE))
+        {
+            uint16_t opcode = opcode_at(mems, pc);
+            opfunc handler = decode(mems, opcode);
+
+            map->flags[pc] |= ROMMAP_CODE;
+            classes[pc] = opcode_class(mems, opcode);
+
+            if (handler == long_i) {
+                if (pc + 3 < map->ram_size) {
+                    mark(map, opcode_at(mems, pc + 2), ROMMAP_DATA);
+                }
+            } else if (handler == itoa) {
+                mark(map, opcode & 0x0FFF, ROMMAP_DATA);
+            }
+
+            edges_count = romcache_edges(mems, pc, edges, &next);
+
+            // straight on, the same block
+            if (edges_count == 1 && edges[0].kind == ROMEDGE_NEXT) {
+                pc = edges[0].to;
+                continue;
+            }
+
+            for (edge = 0; edge < edges_count; ++edge)
+            {
+                if (edges[edge].kind == ROMEDGE_TABLE) {
+                    mark(map, edges[edge].to, ROMMAP_TABLE);
+                }
+                follow(map, pending, &count, edges[edge].to);
+            }
+            break;
+        }
+    }
+
+    free(pending);
+    return 1;
+}
+
+RomMap *romcache_analyse(const MemMaps *mems)
+{
+    RomMap *map = calloc(1, sizeof(RomMap) + 2 * (size_t) mems->ram_size);
+
+    if (map == NULL) {
+        return NULL;
+    }
+    map->ram_size = mems->ram_size;
+
+    if (!analyse(map, mems)) {
+        free(map);
+        return NULL;
+    }
+
+    return map;
+}
+
+//******************************************************************************
+//*                                  files                                     *
+//******************************************************************************
+
+// write the directory of the cache to path, creating it. Return 0 if there's
+// no place for it
+static int cache_dir(char *path, size_t size)
+{
+    const char *env;
+
+    if ((env = getenv("CHIP8_CACHE")) != NULL && *env) {
+        snprintf(path, size, "%s", env);
+    } else if ((env = getenv("XDG_CACHE_HOME")) != NULL && *env) {
+        snprintf(path, size, "%s/chip8", env);
+    } else if ((env = getenv("HOME")) != NULL && *env) {
+        snprintf(path, size, "%s/.cache", env);
+        mkdir(path, 0755);
+        snprintf(path, size, "%s/.cache/chip8", env);
+    } else {
+        return 0;
+    }
+
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static size_t map_size(uint32_t ram_size)
+{
+    return sizeof(RomMap) + 2 * (size_t) ram_size;
+}
+
+// map the file at path read-only. Return NULL if it isn't there or its
+// header isn't expected
+static const RomMap *map_file(const char *path, const RomMap *expected)
+{
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) {
+        return NULL;
+    }
+
+    if (fstat(fd, &info) == -1
+        || (size_t) info.st_size != map_size(expected->ram_size)) {
+        close(fd);
+        return NULL;
+    }
+
+    RomMap *map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (memcmp(map, expected, sizeof(RomMap))) {
+        munmap(map, info.st_size);
+        return NULL;
+    }
+
+    return map;
+}
+
+// write map to path, through a temporary file renamed over it
+static int store(const char *path, const RomMap *map)
+{
+    char temp[4096 + 8];
+    size_t size = map_size(map->ram_size);
+    int fd;
+
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", path);
+    if ((fd = mkstemp(temp)) == -1) {
+        return 0;
+    }
+
+    if (fchmod(fd, 0644) == -1 || write(fd, map, size) != (ssize_t) size) {
+        close(fd);
+        unlink(temp);
+        return 0;
+    }
+    close(fd);
+
+    if (rename(temp, path) == -1) {
+        unlink(temp);
+        return 0;
+    }
+
+    return 1;
+}
+
+const RomMap *romcache_open(const uint8_t *rom, uint32_t size,
+                            const MemMaps *mems)
+{
+    char dir[4000], path[4096];
+    RomMap header, *map;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ROMCACHE_MAGIC, sizeof(header.magic));
+    header.version = ROMCACHE_VERSION;
+    header.opcodes = opcodes_hash();
+    header.analysis = ROMCACHE_BUILD;
+    header.hash = hash_bytes(HASH_SEED, rom, size);
+    header.rom_size = size;
+    header.ram_size = mems->ram_size;
+    strncpy(header.quirks, machine_quirks(mems), sizeof(header.quirks) - 1);
+
+    romcache_close();
+
+    // without a cache directory the map is only made for this run
+    int cached = cache_dir(dir, sizeof(dir));
+    if (cached) {
+        snprintf(path, sizeof(path), "%s/%.16llx-%u-%s.map", dir,
+                 (unsigned long long) header.hash, size, header.quirks);
+
+        if ((current = map_file(path, &header)) != NULL) {
+            current_mapped = 1;
+            return current;
+        }
+    }
+
+    // there's no map, or it's from another build: make it again
+    if ((map = romcache_analyse(mems)) == NULL) {
+        return NULL;
+    }
+    memcpy(map, &header, sizeof(header));
+
+    if (cached && store(path, map)
+        && (current = map_file(path, &header)) != NULL) {
+        current_mapped = 1;
+        free(map);
+        return current;
+    }
+
+    // the map is still good for this run
+    current = map;
+    current_mapped = 0;
+    return current;
+}
+
+void romcache_close()
+{
+    if (current == NULL) {
+        return;
+    }
+
+    if (current_mapped) {
+        munmap((void *) current, map_size(current->ram_size));
+    } else {
+        free((void *) current);
+    }
+    current = NULL;
+}
+
+const RomMap *romcache_get()
+{
+    return current;
+}
@@ -0,0 +1,125 @@
+/*
+ * Persistent cache of the analysis of roms. When the debugger is on, 
+ * load_game() hashes the rom it loaded and looks for a map of it, made by an
+ * earlier run, in the cache directory: $CHIP8_CACHE, or chip8 in 
+ * $XDG_CACHE_HOME or ~/.cache. The map is memory mapped read-only, so 
+ * starting the same rom again costs an open and a mmap, whatever the 
+ * analysis costs. The other modes don't look at the analysis, and never
+ * touch the cache.
+ *
+ * The analysis follows the control flow of the rom from PROG_RAM_START,
+ * through jumps, calls and both sides of the skips, marking where the
+ * opcodes and the blocks start, and the addresses ANNN and F000 NNNN point
+ * I to, which are data. BNNN can't be followed, its base is only marked as
+ * a block. Each opcode found is decoded to its opinfo index.
+ *
+ * The map is a binary file named after the hash and size of the rom and the
+ * quirk profile of the machine it was analysed on:
+ *
+ *   char     magic[8]                "CH8MAP\0\0"
+ *   uint32_t version                 ROMCACHE_VERSION
+ *   uint32_t opcodes                 hash of the opinfo table of the build
+ *   uint32_t analysis                ROMCACHE_BUILD, see below
+ *   uint64_t hash                    FNV-1a of the rom
+ *   uint32_t rom_size                bytes of rom
+ *   uint32_t ram_size                addresses described below
+ *   char     quirks[16]              the quirk profile, see machine_quirks()
+ *   uint8_t  flags[ram_size]         ROMMAP_* of each address
+ *   uint8_t  classes[ram_size]       opinfo index of the opcode starting at
+ *                                    each ROMMAP_CODE address, 0 elsewhere
+ *
+ * All the integers are in the byte order of the host that wrote it. A map
+ * whose header doesn't match, because the format, the opcodes of the build,
+ * the code of the analysis or the profile changed, is made again and 
+ * replaces it. The Makefile passes a checksum of the sources the analysis
+ * and the decode tables are built from as ROMCACHE_BUILD, a build without
+ * it uses the time it was compiled at instead. Maps are written
+ * to a temporary file that is then renamed over the old one, so a process
+ * reading a map never sees half of it, and the old one stays valid for
+ * whoever has it mapped
+ * */
+#ifndef ROMCACHE_H
+#define ROMCACHE_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define ROMCACHE_VERSION 2
+
+// bytes of the name of the quirk profile kept in a map
+#define ROMCACHE_QUIRKS_SIZE 16
+
+// what the analysis found at an address
+enum RomMapFlags
+{
+    ROMMAP_CODE   = 1 << 0,      // an opcode starts here
+    ROMMAP_BLOCK  = 1 << 1,      // and a block: the entry point, the target
+                                 // of a jump, call or skip, or a return
+    ROMMAP_DATA   = 1 << 2,      // I is pointed here
+    ROMMAP_TABLE  = 1 << 3       // base of a BNNN jump table
+};
+
+// how control goes from an opcode to the next one
+enum RomEdgeKind
+{
+    ROMEDGE_NEXT,                // falls through, or returns from a call
+    ROMEDGE_SKIP,                // a skip taken
+    ROMEDGE_JUMP,
+    ROMEDGE_CALL,
+    ROMEDGE_TABLE                // BNNN, to the base of the table
+};
+
+// most edges out of an opcode
+#define ROMCACHE_MAX_EDGES 2
+
+typedef struct RomEdge
+{
+    uint32_t to;
+    uint8_t kind;                // RomEdgeKind
+} RomEdge;
+
+typedef struct RomMap
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t opcodes;
+    uint32_t analysis;
+    uint64_t hash;
+    uint32_t rom_size;
+    uint32_t ram_size;
+    char quirks[ROMCACHE_QUIRKS_SIZE];
+    uint8_t flags[];             // then the classes, see romcache_classes()
+} RomMap;
+
+static inline const uint8_t *romcache_classes(const RomMap *map)
+{
+    return map->flags + map->ram_size;
+}
+
+// find the map of the size bytes of rom, loaded in mems, or analyse the rom
+// and store the map when there's none. Return NULL if there's no map. A 
+// cache that can't be read or written is left alone without a word, the 
+// map is then only kept in memory. The map of the rom opened before is released first, the
+// new one stays until the next romcache_open() or romcache_close()
+const RomMap *romcache_open(const uint8_t *rom, uint32_t size,
+                            const MemMaps *mems);
+
+// analyse the rom loaded in mems, without looking at the cache. Only the 
+// ram_size of the header is filled. The map is freed by the caller, NULL is
+// returned if there's no memory for it
+RomMap *romcache_analyse(const MemMaps *mems);
+
+// the edges out of the opcode at addr of the rom loaded in mems, those that
+// stay in its ram, as the analysis follows them. *next is set to where the
+// opcode after it starts. Return the amount of edges, 0 for RET and EXIT
+unsigned int romcache_edges(const MemMaps *mems, uint32_t addr,
+                            RomEdge *edges, uint32_t *next);
+
+// the map returned by the last romcache_open(), NULL if there's none
+const RomMap *romcache_get();
+
+// release the map of the last romcache_open(), unmapping or freeing it
+void romcache_close();
+
+#endif
@@ -0,0 +1,366 @@
+/*
+ * Server mode. See server.h
+ * */
+
+// accept4()
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "server.h"
+#include "trace.h"
+
+// events taken from epoll at once by a thread
+#define SERVER_EVENTS 16
+
+typedef struct Session
+{
+    int sock;
+    int timer;                              // timerfd, 60 Hz while running
+
+    uint8_t parked;                         // waiting for a key, the timer is
+                                            // stopped
+    uint64_t parked_ns;                     // when it was parked
+    unsigned long frame;                    // frames run
+
+    cpu cpuData;
+    MemMaps mems;
+} Session;
+
+static int epoll_fd;
+static int listen_fd;
+static const char *socket_path;
+
+static const uint8_t *server_rom;
+static unsigned int server_game_size;
+static const char *server_quirks;
+
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void unlink_socket()
+{
+    unlink(socket_path);
+}
+
+// arm fd for a single event of the session
+static void arm(Session *session, int fd, int add)
+{
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLONESHOT,
+        .data.ptr = session
+    };
+
+    if (epoll_ctl(epoll_fd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, 
+                  &event) == -1) {
+        perror("chip8: epoll_ctl");
+    }
+}
+
+// run the timer of session at 60 Hz, starting a frame from now
+static void timer_start(Session *session)
+{
+    struct itimerspec spec = {
+        .it_interval = { 0, TIMERS_HZ_NS },
+        .it_value = { 0, TIMERS_HZ_NS }
+    };
+
+    timerfd_settime(session->timer, 0, &spec, NULL);
+}
+
+static void timer_stop(Session *session)
+{
+    struct itimerspec spec = { 0 };
+
+    timerfd_settime(session->timer, 0, &spec, NULL);
+}
+
+static void session_end(Session *session)
+{
+    // closing the fds also takes them out of epoll
+    close(session->sock);
+    close(session->timer);
+    free(session);
+}
+
+static void session_start(int sock)
+{
+    Session *session = calloc(1, sizeof(Session));
+    if (session == NULL) {
+        close(sock);
+        return;
+    }
+
+    session->sock = sock;
+    session->timer = timerfd_create(CLOCK_MONOTONIC, 
+                                    TFD_NONBLOCK | TFD_CLOEXEC);
+    if (session->timer == -1) {
+        perror("chip8: timerfd_create");
+        close(sock);
+        free(session);
+        return;
+    }
+
+    initialize(&session->cpuData, &session->mems, server_quirks);
+    load_rom(server_rom, server_game_size, &session->mems);
+
+    timer_start(session);
+    arm(session, session->timer, 1);
+}
+
+// read the keys sent since the last call. Return 0 if the client is gone
+static int session_keys(Session *session)
+{
+    ServerKeys message;
+    ssize_t got;
+    uint8_t key;
+
+    while ((got = recv(session->sock, &message, sizeof(message), 
+                       MSG_DONTWAIT)) > 0)
+    {
+        if (got != sizeof(message)) {
+            continue;
+        }
+
+        for (key = 0; key < 16; ++key)
+        {
+            session->mems.keys[key] = (message.keys >> key) & 1;
+        }
+    }
+
+    return got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// run a frame of session. Return 0 if the session is over
+static int session_frame(Session *session)
+{
+    cpu *cpuData = &session->cpuData;
+    MemMaps *mems = &session->mems;
+    unsigned int cycle, cycles = frame_cycles(mems, session->frame);
+
+    mems->keys_read = 0;
+    for (cycle = 0; cycle < cycles; ++cycle)
+    {
+        if (cpuData->pc > server_game_size + PROG_RAM_START) {
+            return 0;
+        }
+
+        uint16_t pc = cpuData->pc;
+        if (step(cpuData, mems) != FAULT_NONE) {
+            trace(TRACE_ERROR, TRACE_FAULT, cpuData->pc, cpuData->fault, 0);
+            return 0;
+        }
+
+        // FX0A without a key and a jump to itself leave pc where it was, and
+        // nothing but a key can change that, so there's no point running
+        // the rest of the frame
+        uint16_t opcode = (mems->ram[pc] << 8) | mems->ram[pc + 1];
+        if (cpuData->pc == pc && ((opcode & 0xF0FF) == 0xF00A 
+                                  || (opcode & 0xF000) == 0x1000)) {
+            session->parked = 1;
+            break;
+        }
+    }
+
+    timers_step(cpuData);
+    ++session->frame;
+
+    if (mems->redraw) {
+        ServerFrame message;
+
+        message.frame = session->frame;
+        screen_lores(mems, message.screen);
+
+        // a client that doesn't keep up loses frames instead of stalling 
+        // the thread, the screen is sent again on the next change
+        if (send(session->sock, &message, sizeof(message), 
+                 MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return 0;
+            }
+        }
+        mems->redraw = 0;
+    }
+
+    return 1;
+}
+
+// the timer of a running session expired
+static void session_timer(Session *session)
+{
+    uint64_t expirations = 0;
+
+    if (read(session->timer, &expirations, sizeof(expirations)) == -1) {
+        expirations = 0;
+    }
+
+    if (expirations > SERVER_MAX_CATCHUP) {
+        expirations = SERVER_MAX_CATCHUP;
+    }
+
+    if (!session_keys(session)) {
+        session_end(session);
+        return;
+    }
+
+    for (; expirations && !session->parked; --expirations)
+    {
+        if (!session_frame(session)) {
+            session_end(session);
+            return;
+        }
+    }
+
+    if (session->parked) {
+        timer_stop(session);
+        session->parked_ns = monotonic_ns();
+
+        // the socket is only in epoll while parked, even a disarmed fd gets
+        // EPOLLHUP, which would run the session on two threads at once
+        arm(session, session->sock, 1);
+    } else {
+        arm(session, session->timer, 0);
+    }
+}
+
+// a parked session got input
+static void session_wake(Session *session)
+{
+    uint8_t *timers[2] = { &session->cpuData.dt, &session->cpuData.st };
+    uint64_t slept = (monotonic_ns() - session->parked_ns) / TIMERS_HZ_NS;
+    unsigned int timer;
+
+    if (!session_keys(session)) {
+        session_end(session);
+        return;
+    }
+
+    // the timers kept counting while the session slept
+    for (timer = 0; timer < 2; ++timer)
+    {
+        *timers[timer] = slept >= *timers[timer] ? 0 : *timers[timer] - slept;
+    }
+    session->frame += slept;
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->sock, NULL);
+    session->parked = 0;
+    timer_start(session);
+    arm(session, session->timer, 0);
+}
+
+static void accept_clients()
+{
+    int sock;
+
+    while ((sock = accept4(listen_fd, NULL, NULL, 
+                           SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        session_start(sock);
+    }
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("chip8: accept");
+    }
+
+    arm(NULL, listen_fd, 0);
+}
+
+static void *server_thread(void *arg)
+{
+    struct epoll_event events[SERVER_EVENTS];
+    int count, index;
+
+    (void) arg;
+
+    for (;;)
+    {
+        count = epoll_wait(epoll_fd, events, SERVER_EVENTS, -1);
+
+        for (index = 0; index < count; ++index)
+        {
+            Session *session = events[index].data.ptr;
+
+            if (session == NULL) {
+                accept_clients();
+            } else if (session->parked) {
+                session_wake(session);
+            } else {
+                session_timer(session);
+            }
+        }
+
+        if (count == -1 && errno != EINTR) {
+            perror("chip8: epoll_wait");
+            return NULL;
+        }
+    }
+}
+
+void server(const char *path, const uint8_t *rom, unsigned int game_size,
+            unsigned int threads, const char *quirks)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    pthread_t thread;
+    unsigned int index;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "chip8: socket path too long: %s\n", path);
+        return;
+    }
+    strcpy(address.sun_path, path);
+
+    server_rom = rom;
+    server_game_size = game_size;
+    server_quirks = quirks;
+    socket_path = path;
+
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                       0);
+    if (listen_fd == -1) {
+        perror("chip8: socket");
+        return;
+    }
+
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) == -1
+        || listen(listen_fd, SOMAXCONN) == -1) {
+        perror("chip8: ");
+        return;
+    }
+    atexit(unlink_socket);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        perror("chip8: epoll_create1");
+        return;
+    }
+    arm(NULL, listen_fd, 1);
+
+    // this thread is one of the pool too
+    for (index = 1; index < threads; ++index)
+    {
+        if (pthread_create(&thread, NULL, server_thread, NULL) != 0) {
+            fprintf(stderr, "chip8: couldn't start server thread %u\n", index);
+            break;
+        }
+        pthread_detach(thread);
+    }
+
+    server_thread(NULL);
+}
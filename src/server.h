@@ -0,0 +1,53 @@
+/*
+ * Server mode. A single process hosts a session of the game for every 
+ * client that connects to a Unix socket, on a few threads instead of a 
+ * process and a window per player.
+ *
+ * Sessions are state machines driven by a pool of threads that share an 
+ * epoll instance. A running session owns a timerfd that expires 60 times a 
+ * second, and every expiration runs one frame and gives the thread back.
+ * When the game can't do anything until a key changes, waiting in FX0A or
+ * jumping to itself, the timer is stopped and the session only wakes up on
+ * input, so idle sessions cost nothing. The frames they slept through are
+ * applied to the timers when they wake up, so DT and ST still count at 60 Hz.
+ *
+ * Only one of the fds of a session is in epoll at a time, armed with 
+ * EPOLLONESHOT, so a session is never run by two threads at once and needs 
+ * no locks.
+ *
+ * The socket is SOCK_SEQPACKET, each message is one of the structs below, 
+ * in host byte order:
+ *   client -> server: ServerKeys, the keys held down
+ *   server -> client: ServerFrame, after every frame that changed the screen
+ * The server closes the connection when the game ends or faults
+ * */
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define SERVER_DEFAULT_THREADS 4
+
+// frames a late session runs at once to catch up, the rest are dropped
+#define SERVER_MAX_CATCHUP 4
+
+typedef struct ServerKeys
+{
+    uint16_t keys;                          // bit n is key n
+} ServerKeys;
+
+typedef struct ServerFrame
+{
+    uint64_t frame;                         // frames since the session began
+    uint64_t screen[WINDOW_HEIGHT];         // same layout as MemMaps.screen
+} ServerFrame;
+
+// serve the rom of game_size bytes to every client of the socket at path, 
+// on threads threads, each session a machine with the quirk profile called
+// quirks. Only returns if the server can't be started
+void server(const char *path, const uint8_t *rom, unsigned int game_size,
+            unsigned int threads, const char *quirks);
+
+#endif
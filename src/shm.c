@@ -0,0 +1,71 @@
+/*
+ * Helpers for POSIX shared memory. See shm.h
+ * */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+void *shm_create(const char *name, size_t size)
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1) {
+        perror("chip8: shm_open");
+        return NULL;
+    }
+
+    if (ftruncate(fd, size) == -1) {
+        perror("chip8: ftruncate");
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        perror("chip8: mmap");
+        shm_unlink(name);
+        return NULL;
+    }
+
+    return addr;
+}
+
+void *shm_attach(const char *name, size_t *size, int writable)
+{
+    struct stat info;
+    int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+
+    if (fd == -1) {
+        return NULL;
+    }
+
+    if (fstat(fd, &info) == -1 || info.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, info.st_size, 
+                      writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+
+    *size = info.st_size;
+    return addr;
+}
+
+void shm_detach(void *addr, size_t size)
+{
+    munmap(addr, size);
+}
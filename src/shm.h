@@ -0,0 +1,20 @@
+/*
+ * Helpers for the POSIX shared memory segments the emulator publishes
+ * */
+#ifndef SHM_H
+#define SHM_H
+
+#include <stddef.h>
+
+// create the segment name with size bytes, zeroed, and map it read-write.
+// Return NULL and print why if it can't be done
+void *shm_create(const char *name, size_t size);
+
+// map the existing segment name. size is set to the size of the segment.
+// Return NULL if it can't be done
+void *shm_attach(const char *name, size_t *size, int writable);
+
+// unmap a segment mapped by the functions above
+void shm_detach(void *addr, size_t size);
+
+#endif
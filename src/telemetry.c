@@ -0,0 +1,132 @@
+/*
+ * Live telemetry. See telemetry.h
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "shm.h"
+#include "telemetry.h"
+
+#define SECOND_NS 1000000000ULL
+
+static char segment_name[64];
+static Telemetry *segment = NULL;
+
+// counters of the second being measured, published when it ends
+static uint64_t window_start_ns;
+static uint32_t window_instructions, window_frames, window_presents;
+static int64_t window_jitter_max, window_overshoot_max;
+
+// remove the segment even when exit() is called from deep inside the loop
+static void close_atexit()
+{
+    telemetry_close(segment);
+}
+
+Telemetry *telemetry_open()
+{
+    snprintf(segment_name, sizeof(segment_name), "%s%d", 
+             TELEMETRY_PREFIX, (int) getpid());
+
+    Telemetry *telemetry = shm_create(segment_name, sizeof(Telemetry));
+    if (telemetry == NULL) {
+        return NULL;
+    }
+
+    telemetry->version = TELEMETRY_VERSION;
+    telemetry->size = sizeof(Telemetry);
+    telemetry->pid = getpid();
+
+    // readers check the magic last, so they never see a half made header
+    atomic_thread_fence(memory_order_release);
+    telemetry->magic = TELEMETRY_MAGIC;
+
+    window_start_ns = 0;
+
+    if (segment == NULL) {
+        atexit(close_atexit);
+    }
+    segment = telemetry;
+
+    return telemetry;
+}
+
+void telemetry_frame(Telemetry *telemetry, const FrameReport *report)
+{
+    if (telemetry == NULL) {
+        return;
+    }
+
+    if (window_start_ns == 0) {
+        window_start_ns = report->now_ns;
+    }
+
+    ++window_frames;
+    window_instructions += report->instructions;
+    window_presents += report->presents;
+    if (report->jitter_ns > window_jitter_max) {
+        window_jitter_max = report->jitter_ns;
+    }
+    if (report->overshoot_ns > window_overshoot_max) {
+        window_overshoot_max = report->overshoot_ns;
+    }
+
+    atomic_fetch_add_explicit(&telemetry->frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&telemetry->instructions, report->instructions,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&telemetry->presents, report->presents,
+                              memory_order_relaxed);
+    atomic_store_explicit(&telemetry->unknown_opcodes, report->unknown_opcodes,
+                          memory_order_relaxed);
+    atomic_store_explicit(&telemetry->jitter_ns, report->jitter_ns,
+                          memory_order_relaxed);
+    atomic_store_explicit(&telemetry->overshoot_ns, report->overshoot_ns,
+                          memory_order_relaxed);
+    atomic_store_explicit(&telemetry->pc, report->pc, memory_order_relaxed);
+    atomic_store_explicit(&telemetry->skipped_catchup, report->skipped_catchup,
+                          memory_order_relaxed);
+    atomic_store_explicit(&telemetry->skipped_interval,
+                          report->skipped_interval, memory_order_relaxed);
+    atomic_store_explicit(&telemetry->dropped, report->dropped,
+                          memory_order_relaxed);
+    atomic_store_explicit(&telemetry->present_interval,
+                          report->present_interval, memory_order_relaxed);
+    atomic_store_explicit(&telemetry->updated_ns, report->now_ns,
+                          memory_order_relaxed);
+
+    // a second went by, publish its rates and start measuring the next one
+    uint64_t elapsed = report->now_ns - window_start_ns;
+    if (elapsed >= SECOND_NS) {
+        atomic_store_explicit(&telemetry->ips, 
+                              window_instructions * SECOND_NS / elapsed,
+                              memory_order_relaxed);
+        atomic_store_explicit(&telemetry->fps, 
+                              window_frames * SECOND_NS / elapsed,
+                              memory_order_relaxed);
+        atomic_store_explicit(&telemetry->pps, 
+                              window_presents * SECOND_NS / elapsed,
+                              memory_order_relaxed);
+        atomic_store_explicit(&telemetry->jitter_max_ns, window_jitter_max,
+                              memory_order_relaxed);
+        atomic_store_explicit(&telemetry->overshoot_max_ns, 
+                              window_overshoot_max, memory_order_relaxed);
+
+        window_start_ns = report->now_ns;
+        window_instructions = window_frames = window_presents = 0;
+        window_jitter_max = window_overshoot_max = 0;
+    }
+}
+
+void telemetry_close(Telemetry *telemetry)
+{
+    if (telemetry == NULL) {
+        return;
+    }
+
+    shm_unlink(segment_name);
+    shm_detach(telemetry, sizeof(Telemetry));
+    segment = NULL;
+}
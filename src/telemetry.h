@@ -0,0 +1,82 @@
+/*
+ * Live telemetry. Each running emulator publishes its counters to the shared
+ * memory segment TELEMETRY_PREFIX<pid>, where chip8stat, or anything else,
+ * can read them without stopping it.
+ *
+ * The counters are updated once per frame, with relaxed atomic stores, so
+ * a reader may see the fields of two consecutive frames mixed together
+ * */
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define TELEMETRY_PREFIX "/chip8-telemetry-"
+#define TELEMETRY_MAGIC 0x43385445          // "ET8C"
+#define TELEMETRY_VERSION 1
+
+// layout of the segment. New fields go at the end, so readers of an older
+// version can still read the ones they know about
+typedef struct Telemetry
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                          // sizeof(Telemetry) of the writer
+    int32_t pid;
+
+    _Atomic uint64_t updated_ns;            // CLOCK_MONOTONIC of last update
+
+    // totals since the emulator started
+    _Atomic uint64_t frames;
+    _Atomic uint64_t instructions;
+    _Atomic uint64_t presents;
+    _Atomic uint64_t unknown_opcodes;
+
+    // rates over the last whole second
+    _Atomic uint32_t ips;                   // instructions per second
+    _Atomic uint32_t fps;                   // frames per second
+    _Atomic uint32_t pps;                   // presents per second
+
+    // frame pacing, in ns. The max values are over the last whole second
+    _Atomic int64_t jitter_ns;              // frame interval - 1/60 s
+    _Atomic int64_t jitter_max_ns;
+    _Atomic int64_t overshoot_ns;           // wake up - end of the sleep
+    _Atomic int64_t overshoot_max_ns;
+
+    _Atomic uint32_t pc;
+
+    // frame skipping, totals since the start, see pacing.h
+    _Atomic uint64_t skipped_catchup;       // presents skipped catching up
+    _Atomic uint64_t skipped_interval;      // and presenting at a lower rate
+    _Atomic uint64_t dropped;               // frames never run
+    _Atomic uint32_t present_interval;      // frames per present right now
+} Telemetry;
+
+// what happened during a frame, as measured by the main loop
+typedef struct FrameReport
+{
+    uint64_t now_ns;
+    uint32_t instructions;
+    uint32_t presents;
+    uint32_t unknown_opcodes;               // total since the start
+    uint16_t pc;
+    int64_t jitter_ns;
+    int64_t overshoot_ns;
+    uint64_t skipped_catchup;               // totals since the start
+    uint64_t skipped_interval;
+    uint64_t dropped;
+    uint32_t present_interval;
+} FrameReport;
+
+// create the segment of this process. Return NULL if it can't be created, 
+// and the other functions accept that NULL and do nothing
+Telemetry *telemetry_open();
+
+// publish the counters of a frame
+void telemetry_frame(Telemetry *telemetry, const FrameReport *report);
+
+// remove the segment. It's also removed at exit, if it wasn't before
+void telemetry_close(Telemetry *telemetry);
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ * Lock-free tracing. See trace.h
+ * */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+// an event counted instead of written, because it already was
+typedef struct TraceRepeat
+{
+    uint16_t id;
+    uint16_t pc;
+    uint16_t args[2];
+    _Atomic uint32_t count;
+} TraceRepeat;
+
+// single producer, single consumer ring. Only its thread writes to head
+// and the events, only the drain writes to tail
+typedef struct TraceRing
+{
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+    _Alignas(64) _Atomic uint64_t dropped;
+    TraceRepeat repeats[TRACE_REPEAT_SLOTS];
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+// what to do with each kind of event
+static const struct
+{
+    uint8_t level;
+    uint8_t aggregate;
+} event_kinds[TRACE_EVENT_COUNT] =
+{
+    [TRACE_DRAW]           = { TRACE_DEBUG, 0 },
+    [TRACE_UNKNOWN_OPCODE] = { TRACE_WARN,  1 },
+    [TRACE_KEY_WAIT]       = { TRACE_DEBUG, 1 },
+    [TRACE_FAULT]          = { TRACE_ERROR, 0 },
+};
+
+static const char *level_names[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+
+static __thread TraceRing *thread_ring = NULL;
+
+static TraceRing *rings[TRACE_MAX_THREADS];
+static _Atomic unsigned int rings_count = 0;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// serializes the consumers of the rings
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t drain_thread;
+static _Atomic int draining = 0;
+static FILE *drain_out = NULL;
+
+static uint64_t now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// create the ring of the calling thread. Return NULL if there's no room
+// left for it
+static TraceRing *ring_create()
+{
+    TraceRing *ring = aligned_alloc(64, sizeof(TraceRing));
+    if (ring == NULL) {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(TraceRing));
+
+    pthread_mutex_lock(&rings_lock);
+    unsigned int count = atomic_load(&rings_count);
+    if (count == TRACE_MAX_THREADS) {
+        pthread_mutex_unlock(&rings_lock);
+        free(ring);
+        return NULL;
+    }
+    rings[count] = ring;
+    atomic_store_explicit(&rings_count, count + 1, memory_order_release);
+    pthread_mutex_unlock(&rings_lock);
+
+    return ring;
+}
+
+static void ring_push(TraceRing *ring, uint64_t time, uint32_t count,
+                      uint16_t id, uint16_t pc, uint16_t arg0, uint16_t arg1)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail == TRACE_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    TraceEvent *event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+    event->time = time;
+    event->count = count;
+    event->id = id;
+    event->pc = pc;
+    event->args[0] = arg0;
+    event->args[1] = arg1;
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_write(uint16_t id, uint16_t pc, uint16_t arg0, uint16_t arg1)
+{
+    TraceRing *ring = thread_ring;
+
+    if (ring == NULL && (ring = thread_ring = ring_create()) == NULL) {
+        return;
+    }
+
+    if (event_kinds[id].aggregate) {
+        unsigned int slot = (id * 31 + pc * 17 + arg0 * 7 + arg1) 
+                            & (TRACE_REPEAT_SLOTS - 1);
+        TraceRepeat *repeat = &ring->repeats[slot];
+        uint32_t count = atomic_load_explicit(&repeat->count, 
+                                              memory_order_relaxed);
+
+        if (count && repeat->id == id && repeat->pc == pc 
+            && repeat->args[0] == arg0 && repeat->args[1] == arg1) {
+            atomic_store_explicit(&repeat->count, count + 1, 
+                                  memory_order_relaxed);
+            return;
+        }
+
+        // another event takes the slot, write how many times the one
+        // leaving it repeated
+        if (count > 1) {
+            ring_push(ring, now_ns(), count - 1, repeat->id, repeat->pc,
+                      repeat->args[0], repeat->args[1]);
+        }
+
+        repeat->id = id;
+        repeat->pc = pc;
+        repeat->args[0] = arg0;
+        repeat->args[1] = arg1;
+        atomic_store_explicit(&repeat->count, 1, memory_order_relaxed);
+    }
+
+    ring_push(ring, now_ns(), 1, id, pc, arg0, arg1);
+}
+
+//******************************************************************************
+//*                              draining                                      *
+//******************************************************************************
+
+static void format_event(FILE *out, uint16_t id, uint16_t pc, 
+                         uint16_t *args)
+{
+    switch (id)
+    {
+        case TRACE_DRAW:
+            fprintf(out, "Writing %i bytes of data to (%i, %i) at %#X",
+                    args[0] & 0xF, args[1] >> 8, args[1] & 0xFF, pc);
+            break;
+        case TRACE_UNKNOWN_OPCODE:
+            fprintf(out, "Unknown opcode %#X at %#X", args[0], pc);
+            break;
+        case TRACE_KEY_WAIT:
+            fprintf(out, "Waiting for key into V%X at %#X", args[0], pc);
+            break;
+        case TRACE_FAULT:
+            fprintf(out, "Fault %i at %#X", args[0], pc);
+            break;
+        default:
+            fprintf(out, "Event %i at %#X", id, pc);
+    }
+}
+
+void trace_dump(FILE *out)
+{
+    unsigned int count, index;
+
+    pthread_mutex_lock(&drain_lock);
+
+    count = atomic_load_explicit(&rings_count, memory_order_acquire);
+    for (index = 0; index < count; ++index)
+    {
+        TraceRing *ring = rings[index];
+        uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        for (; tail != head; ++tail)
+        {
+            TraceEvent *event = &ring->events[tail & (TRACE_RING_SIZE - 1)];
+
+            fprintf(out, "[%s] ", level_names[event_kinds[event->id].level]);
+            format_event(out, event->id, event->pc, event->args);
+            if (event->count > 1) {
+                fprintf(out, " repeated %u more times", event->count);
+            }
+            fputc('\n', out);
+        }
+
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    fflush(out);
+
+    pthread_mutex_unlock(&drain_lock);
+}
+
+void trace_summary(FILE *out)
+{
+    unsigned int count, index, slot;
+
+    pthread_mutex_lock(&drain_lock);
+
+    count = atomic_load_explicit(&rings_count, memory_order_acquire);
+    for (index = 0; index < count; ++index)
+    {
+        TraceRing *ring = rings[index];
+
+        for (slot = 0; slot < TRACE_REPEAT_SLOTS; ++slot)
+        {
+            TraceRepeat *repeat = &ring->repeats[slot];
+            uint32_t repeated = atomic_load_explicit(&repeat->count,
+                                                     memory_order_relaxed);
+            if (repeated <= 1) {
+                continue;
+            }
+
+            fprintf(out, "[%s] ", level_names[event_kinds[repeat->id].level]);
+            format_event(out, repeat->id, repeat->pc, repeat->args);
+            fprintf(out, " repeated %u more times\n", repeated - 1);
+        }
+
+        uint64_t dropped = atomic_load_explicit(&ring->dropped,
+                                                memory_order_relaxed);
+        if (dropped) {
+            fprintf(out, "[WARNING] %lu trace events dropped\n",
+                    (unsigned long) dropped);
+        }
+    }
+    fflush(out);
+
+    pthread_mutex_unlock(&drain_lock);
+}
+
+static void *drain(void *arg)
+{
+    struct timespec period = { 0, TRACE_DRAIN_MS * 1000000L };
+
+    while (atomic_load_explicit(&draining, memory_order_relaxed))
+    {
+        trace_dump(drain_out);
+        nanosleep(&period, NULL);
+    }
+
+    return NULL;
+}
+
+void trace_start(FILE *out)
+{
+    drain_out = out;
+    atomic_store(&draining, 1);
+
+    if (pthread_create(&drain_thread, NULL, drain, NULL) != 0) {
+        fprintf(stderr, "chip8: couldn't start the trace thread\n");
+        atomic_store(&draining, 0);
+    }
+}
+
+void trace_stop()
+{
+    if (atomic_exchange(&draining, 0)) {
+        pthread_join(drain_thread, NULL);
+        trace_dump(drain_out);
+    }
+}
@@ -0,0 +1,90 @@
+/*
+ * Tracing of what happens inside the emulator, meant to replace printf and
+ * fprintf on the paths executed for every opcode.
+ *
+ * Each thread writes fixed-size binary events to its own lock-free ring,
+ * that is only read by whoever drains the traces: either a background thread
+ * started with trace_start(), or trace_dump() when called directly. If a ring
+ * is full, its events are dropped and counted instead of blocking the writer.
+ *
+ * Events of a level lower than TRACE_LEVEL are removed at compile time, and 
+ * events that tend to repeat(like an unknown opcode inside a loop) are only
+ * written the first time, and then counted
+ * */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum TraceLevels
+{
+    TRACE_DEBUG,
+    TRACE_INFO,
+    TRACE_WARN,
+    TRACE_ERROR,
+    TRACE_OFF                    // as TRACE_LEVEL, removes every event
+};
+
+// events below this level don't make it into the binary
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_INFO
+#endif
+
+// events per thread ring, must be a power of 2
+#define TRACE_RING_SIZE 4096
+
+// slots used per thread to count repeated events, must be a power of 2
+#define TRACE_REPEAT_SLOTS 64
+
+// maximum amount of threads that can write events
+#define TRACE_MAX_THREADS 64
+
+// how often the background thread drains the rings, in ms
+#define TRACE_DRAIN_MS 20
+
+enum TraceEvents
+{
+    TRACE_DRAW,                  // args: opcode, x << 8 | y
+    TRACE_UNKNOWN_OPCODE,        // args: opcode
+    TRACE_KEY_WAIT,              // args: register waiting for the key
+    TRACE_FAULT,                 // args: fault
+    TRACE_EVENT_COUNT
+};
+
+typedef struct TraceEvent
+{
+    uint64_t time;               // CLOCK_MONOTONIC time, in ns
+    uint32_t count;              // times it happened, when aggregated
+    uint16_t id;                 // TraceEvents
+    uint16_t pc;                 // address of the opcode that raised it
+    uint16_t args[2];
+} TraceEvent;
+
+// write an event to the ring of the calling thread, unless it's filtered out
+// at compile time
+#define trace(level, id, pc, arg0, arg1)                                      \
+    do {                                                                      \
+        if ((level) >= TRACE_LEVEL) {                                         \
+            trace_write((id), (pc), (arg0), (arg1));                          \
+        }                                                                     \
+    } while (0)
+
+// use the trace() macro instead, so that the level filtering applies
+void trace_write(uint16_t id, uint16_t pc, uint16_t arg0, uint16_t arg1);
+
+// start a thread that drains the rings to out every TRACE_DRAIN_MS
+void trace_start(FILE *out);
+
+// stop the draining thread, if any, and drain what is left to it
+void trace_stop();
+
+// drain every ring to out, as text. Safe to call while the background 
+// thread is running
+void trace_dump(FILE *out);
+
+// write to out how many times each aggregated event repeated, and how many
+// events were dropped because the rings were full
+void trace_summary(FILE *out);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Synthetic roms for the benchmarks and the training mode. See workloads.h
+ * */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "workloads.h"
+
+// the 8XYN opcodes, plus an ADD to keep the values moving
+static const uint8_t alu[] =
+{
+    0x60, 0x01,                  // 0x200 LD V0, 0x01
+    0x61, 0x03,                  // 0x202 LD V1, 0x03
+    0x80, 0x14,                  // 0x204 ADD V0, V1
+    0x81, 0x05,                  // 0x206 SUB V1, V0
+    0x82, 0x03,                  // 0x208 XOR V2, V0
+    0x83, 0x16,                  // 0x20A SHR V3, V1
+    0x84, 0x21,                  // 0x20C OR V4, V2
+    0x85, 0x32,                  // 0x20E AND V5, V3
+    0x86, 0x47,                  // 0x210 SUBN V6, V4
+    0x87, 0x5E,                  // 0x212 SHL V7, V5
+    0x88, 0x60,                  // 0x214 LD V8, V6
+    0x70, 0x05,                  // 0x216 ADD V0, 0x05
+    0x12, 0x04                   // 0x218 JP 0x204
+};
+
+// skips, half of them taken, as V0 counts up and V1 stays 0
+static const uint8_t branch[] =
+{
+    0x60, 0x00,                  // 0x200 LD V0, 0x00
+    0x70, 0x01,                  // 0x202 ADD V0, 0x01
+    0x30, 0x00,                  // 0x204 SE V0, 0x00
+    0x40, 0x01,                  // 0x206 SNE V0, 0x01
+    0x50, 0x10,                  // 0x208 SE V0, V1
+    0x90, 0x10,                  // 0x20A SNE V0, V1
+    0x31, 0x00,                  // 0x20C SE V1, 0x00
+    0x00, 0x00,                  // 0x20E skipped
+    0x12, 0x02                   // 0x210 JP 0x202
+};
+
+// nested calls, 2 deep
+static const uint8_t call[] =
+{
+    0x22, 0x06,                  // 0x200 CALL 0x206
+    0x12, 0x00,                  // 0x202 JP 0x200
+    0x00, 0x00,
+    0x22, 0x0C,                  // 0x206 CALL 0x20C
+    0x71, 0x01,                  // 0x208 ADD V1, 0x01
+    0x00, 0xEE,                  // 0x20A RET
+    0x70, 0x01,                  // 0x20C ADD V0, 0x01
+    0x00, 0xEE                   // 0x20E RET
+};
+
+// digits of the font all over the screen, crossing the word boundaries of
+// the rows and wrapping around, plus a tall sprite from the program
+static const uint8_t draw[] =
+{
+    0x60, 0x00,                  // 0x200 LD V0, 0x00
+    0x61, 0x00,                  // 0x202 LD V1, 0x00
+    0xF0, 0x29,                  // 0x204 LD F, V0
+    0xD0, 0x15,                  // 0x206 DRW V0, V1, 5
+    0xA2, 0x14,                  // 0x208 LD I, 0x214
+    0xD1, 0x0F,                  // 0x20A DRW V1, V0, 15
+    0x70, 0x07,                  // 0x20C ADD V0, 0x07
+    0x71, 0x03,                  // 0x20E ADD V1, 0x03
+    0x12, 0x04,                  // 0x210 JP 0x204
+    0x00, 0x00,
+    0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF,
+    0x18, 0x3C, 0x7E, 0xFF, 0x7E, 0x3C, 0x18
+};
+
+// the registers to ram and back, and BCD
+static const uint8_t memory[] =
+{
+    0xA3, 0x00,                  // 0x200 LD I, 0x300
+    0xFF, 0x55,                  // 0x202 LD [I], VF
+    0xA3, 0x10,                  // 0x204 LD I, 0x310
+    0xFF, 0x65,                  // 0x206 LD VF, [I]
+    0xF0, 0x33,                  // 0x208 LD B, V0
+    0x70, 0x0B,                  // 0x20A ADD V0, 0x0B
+    0x12, 0x00                   // 0x20C JP 0x200
+};
+
+const Workload workloads[] =
+{
+    { "alu",    alu,    sizeof(alu) },
+    { "branch", branch, sizeof(branch) },
+    { "call",   call,   sizeof(call) },
+    { "draw",   draw,   sizeof(draw) },
+    { "memory", memory, sizeof(memory) },
+    { NULL,     NULL,   0 }
+};
+
+//******************************************************************************
+//*                                 runner                                     *
+//******************************************************************************
+
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+uint64_t workload_run(cpu *cpuData, MemMaps *mems, const char *quirks,
+                      const uint8_t *rom, unsigned int size, 
+                      unsigned long count)
+{
+    unsigned long done;
+    unsigned int tick = 0;
+
+    initialize(cpuData, mems, quirks);
+    load_rom(rom, size, mems);
+
+    uint64_t start = monotonic_ns();
+    for (done = 0; done < count; ++done)
+    {
+        if (step(cpuData, mems) != FAULT_NONE) {
+            initialize(cpuData, mems, quirks);
+            load_rom(rom, size, mems);
+        }
+
+        if (++tick == CYCLES_PER_TICK) {
+            timers_step(cpuData);
+            tick = 0;
+        }
+    }
+
+    return monotonic_ns() - start;
+}
+
+//******************************************************************************
+//*                               training mode                                *
+//******************************************************************************
+
+static void train_rom(const char *name, const uint8_t *rom, unsigned int size,
+                      unsigned long cycles, const char *quirks)
+{
+    static cpu cpuData;
+    static MemMaps mems;
+    uint64_t elapsed = workload_run(&cpuData, &mems, quirks, rom, size,
+                                    cycles);
+
+    printf("rom %s %lu %llu %.1f\n", name, cycles,
+           (unsigned long long) elapsed,
+           elapsed ? cycles * 1000.0 / elapsed : 0.0);
+}
+
+int train(char **paths, unsigned int count, unsigned long cycles,
+          const char *quirks)
+{
+    static uint8_t rom[XO_RAM_SIZE - PROG_RAM_START];
+    unsigned int index;
+    int read_all = 1;
+
+    for (index = 0; workloads[index].name != NULL; ++index)
+    {
+        train_rom(workloads[index].name, workloads[index].rom,
+                  workloads[index].size, cycles, quirks);
+    }
+
+    for (index = 0; index < count; ++index)
+    {
+        FILE *file = fopen(paths[index], "rb");
+
+        if (file == NULL) {
+            fprintf(stderr, "chip8: can't read %s\n", paths[index]);
+            read_all = 0;
+            continue;
+        }
+
+        unsigned int size = fread(rom, 1, sizeof(rom), file);
+        fclose(file);
+
+        const char *name = strrchr(paths[index], '/');
+        train_rom(name != NULL ? name + 1 : paths[index], rom, size, cycles,
+                  quirks);
+    }
+
+    return read_all;
+}
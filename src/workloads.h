@@ -0,0 +1,42 @@
+/*
+ * Synthetic roms for the benchmarks, each a loop that never ends hammering
+ * one part of the interpreter. They are also what the profile guided build
+ * trains on, through the headless training mode of train()
+ * */
+#ifndef WORKLOADS_H
+#define WORKLOADS_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+typedef struct Workload
+{
+    const char *name;
+    const uint8_t *rom;
+    unsigned int size;
+} Workload;
+
+// the roms, the last one has a NULL name
+extern const Workload workloads[];
+
+// run count opcodes of the rom on the machine, reset with the quirk profile
+// called quirks and loaded with it, headless and unthrottled. The timers 
+// tick as the emulator ticks them, and the machine starts over when the rom
+// faults or exits. Return the ns it took. This is how both core_bench and
+// the training mode run roms
+uint64_t workload_run(cpu *cpuData, MemMaps *mems, const char *quirks,
+                      const uint8_t *rom, unsigned int size, 
+                      unsigned long count);
+
+// opcodes each rom runs for in the training mode, by default
+#define TRAIN_DEFAULT_CYCLES 20000000
+
+// the training mode, -W: run the workloads, then the roms at paths, headless
+// and unthrottled for cycles opcodes each, with the quirk profile called 
+// quirks. Prints a line per rom like core_bench does. Return 0 if a rom 
+// couldn't be read
+int train(char **paths, unsigned int count, unsigned long cycles,
+          const char *quirks);
+
+#endif
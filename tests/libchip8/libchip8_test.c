@@ -0,0 +1,129 @@
+/*
+ * libchip8_test: runs small roms through libchip8 and checks the status
+ * each run returns, the statuses being the part of the library the
+ * conformance roms can't see. Prints a line per failed check and exits
+ * with 1 if there was any
+ * */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libchip8.h"
+
+static int failed;
+
+static void expect(const char *what, long got, long expected)
+{
+    if (got != expected) {
+        printf("FAIL %s: expected %ld, got %ld\n", what, expected, got);
+        failed = 1;
+    }
+}
+
+// a new machine with quirks and rom loaded
+static Chip8 *machine(const char *quirks, const uint8_t *rom, size_t size)
+{
+    Chip8 *chip8 = chip8_create();
+
+    if (chip8 == NULL || !chip8_set_quirks(chip8, quirks)) {
+        printf("FAIL no %s machine\n", quirks);
+        return NULL;
+    }
+    chip8_load_rom(chip8, rom, size);
+
+    return chip8;
+}
+
+// 00FD ends the program: the run stops with CHIP8_EXIT, and the machine
+// stays on it, however often it's run again
+static void test_exit(const char *quirks)
+{
+    static const uint8_t rom[] = { 0x6A, 0x01, 0x00, 0xFD, 0x6A, 0x02 };
+    uint8_t snapshot[chip8_snapshot_size()];
+    char what[64];
+    Chip8 *chip8 = machine(quirks, rom, sizeof(rom));
+
+    if (chip8 == NULL) {
+        failed = 1;
+        return;
+    }
+
+    snprintf(what, sizeof(what), "00FD with %s", quirks);
+    expect(what, chip8_run_frames(chip8, 10), CHIP8_EXIT);
+
+    snprintf(what, sizeof(what), "00FD with %s run again", quirks);
+    expect(what, chip8_run_cycles(chip8, 10), CHIP8_EXIT);
+
+    // the opcode after the 00FD never ran, so a restored snapshot still
+    // ends where it did
+    chip8_snapshot(chip8, snapshot);
+    chip8_reset(chip8, 1);
+    chip8_restore(chip8, snapshot);
+    snprintf(what, sizeof(what), "00FD with %s restored", quirks);
+    expect(what, chip8_run_cycles(chip8, 1), CHIP8_EXIT);
+
+    chip8_destroy(chip8);
+}
+
+// each fault of the machine maps to its own status
+static void test_faults()
+{
+    static const struct
+    {
+        const char *what;
+        uint8_t rom[4];
+        size_t size;
+        int status;
+    } cases[] =
+    {
+        { "RET with an empty stack", { 0x00, 0xEE }, 2,
+          CHIP8_STACK_UNDERFLOW },
+        { "CALL past 16 levels", { 0x22, 0x00 }, 2, CHIP8_STACK_OVERFLOW },
+        { "FX55 past the ram end", { 0xAF, 0xFF, 0xFF, 0x55 }, 4,
+          CHIP8_RAM_OVERRUN },
+        { "past the end of the rom", { 0x60, 0x01 }, 2, CHIP8_END },
+        { "a jump to itself", { 0x12, 0x00 }, 2, CHIP8_OK }
+    };
+    unsigned int index;
+    Chip8 *chip8;
+
+    for (index = 0; index < sizeof(cases) / sizeof(cases[0]); ++index)
+    {
+        chip8 = machine("default", cases[index].rom, cases[index].size);
+        if (chip8 == NULL) {
+            failed = 1;
+            return;
+        }
+
+        expect(cases[index].what, chip8_run_cycles(chip8, 100),
+               cases[index].status);
+        chip8_destroy(chip8);
+    }
+
+    // pc can only leave the ram from a rom that fills it, or the end of 
+    // the rom comes first
+    uint8_t rom[4096 - 0x200] = { 0x1F, 0xFF };
+
+    chip8 = machine("default", rom, sizeof(rom));
+    if (chip8 == NULL) {
+        failed = 1;
+        return;
+    }
+
+    expect("JP to the last byte", chip8_run_cycles(chip8, 100),
+           CHIP8_PC_OVERRUN);
+    chip8_destroy(chip8);
+}
+
+int main()
+{
+    test_exit("schip");
+    test_exit("xochip");
+    test_faults();
+
+    if (!failed) {
+        printf("libchip8: all passed\n");
+    }
+
+    return failed;
+}